@@ -0,0 +1,604 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef ASYNCHRONOUSCAPSULEOUTPUTMODIFIER_HPP_
+#define ASYNCHRONOUSCAPSULEOUTPUTMODIFIER_HPP_
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "AbstractCellBasedSimulationModifier.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+#include "OutputFileHandler.hpp"
+#include "SimulationTime.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "CapsuleTraceRecorder.hpp"
+
+/**
+ * A modifier that writes per-cell capsule output on a background thread.
+ *
+ * At each sampling step the location, orientation, length, radius and machine
+ * state counts of every cell are copied into a preallocated frame, which is
+ * handed to a writer thread through a bounded queue. Mechanics therefore
+ * continues while the previous frame is formatted and written. When every
+ * frame is in use the back-pressure policy decides whether the simulation
+ * waits for the writer (BLOCK) or skips the sample (DROP_FRAME).
+ *
+ * Each output line holds the time followed by, for each cell, its location
+ * index, cell ID, centre coordinates, theta, (phi in 3D,) length, radius and
+ * the number of machines in each state. The file is flushed and synced to disk
+ * in UpdateAtEndOfSolve(), which throws if any write failed.
+ *
+ * This modifier is intended as a replacement for CellIdWriter,
+ * CapsuleOrientationWriter, CapsuleScalingWriter and MachineStateCountWriter;
+ * it is not archived.
+ */
+template<unsigned DIM>
+class AsynchronousCapsuleOutputModifier : public AbstractCellBasedSimulationModifier<DIM,DIM>
+{
+public:
+
+    /** What to do when a sample is due but every frame is still queued for writing. */
+    enum BackPressurePolicy
+    {
+        BLOCK,
+        DROP_FRAME
+    };
+
+protected:
+
+    /** A snapshot of the per-cell fields needed for one output line. */
+    struct Frame
+    {
+        /** The simulation time at which the snapshot was taken. */
+        double mTime;
+
+        /** Location index of each cell. */
+        std::vector<unsigned> mLocationIndices;
+
+        /** ID of each cell. */
+        std::vector<unsigned> mCellIds;
+
+        /** Centre coordinates, DIM values per cell. */
+        std::vector<double> mLocations;
+
+        /** Theta, phi, length and radius of each cell. */
+        std::vector<double> mShapes;
+
+        /** Number of machines in each state, mNumMachineStates values per cell. */
+        std::vector<unsigned> mMachineStateCounts;
+    };
+
+private:
+
+    /** Number of shape values stored per cell. */
+    static const unsigned NUM_SHAPE_VALUES = 4;
+
+    /** Output is taken every this many time steps. Defaults to 1. */
+    unsigned mSamplingTimestepMultiple;
+
+    /** Number of frames that may be in flight at once. Defaults to 2 (double buffering). */
+    unsigned mQueueCapacity;
+
+    /** Number of machine states to count per cell. Defaults to 6. */
+    unsigned mNumMachineStates;
+
+    /** The back-pressure policy. Defaults to BLOCK. */
+    BackPressurePolicy mBackPressurePolicy;
+
+    /** Name of the output file, relative to the simulation output directory. */
+    std::string mOutputFileName;
+
+    /** The preallocated frames. */
+    std::vector<Frame> mFrames;
+
+    /** Indices of frames available for filling. */
+    std::deque<unsigned> mFreeFrames;
+
+    /** Indices of filled frames waiting to be written, oldest first. */
+    std::deque<unsigned> mQueuedFrames;
+
+    /** Guards mFreeFrames, mQueuedFrames and mStopRequested. */
+    std::mutex mMutex;
+
+    /** Signalled by the writer when a frame is returned to mFreeFrames. */
+    std::condition_variable mFrameFreed;
+
+    /** Signalled by the simulation when a frame is added to mQueuedFrames. */
+    std::condition_variable mFrameQueued;
+
+    /** Whether the writer should exit once the queue is drained. */
+    bool mStopRequested;
+
+    /** The background writer thread. */
+    std::thread mWriterThread;
+
+    /** The output file, owned by the writer thread while it is running. */
+    FILE* mpOutputFile;
+
+    /** Full path of the output file, for error messages. */
+    std::string mOutputFilePath;
+
+    /** Whether a write to the output file has failed; set by the writer thread. */
+    bool mWriteFailed;
+
+    /** Number of samples skipped under the DROP_FRAME policy. */
+    unsigned mNumDroppedFrames;
+
+    /**
+     * Copy the required per-cell fields of the population into a frame.
+     *
+     * @param rCellPopulation reference to the cell population
+     * @param rFrame the frame to fill
+     */
+    void FillFrame(AbstractCellPopulation<DIM,DIM>& rCellPopulation, Frame& rFrame)
+    {
+        const unsigned num_cells = rCellPopulation.GetNumRealCells();
+
+        rFrame.mTime = SimulationTime::Instance()->GetTime();
+        rFrame.mLocationIndices.resize(num_cells);
+        rFrame.mCellIds.resize(num_cells);
+        rFrame.mLocations.resize(DIM*num_cells);
+        rFrame.mShapes.resize(NUM_SHAPE_VALUES*num_cells);
+        rFrame.mMachineStateCounts.assign(mNumMachineStates*num_cells, 0u);
+
+        unsigned cell_count = 0;
+        for (typename AbstractCellPopulation<DIM,DIM>::Iterator cell_iter = rCellPopulation.Begin();
+             cell_iter != rCellPopulation.End();
+             ++cell_iter)
+        {
+            unsigned location_index = rCellPopulation.GetLocationIndexUsingCell(*cell_iter);
+            Node<DIM>* p_node = rCellPopulation.GetNode(location_index);
+            const std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+            const c_vector<double, DIM>& r_location = p_node->rGetLocation();
+
+            rFrame.mLocationIndices[cell_count] = location_index;
+            rFrame.mCellIds[cell_count] = cell_iter->GetCellId();
+            for (unsigned i=0; i<DIM; i++)
+            {
+                rFrame.mLocations[DIM*cell_count + i] = r_location[i];
+            }
+            rFrame.mShapes[NUM_SHAPE_VALUES*cell_count] = r_attributes[NA_THETA];
+            rFrame.mShapes[NUM_SHAPE_VALUES*cell_count + 1] = (DIM == 3) ? r_attributes[NA_PHI] : 0.0;
+            rFrame.mShapes[NUM_SHAPE_VALUES*cell_count + 2] = r_attributes[NA_LENGTH];
+            rFrame.mShapes[NUM_SHAPE_VALUES*cell_count + 3] = r_attributes[NA_RADIUS];
+
+            CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+            if (collection.GetSize() == 1)
+            {
+                boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+                for (const auto& r_pair : p_property->rGetMachineData())
+                {
+                    if (r_pair.first < mNumMachineStates)
+                    {
+                        rFrame.mMachineStateCounts[mNumMachineStates*cell_count + r_pair.first]++;
+                    }
+                }
+            }
+            cell_count++;
+        }
+
+        // Ghost or deleted entries do not appear in the iteration
+        rFrame.mLocationIndices.resize(cell_count);
+        rFrame.mCellIds.resize(cell_count);
+        rFrame.mLocations.resize(DIM*cell_count);
+        rFrame.mShapes.resize(NUM_SHAPE_VALUES*cell_count);
+        rFrame.mMachineStateCounts.resize(mNumMachineStates*cell_count);
+    }
+
+    /**
+     * Write formatted output to the output file, recording any failure in
+     * mWriteFailed. Called only from the writer thread.
+     *
+     * @param format the printf format
+     * @param args the values to format
+     */
+    template<typename... ARGS>
+    void Print(const char* format, ARGS... args)
+    {
+        if (fprintf(mpOutputFile, format, args...) < 0)
+        {
+            mWriteFailed = true;
+        }
+    }
+
+protected:
+
+    /**
+     * Format a frame as a single output line and write it to the output file.
+     * Called only from the writer thread; overridden in tests to hold the writer.
+     *
+     * @param rFrame the frame to write
+     */
+    virtual void WriteFrame(const Frame& rFrame)
+    {
+        Print("%.10g\t", rFrame.mTime);
+        for (unsigned cell=0; cell<rFrame.mCellIds.size(); cell++)
+        {
+            Print("%u %u ", rFrame.mLocationIndices[cell], rFrame.mCellIds[cell]);
+            for (unsigned i=0; i<DIM; i++)
+            {
+                Print("%.10g ", rFrame.mLocations[DIM*cell + i]);
+            }
+            Print("%.10g ", rFrame.mShapes[NUM_SHAPE_VALUES*cell]);
+            if (DIM == 3)
+            {
+                Print("%.10g ", rFrame.mShapes[NUM_SHAPE_VALUES*cell + 1]);
+            }
+            Print("%.10g %.10g ", rFrame.mShapes[NUM_SHAPE_VALUES*cell + 2], rFrame.mShapes[NUM_SHAPE_VALUES*cell + 3]);
+            for (unsigned state=0; state<mNumMachineStates; state++)
+            {
+                Print("%u ", rFrame.mMachineStateCounts[mNumMachineStates*cell + state]);
+            }
+        }
+        Print("\n");
+    }
+
+private:
+
+    /**
+     * Main loop of the writer thread: write queued frames in order until a stop
+     * is requested and the queue is empty.
+     */
+    void RunWriter()
+    {
+#ifdef CAPSULE_PROFILING
+        CapsuleTraceRecorder::SetThreadName("AsynchronousCapsuleOutputWriter");
+#endif
+        while (true)
+        {
+            unsigned frame_index;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mFrameQueued.wait(lock, [this]{ return mStopRequested || !mQueuedFrames.empty(); });
+                if (mQueuedFrames.empty())
+                {
+                    break;
+                }
+                frame_index = mQueuedFrames.front();
+                mQueuedFrames.pop_front();
+            }
+
+            // After a failure the remaining frames are discarded
+            if (!mWriteFailed)
+            {
+                CAPSULE_TRACE_SCOPE("WriteFrame");
+                WriteFrame(mFrames[frame_index]);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mFreeFrames.push_back(frame_index);
+            }
+            mFrameFreed.notify_one();
+        }
+    }
+
+    /**
+     * Take a snapshot of the population and queue it for writing, applying the
+     * back-pressure policy if no frame is free.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    void QueueSnapshot(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        unsigned frame_index;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mFreeFrames.empty() && mBackPressurePolicy == DROP_FRAME)
+            {
+                mNumDroppedFrames++;
+                return;
+            }
+            mFrameFreed.wait(lock, [this]{ return !mFreeFrames.empty(); });
+            frame_index = mFreeFrames.front();
+            mFreeFrames.pop_front();
+        }
+
+        // The writer never touches a frame that is not in the queue, so fill without the lock
+        FillFrame(rCellPopulation, mFrames[frame_index]);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQueuedFrames.push_back(frame_index);
+        }
+        mFrameQueued.notify_one();
+    }
+
+    /**
+     * Drain the queue, stop the writer thread, and flush, sync and close the
+     * output file. Safe to call more than once.
+     *
+     * @return whether every write, the flush, the sync and the close succeeded
+     */
+    bool StopWriter()
+    {
+        if (mWriterThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopRequested = true;
+            }
+            mFrameQueued.notify_one();
+            mWriterThread.join();
+        }
+
+        if (mpOutputFile != nullptr)
+        {
+            CAPSULE_TRACE_SCOPE("FlushCapsuleOutput");
+            if (fflush(mpOutputFile) != 0 || fsync(fileno(mpOutputFile)) != 0)
+            {
+                mWriteFailed = true;
+            }
+            if (fclose(mpOutputFile) != 0)
+            {
+                mWriteFailed = true;
+            }
+            mpOutputFile = nullptr;
+        }
+        return !mWriteFailed;
+    }
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    AsynchronousCapsuleOutputModifier()
+        : AbstractCellBasedSimulationModifier<DIM,DIM>(),
+          mSamplingTimestepMultiple(1u),
+          mQueueCapacity(2u),
+          mNumMachineStates(6u),
+          mBackPressurePolicy(BLOCK),
+          mOutputFileName("capsules.dat"),
+          mStopRequested(false),
+          mpOutputFile(nullptr),
+          mWriteFailed(false),
+          mNumDroppedFrames(0u)
+    {
+    }
+
+    /**
+     * Destructor. Stops the writer thread if the simulation ended abnormally.
+     */
+    virtual ~AsynchronousCapsuleOutputModifier()
+    {
+        StopWriter();
+    }
+
+    /**
+     * @return mSamplingTimestepMultiple
+     */
+    unsigned GetSamplingTimestepMultiple() const
+    {
+        return mSamplingTimestepMultiple;
+    }
+
+    /**
+     * Set mSamplingTimestepMultiple. Use the same value as the simulation.
+     *
+     * @param samplingTimestepMultiple the new value
+     */
+    void SetSamplingTimestepMultiple(unsigned samplingTimestepMultiple)
+    {
+        if (samplingTimestepMultiple == 0)
+        {
+            EXCEPTION("The sampling timestep multiple must be positive");
+        }
+        mSamplingTimestepMultiple = samplingTimestepMultiple;
+    }
+
+    /**
+     * @return mQueueCapacity
+     */
+    unsigned GetQueueCapacity() const
+    {
+        return mQueueCapacity;
+    }
+
+    /**
+     * Set mQueueCapacity, the number of frames that may be in flight at once.
+     *
+     * @param queueCapacity the new value
+     */
+    void SetQueueCapacity(unsigned queueCapacity)
+    {
+        if (queueCapacity == 0)
+        {
+            EXCEPTION("The queue capacity must be positive");
+        }
+        mQueueCapacity = queueCapacity;
+    }
+
+    /**
+     * @return mNumMachineStates
+     */
+    unsigned GetNumMachineStates() const
+    {
+        return mNumMachineStates;
+    }
+
+    /**
+     * Set mNumMachineStates. Machines in states outside [0, numMachineStates) are not counted.
+     *
+     * @param numMachineStates the new value
+     */
+    void SetNumMachineStates(unsigned numMachineStates)
+    {
+        if (numMachineStates == 0)
+        {
+            EXCEPTION("The number of machine states must be positive");
+        }
+        mNumMachineStates = numMachineStates;
+    }
+
+    /**
+     * @return mBackPressurePolicy
+     */
+    BackPressurePolicy GetBackPressurePolicy() const
+    {
+        return mBackPressurePolicy;
+    }
+
+    /**
+     * Set mBackPressurePolicy.
+     *
+     * @param backPressurePolicy the new value
+     */
+    void SetBackPressurePolicy(BackPressurePolicy backPressurePolicy)
+    {
+        mBackPressurePolicy = backPressurePolicy;
+    }
+
+    /**
+     * @return mOutputFileName
+     */
+    const std::string& rGetOutputFileName() const
+    {
+        return mOutputFileName;
+    }
+
+    /**
+     * Set mOutputFileName.
+     *
+     * @param rOutputFileName the new value
+     */
+    void SetOutputFileName(const std::string& rOutputFileName)
+    {
+        mOutputFileName = rOutputFileName;
+    }
+
+    /**
+     * @return the number of samples skipped under the DROP_FRAME policy
+     */
+    unsigned GetNumDroppedFrames() const
+    {
+        return mNumDroppedFrames;
+    }
+
+    /**
+     * Overridden SetupSolve() method.
+     *
+     * Open the output file, start the writer thread and queue the initial frame.
+     *
+     * @param rCellPopulation reference to the cell population
+     * @param outputDirectory the output directory, relative to where Chaste output is stored
+     */
+    virtual void SetupSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation, std::string outputDirectory)
+    {
+        StopWriter();
+
+        OutputFileHandler output_file_handler(outputDirectory, false);
+        mOutputFilePath = output_file_handler.GetOutputDirectoryFullPath() + mOutputFileName;
+        mpOutputFile = fopen(mOutputFilePath.c_str(), "w");
+        if (mpOutputFile == nullptr)
+        {
+            EXCEPTION("Could not open " << mOutputFilePath << " for writing");
+        }
+        mWriteFailed = false;
+
+        mFrames.assign(mQueueCapacity, Frame());
+        mFreeFrames.clear();
+        mQueuedFrames.clear();
+        for (unsigned i=0; i<mQueueCapacity; i++)
+        {
+            mFreeFrames.push_back(i);
+        }
+        mStopRequested = false;
+        mNumDroppedFrames = 0;
+
+        mWriterThread = std::thread(&AsynchronousCapsuleOutputModifier<DIM>::RunWriter, this);
+
+        QueueSnapshot(rCellPopulation);
+    }
+
+    /**
+     * Overridden UpdateAtEndOfTimeStep() method.
+     *
+     * Queue a frame if this is a sampling step.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfTimeStep(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        if (SimulationTime::Instance()->GetTimeStepsElapsed() % mSamplingTimestepMultiple == 0)
+        {
+            QueueSnapshot(rCellPopulation);
+        }
+    }
+
+    /**
+     * Overridden UpdateAtEndOfSolve() method.
+     *
+     * Write any outstanding frames and flush and sync the output file.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        if (!StopWriter())
+        {
+            EXCEPTION("Error writing " << mOutputFilePath);
+        }
+    }
+
+    /**
+     * Overridden OutputSimulationModifierParameters() method.
+     * Output any simulation modifier parameters to file.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputSimulationModifierParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<SamplingTimestepMultiple>" << mSamplingTimestepMultiple << "</SamplingTimestepMultiple>\n";
+        *rParamsFile << "\t\t\t<QueueCapacity>" << mQueueCapacity << "</QueueCapacity>\n";
+        *rParamsFile << "\t\t\t<NumMachineStates>" << mNumMachineStates << "</NumMachineStates>\n";
+        *rParamsFile << "\t\t\t<BackPressurePolicy>" << mBackPressurePolicy << "</BackPressurePolicy>\n";
+
+        // Next, call method on direct parent class
+        AbstractCellBasedSimulationModifier<DIM,DIM>::OutputSimulationModifierParameters(rParamsFile);
+    }
+};
+
+#endif /*ASYNCHRONOUSCAPSULEOUTPUTMODIFIER_HPP_*/
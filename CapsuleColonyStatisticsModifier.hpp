@@ -0,0 +1,570 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULECOLONYSTATISTICSMODIFIER_HPP_
+#define CAPSULECOLONYSTATISTICSMODIFIER_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "AbstractCellBasedSimulationModifier.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+#include "OutputFileHandler.hpp"
+#include "SimulationTime.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "UblasCustomFunctions.hpp"
+
+/**
+ * A modifier that computes colony-level statistics of a capsule population in
+ * situ and writes one row per sample, as an alternative to per-cell output for
+ * parameter sweeps.
+ *
+ * Each row of colonystatistics.dat holds: the time; the number of cells; the
+ * number of cells born and killed since the previous sample; the total number
+ * of machines in each state; the nematic order parameter of the capsule axes;
+ * the radius of gyration and maximum radial extent of the colony about its
+ * centroid; the mean and standard deviation of capsule length; and a histogram
+ * of capsule lengths over fixed bins.
+ *
+ * All quantities are accumulated in a single sweep over the cells (Welford's
+ * algorithm for the length moments and an O(N) accumulation of the nematic
+ * order tensor), followed by a sweep over a buffer of cell centres for the
+ * radial extent.
+ *
+ * Births are detected from cell IDs exceeding the largest seen at the previous
+ * sample, and kills from the change in population size, so a cell that is born
+ * and killed between two samples is not counted.
+ */
+template<unsigned DIM>
+class CapsuleColonyStatisticsModifier : public AbstractCellBasedSimulationModifier<DIM,DIM>
+{
+private:
+
+    /** Output is taken every this many time steps. Defaults to 1. */
+    unsigned mSamplingTimestepMultiple;
+
+    /** Number of machine states in the histogram. Defaults to 6. */
+    unsigned mNumMachineStates;
+
+    /** Number of bins in the length histogram. Defaults to 10. */
+    unsigned mNumLengthBins;
+
+    /** Lower edge of the length histogram. Defaults to 0. */
+    double mMinLength;
+
+    /** Upper edge of the length histogram. Defaults to 5; longer capsules go in the last bin. */
+    double mMaxLength;
+
+    /** Output file stream. */
+    out_stream mpOutputFile;
+
+    /** Buffer of cell centres, reused between samples. */
+    std::vector<c_vector<double, DIM> > mCentres;
+
+    /** Whether any sample has been taken. */
+    bool mHasPreviousSample;
+
+    /** Largest cell ID seen at the previous sample. */
+    unsigned mMaxCellId;
+
+    /** Number of cells at the previous sample. */
+    unsigned mPreviousNumCells;
+
+    /** Number of cells at the last sample. */
+    unsigned mNumCells;
+
+    /** Number of cells born between the last two samples. */
+    unsigned mNumBirths;
+
+    /** Number of cells killed between the last two samples. */
+    unsigned mNumDeaths;
+
+    /** Total number of machines in each state at the last sample. */
+    std::vector<unsigned> mMachineStateHistogram;
+
+    /** Nematic order parameter at the last sample. */
+    double mNematicOrder;
+
+    /** Radius of gyration at the last sample. */
+    double mRadiusOfGyration;
+
+    /** Maximum distance of a cell centre from the colony centroid at the last sample. */
+    double mRadialExtent;
+
+    /** Mean capsule length at the last sample. */
+    double mMeanLength;
+
+    /** Standard deviation of capsule length at the last sample. */
+    double mLengthStandardDeviation;
+
+    /** Histogram of capsule lengths at the last sample. */
+    std::vector<unsigned> mLengthHistogram;
+
+    /**
+     * @param rQ a symmetric 3x3 matrix
+     * @return its largest eigenvalue
+     */
+    static double LargestEigenvalueOfSymmetricMatrix(const c_matrix<double, 3, 3>& rQ)
+    {
+        double off_diagonal = rQ(0,1)*rQ(0,1) + rQ(0,2)*rQ(0,2) + rQ(1,2)*rQ(1,2);
+        if (off_diagonal == 0.0)
+        {
+            return std::max(rQ(0,0), std::max(rQ(1,1), rQ(2,2)));
+        }
+
+        double q = (rQ(0,0) + rQ(1,1) + rQ(2,2))/3.0;
+        double p = sqrt(((rQ(0,0)-q)*(rQ(0,0)-q) + (rQ(1,1)-q)*(rQ(1,1)-q) + (rQ(2,2)-q)*(rQ(2,2)-q) + 2.0*off_diagonal)/6.0);
+
+        c_matrix<double, 3, 3> b = rQ;
+        for (unsigned i=0; i<3; i++)
+        {
+            b(i,i) -= q;
+        }
+        b /= p;
+
+        double half_det_b = 0.5*(b(0,0)*(b(1,1)*b(2,2) - b(1,2)*b(2,1))
+                                 - b(0,1)*(b(1,0)*b(2,2) - b(1,2)*b(2,0))
+                                 + b(0,2)*(b(1,0)*b(2,1) - b(1,1)*b(2,0)));
+        half_det_b = std::max(-1.0, std::min(1.0, half_det_b));
+
+        return q + 2.0*p*cos(acos(half_det_b)/3.0);
+    }
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    CapsuleColonyStatisticsModifier()
+        : AbstractCellBasedSimulationModifier<DIM,DIM>(),
+          mSamplingTimestepMultiple(1u),
+          mNumMachineStates(6u),
+          mNumLengthBins(10u),
+          mMinLength(0.0),
+          mMaxLength(5.0),
+          mHasPreviousSample(false),
+          mMaxCellId(0u),
+          mPreviousNumCells(0u),
+          mNumCells(0u),
+          mNumBirths(0u),
+          mNumDeaths(0u),
+          mNematicOrder(0.0),
+          mRadiusOfGyration(0.0),
+          mRadialExtent(0.0),
+          mMeanLength(0.0),
+          mLengthStandardDeviation(0.0)
+    {
+    }
+
+    /**
+     * @return mSamplingTimestepMultiple
+     */
+    unsigned GetSamplingTimestepMultiple() const
+    {
+        return mSamplingTimestepMultiple;
+    }
+
+    /**
+     * Set mSamplingTimestepMultiple.
+     *
+     * @param samplingTimestepMultiple the new value
+     */
+    void SetSamplingTimestepMultiple(unsigned samplingTimestepMultiple)
+    {
+        if (samplingTimestepMultiple == 0)
+        {
+            EXCEPTION("The sampling timestep multiple must be positive");
+        }
+        mSamplingTimestepMultiple = samplingTimestepMultiple;
+    }
+
+    /**
+     * @return mNumMachineStates
+     */
+    unsigned GetNumMachineStates() const
+    {
+        return mNumMachineStates;
+    }
+
+    /**
+     * Set mNumMachineStates. Machines in states outside [0, numMachineStates) are not counted.
+     *
+     * @param numMachineStates the new value
+     */
+    void SetNumMachineStates(unsigned numMachineStates)
+    {
+        mNumMachineStates = numMachineStates;
+    }
+
+    /**
+     * Set the bins of the length histogram.
+     *
+     * @param numBins the number of bins
+     * @param minLength the lower edge of the first bin
+     * @param maxLength the upper edge of the last bin
+     */
+    void SetLengthHistogramBins(unsigned numBins, double minLength, double maxLength)
+    {
+        if (numBins == 0 || !(maxLength > minLength))
+        {
+            EXCEPTION("The length histogram needs at least one bin and maxLength > minLength");
+        }
+        mNumLengthBins = numBins;
+        mMinLength = minLength;
+        mMaxLength = maxLength;
+    }
+
+    /**
+     * @return the number of length histogram bins
+     */
+    unsigned GetNumLengthBins() const
+    {
+        return mNumLengthBins;
+    }
+
+    /** @return the number of cells at the last sample */
+    unsigned GetNumCells() const
+    {
+        return mNumCells;
+    }
+
+    /** @return the number of cells born between the last two samples */
+    unsigned GetNumBirths() const
+    {
+        return mNumBirths;
+    }
+
+    /** @return the number of cells killed between the last two samples */
+    unsigned GetNumDeaths() const
+    {
+        return mNumDeaths;
+    }
+
+    /** @return the total number of machines in each state at the last sample */
+    const std::vector<unsigned>& rGetMachineStateHistogram() const
+    {
+        return mMachineStateHistogram;
+    }
+
+    /** @return the nematic order parameter at the last sample */
+    double GetNematicOrder() const
+    {
+        return mNematicOrder;
+    }
+
+    /** @return the radius of gyration at the last sample */
+    double GetRadiusOfGyration() const
+    {
+        return mRadiusOfGyration;
+    }
+
+    /** @return the maximum distance of a cell centre from the centroid at the last sample */
+    double GetRadialExtent() const
+    {
+        return mRadialExtent;
+    }
+
+    /** @return the mean capsule length at the last sample */
+    double GetMeanLength() const
+    {
+        return mMeanLength;
+    }
+
+    /** @return the standard deviation of capsule length at the last sample */
+    double GetLengthStandardDeviation() const
+    {
+        return mLengthStandardDeviation;
+    }
+
+    /** @return the histogram of capsule lengths at the last sample */
+    const std::vector<unsigned>& rGetLengthHistogram() const
+    {
+        return mLengthHistogram;
+    }
+
+    /**
+     * Compute the statistics of the population and store them as the last sample.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    void ComputeStatistics(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        mMachineStateHistogram.assign(mNumMachineStates, 0u);
+        mLengthHistogram.assign(mNumLengthBins, 0u);
+        mCentres.clear();
+
+        unsigned num_births = 0;
+        unsigned max_cell_id = mMaxCellId;
+
+        // Welford accumulators for the length
+        unsigned num_cells = 0;
+        double length_mean = 0.0;
+        double length_m2 = 0.0;
+
+        // Accumulator for the centroid
+        c_vector<double, DIM> centre_sum = zero_vector<double>(DIM);
+
+        // Accumulators for the nematic order tensor (in 2D only the first two are used)
+        c_matrix<double, 3, 3> uu_sum = boost::numeric::ublas::zero_matrix<double>(3, 3);
+        double cos_sum = 0.0;
+        double sin_sum = 0.0;
+
+        const double bin_width = (mMaxLength - mMinLength)/mNumLengthBins;
+
+        for (typename AbstractCellPopulation<DIM,DIM>::Iterator cell_iter = rCellPopulation.Begin();
+             cell_iter != rCellPopulation.End();
+             ++cell_iter)
+        {
+            unsigned cell_id = cell_iter->GetCellId();
+            if (mHasPreviousSample && cell_id > mMaxCellId)
+            {
+                num_births++;
+            }
+            max_cell_id = std::max(max_cell_id, cell_id);
+
+            Node<DIM>* p_node = rCellPopulation.GetNode(rCellPopulation.GetLocationIndexUsingCell(*cell_iter));
+            const std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+            const c_vector<double, DIM>& r_location = p_node->rGetLocation();
+
+            num_cells++;
+
+            double length = r_attributes[NA_LENGTH];
+            double delta = length - length_mean;
+            length_mean += delta/num_cells;
+            length_m2 += delta*(length - length_mean);
+
+            int bin = static_cast<int>(floor((length - mMinLength)/bin_width));
+            bin = std::max(0, std::min(static_cast<int>(mNumLengthBins) - 1, bin));
+            mLengthHistogram[bin]++;
+
+            centre_sum += r_location;
+            mCentres.push_back(r_location);
+
+            double theta = r_attributes[NA_THETA];
+            if (DIM == 2)
+            {
+                cos_sum += cos(2.0*theta);
+                sin_sum += sin(2.0*theta);
+            }
+            else
+            {
+                double phi = r_attributes[NA_PHI];
+                double axis[3] = {cos(theta)*sin(phi), sin(theta)*sin(phi), cos(phi)};
+                for (unsigned i=0; i<3; i++)
+                {
+                    for (unsigned j=i; j<3; j++)
+                    {
+                        uu_sum(i,j) += axis[i]*axis[j];
+                    }
+                }
+            }
+
+            CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+            if (collection.GetSize() == 1)
+            {
+                boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+                for (const auto& r_pair : p_property->rGetMachineData())
+                {
+                    if (r_pair.first < mNumMachineStates)
+                    {
+                        mMachineStateHistogram[r_pair.first]++;
+                    }
+                }
+            }
+        }
+
+        mNumBirths = num_births;
+        mNumDeaths = mHasPreviousSample ? (mPreviousNumCells + num_births - num_cells) : 0u;
+        mNumCells = num_cells;
+        mPreviousNumCells = num_cells;
+        mMaxCellId = max_cell_id;
+        mHasPreviousSample = true;
+
+        if (num_cells == 0)
+        {
+            mNematicOrder = 0.0;
+            mRadiusOfGyration = 0.0;
+            mRadialExtent = 0.0;
+            mMeanLength = 0.0;
+            mLengthStandardDeviation = 0.0;
+            return;
+        }
+
+        mMeanLength = length_mean;
+        mLengthStandardDeviation = sqrt(length_m2/num_cells);
+
+        if (DIM == 2)
+        {
+            mNematicOrder = sqrt(cos_sum*cos_sum + sin_sum*sin_sum)/num_cells;
+        }
+        else
+        {
+            // Q = (3 <u u^T> - I)/2
+            c_matrix<double, 3, 3> q;
+            for (unsigned i=0; i<3; i++)
+            {
+                for (unsigned j=i; j<3; j++)
+                {
+                    q(i,j) = 1.5*uu_sum(i,j)/num_cells - (i == j ? 0.5 : 0.0);
+                    q(j,i) = q(i,j);
+                }
+            }
+            mNematicOrder = LargestEigenvalueOfSymmetricMatrix(q);
+        }
+
+        // Distances are taken about the centroid to avoid cancellation far from the origin
+        c_vector<double, DIM> centroid = centre_sum/num_cells;
+        double squared_distance_sum = 0.0;
+        double max_squared_distance = 0.0;
+        for (const auto& r_centre : mCentres)
+        {
+            double squared_distance = 0.0;
+            for (unsigned i=0; i<DIM; i++)
+            {
+                squared_distance += (r_centre[i] - centroid[i])*(r_centre[i] - centroid[i]);
+            }
+            squared_distance_sum += squared_distance;
+            max_squared_distance = std::max(max_squared_distance, squared_distance);
+        }
+        mRadiusOfGyration = sqrt(squared_distance_sum/num_cells);
+        mRadialExtent = sqrt(max_squared_distance);
+    }
+
+    /**
+     * Overridden SetupSolve() method.
+     *
+     * Open the output file, write the column headings and the initial sample.
+     *
+     * @param rCellPopulation reference to the cell population
+     * @param outputDirectory the output directory, relative to where Chaste output is stored
+     */
+    virtual void SetupSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation, std::string outputDirectory)
+    {
+        OutputFileHandler output_file_handler(outputDirectory, false);
+        mpOutputFile = output_file_handler.OpenOutputFile("colonystatistics.dat");
+
+        *mpOutputFile << "# time num_cells num_births num_deaths";
+        for (unsigned state=0; state<mNumMachineStates; state++)
+        {
+            *mpOutputFile << " machines_state_" << state;
+        }
+        *mpOutputFile << " nematic_order radius_of_gyration radial_extent mean_length sd_length";
+        for (unsigned bin=0; bin<mNumLengthBins; bin++)
+        {
+            *mpOutputFile << " length_bin_" << bin;
+        }
+        *mpOutputFile << "\n";
+
+        mHasPreviousSample = false;
+        mMaxCellId = 0;
+        WriteSample(rCellPopulation);
+    }
+
+    /**
+     * Compute the statistics of the population and write them as one row.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    void WriteSample(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        ComputeStatistics(rCellPopulation);
+
+        *mpOutputFile << SimulationTime::Instance()->GetTime() << " " << mNumCells << " " << mNumBirths << " " << mNumDeaths;
+        for (unsigned state=0; state<mNumMachineStates; state++)
+        {
+            *mpOutputFile << " " << mMachineStateHistogram[state];
+        }
+        *mpOutputFile << " " << mNematicOrder << " " << mRadiusOfGyration << " " << mRadialExtent
+                      << " " << mMeanLength << " " << mLengthStandardDeviation;
+        for (unsigned bin=0; bin<mNumLengthBins; bin++)
+        {
+            *mpOutputFile << " " << mLengthHistogram[bin];
+        }
+        *mpOutputFile << "\n";
+    }
+
+    /**
+     * Overridden UpdateAtEndOfTimeStep() method.
+     *
+     * Write a row if this is a sampling step.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfTimeStep(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        if (SimulationTime::Instance()->GetTimeStepsElapsed() % mSamplingTimestepMultiple == 0)
+        {
+            WriteSample(rCellPopulation);
+        }
+    }
+
+    /**
+     * Overridden UpdateAtEndOfSolve() method.
+     *
+     * Close the output file.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        if (mpOutputFile)
+        {
+            mpOutputFile->close();
+        }
+    }
+
+    /**
+     * Overridden OutputSimulationModifierParameters() method.
+     * Output any simulation modifier parameters to file.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputSimulationModifierParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<SamplingTimestepMultiple>" << mSamplingTimestepMultiple << "</SamplingTimestepMultiple>\n";
+        *rParamsFile << "\t\t\t<NumMachineStates>" << mNumMachineStates << "</NumMachineStates>\n";
+        *rParamsFile << "\t\t\t<NumLengthBins>" << mNumLengthBins << "</NumLengthBins>\n";
+        *rParamsFile << "\t\t\t<MinLength>" << mMinLength << "</MinLength>\n";
+        *rParamsFile << "\t\t\t<MaxLength>" << mMaxLength << "</MaxLength>\n";
+
+        // Next, call method on direct parent class
+        AbstractCellBasedSimulationModifier<DIM,DIM>::OutputSimulationModifierParameters(rParamsFile);
+    }
+};
+
+#endif /*CAPSULECOLONYSTATISTICSMODIFIER_HPP_*/
@@ -0,0 +1,299 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULECONTACTISLANDS_HPP_
+#define CAPSULECONTACTISLANDS_HPP_
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include "Exception.hpp"
+#include "NodeBasedCellPopulation.hpp"
+#include "CapsuleForce.hpp"
+
+/**
+ * Partitions a capsule population into contact islands: the connected
+ * components of the graph whose edges are the pairs of capsules that touch.
+ *
+ * Compute() visits the node pairs of the population once, tests each pair
+ * with the capsule geometry of CapsuleForce, and merges touching capsules
+ * with a union-find (union by size with path halving). Islands are then
+ * numbered in node iteration order and stored in compressed form, so the
+ * node indices of island i are
+ * rGetIslandNodeIndices()[rGetIslandOffsets()[i]] up to, but not including,
+ * rGetIslandNodeIndices()[rGetIslandOffsets()[i+1]].
+ *
+ * Contacts can break as well as form, so the islands are recomputed from
+ * scratch on each call; the storage is reused between calls. Islands do not
+ * interact, so each can be integrated or analysed independently.
+ *
+ * This class is not archived.
+ */
+template<unsigned DIM>
+class CapsuleContactIslands
+{
+private:
+
+    /** Marks entries of mParents for node indices not in use. */
+    static const unsigned UNUSED_INDEX = UINT_MAX;
+
+    /** Used for the capsule contact geometry. */
+    CapsuleForce<DIM> mGeometry;
+
+    /**
+     * Capsules closer than this count as touching even if they do not
+     * overlap. Defaults to 0.
+     */
+    double mContactTolerance;
+
+    /** Union-find parent of each node index. */
+    std::vector<unsigned> mParents;
+
+    /** Union-find tree size of each root. */
+    std::vector<unsigned> mSizes;
+
+    /** Island of each node index. */
+    std::vector<unsigned> mIslandOfNode;
+
+    /** Start of each island in mIslandNodeIndices, plus the total at the end. */
+    std::vector<unsigned> mIslandOffsets;
+
+    /** Node indices grouped by island. */
+    std::vector<unsigned> mIslandNodeIndices;
+
+    /** Number of touching pairs found by the last call to Compute(). */
+    unsigned mNumContacts;
+
+    /**
+     * @param index a node index
+     * @return the root of the tree containing index
+     */
+    unsigned FindRoot(unsigned index)
+    {
+        while (mParents[index] != index)
+        {
+            mParents[index] = mParents[mParents[index]];
+            index = mParents[index];
+        }
+        return index;
+    }
+
+    /**
+     * Merge the trees containing two node indices.
+     *
+     * @param indexA the first node index
+     * @param indexB the second node index
+     */
+    void Union(unsigned indexA, unsigned indexB)
+    {
+        unsigned root_a = FindRoot(indexA);
+        unsigned root_b = FindRoot(indexB);
+        if (root_a == root_b)
+        {
+            return;
+        }
+        if (mSizes[root_a] < mSizes[root_b])
+        {
+            std::swap(root_a, root_b);
+        }
+        mParents[root_b] = root_a;
+        mSizes[root_a] += mSizes[root_b];
+    }
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CapsuleContactIslands()
+        : mContactTolerance(0.0),
+          mNumContacts(0u)
+    {
+        mIslandOffsets.push_back(0u);
+    }
+
+    /**
+     * Compute the contact islands of a population.
+     *
+     * @param rCellPopulation the cell population, whose node pairs must be up to date
+     * @return the number of islands
+     */
+    unsigned Compute(NodeBasedCellPopulation<DIM>& rCellPopulation)
+    {
+        NodesOnlyMesh<DIM>& r_mesh = rCellPopulation.rGetMesh();
+        const unsigned max_index = r_mesh.GetMaximumNodeIndex();
+        mParents.assign(max_index, UNUSED_INDEX);
+        mSizes.assign(max_index, 1u);
+        mIslandOfNode.assign(max_index, UNUSED_INDEX);
+
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = r_mesh.GetNodeIteratorBegin();
+             node_iter != r_mesh.GetNodeIteratorEnd();
+             ++node_iter)
+        {
+            mParents[node_iter->GetIndex()] = node_iter->GetIndex();
+        }
+
+        mNumContacts = 0;
+        c_vector<double, DIM> vec_a_to_b;
+        double contact_dist_a;
+        double contact_dist_b;
+        std::vector<std::pair<Node<DIM>*, Node<DIM>*> >& r_node_pairs = rCellPopulation.rGetNodePairs();
+        for (unsigned i=0; i<r_node_pairs.size(); i++)
+        {
+            Node<DIM>* p_node_a = r_node_pairs[i].first;
+            Node<DIM>* p_node_b = r_node_pairs[i].second;
+            double overlap = mGeometry.CalculateForceDirectionAndContactPoints(*p_node_a, *p_node_b, vec_a_to_b, contact_dist_a, contact_dist_b);
+            if (overlap + mContactTolerance > 0.0)
+            {
+                mNumContacts++;
+                Union(p_node_a->GetIndex(), p_node_b->GetIndex());
+            }
+        }
+
+        // Number the islands by their first node, and count their sizes
+        unsigned num_islands = 0;
+        mIslandOffsets.assign(1u, 0u);
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = r_mesh.GetNodeIteratorBegin();
+             node_iter != r_mesh.GetNodeIteratorEnd();
+             ++node_iter)
+        {
+            unsigned root = FindRoot(node_iter->GetIndex());
+            if (mIslandOfNode[root] == UNUSED_INDEX)
+            {
+                mIslandOfNode[root] = num_islands++;
+                mIslandOffsets.push_back(0u);
+            }
+            unsigned island = mIslandOfNode[root];
+            mIslandOfNode[node_iter->GetIndex()] = island;
+            mIslandOffsets[island + 1]++;
+        }
+        for (unsigned island=0; island<num_islands; island++)
+        {
+            mIslandOffsets[island + 1] += mIslandOffsets[island];
+        }
+
+        // Counting sort of the node indices by island, reusing mSizes as the insertion points
+        mIslandNodeIndices.resize(mIslandOffsets[num_islands]);
+        mSizes.assign(mIslandOffsets.begin(), mIslandOffsets.end() - 1);
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = r_mesh.GetNodeIteratorBegin();
+             node_iter != r_mesh.GetNodeIteratorEnd();
+             ++node_iter)
+        {
+            unsigned island = mIslandOfNode[node_iter->GetIndex()];
+            mIslandNodeIndices[mSizes[island]++] = node_iter->GetIndex();
+        }
+
+        return num_islands;
+    }
+
+    /**
+     * @return the number of islands found by the last call to Compute()
+     */
+    unsigned GetNumIslands() const
+    {
+        return mIslandOffsets.size() - 1;
+    }
+
+    /**
+     * @return the number of touching pairs found by the last call to Compute()
+     */
+    unsigned GetNumContacts() const
+    {
+        return mNumContacts;
+    }
+
+    /**
+     * @param nodeIndex a node index
+     * @return the island containing the node
+     */
+    unsigned GetIslandOfNode(unsigned nodeIndex) const
+    {
+        if (nodeIndex >= mIslandOfNode.size() || mIslandOfNode[nodeIndex] == UNUSED_INDEX)
+        {
+            EXCEPTION("Node " << nodeIndex << " was not in the population when the islands were computed");
+        }
+        return mIslandOfNode[nodeIndex];
+    }
+
+    /**
+     * @param island an island
+     * @return the number of capsules in the island
+     */
+    unsigned GetIslandSize(unsigned island) const
+    {
+        return mIslandOffsets[island + 1] - mIslandOffsets[island];
+    }
+
+    /**
+     * @return the start of each island in rGetIslandNodeIndices(), plus the total number of nodes at the end
+     */
+    const std::vector<unsigned>& rGetIslandOffsets() const
+    {
+        return mIslandOffsets;
+    }
+
+    /**
+     * @return the node indices grouped by island
+     */
+    const std::vector<unsigned>& rGetIslandNodeIndices() const
+    {
+        return mIslandNodeIndices;
+    }
+
+    /**
+     * @return mContactTolerance
+     */
+    double GetContactTolerance() const
+    {
+        return mContactTolerance;
+    }
+
+    /**
+     * Set mContactTolerance.
+     *
+     * @param contactTolerance the largest gap between capsules that still counts as a contact
+     */
+    void SetContactTolerance(double contactTolerance)
+    {
+        if (contactTolerance < 0.0)
+        {
+            EXCEPTION("The contact tolerance must be non-negative");
+        }
+        mContactTolerance = contactTolerance;
+    }
+};
+
+#endif /*CAPSULECONTACTISLANDS_HPP_*/
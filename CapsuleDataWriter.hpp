@@ -0,0 +1,226 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEDATAWRITER_HPP_
+#define CAPSULEDATAWRITER_HPP_
+
+#include "AbstractCellWriter.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * A cell writer that outputs all capsule data for each cell in a single pass.
+ *
+ * This replaces registering CellIdWriter, CapsuleOrientationWriter,
+ * CapsuleScalingWriter and MachineStateCountWriter separately, each of which
+ * traverses the population, looks up the node corresponding to each cell and
+ * reads its attributes and properties on its own. Here each cell is visited
+ * once and the selected columns are written to a single file.
+ *
+ * For each cell the output contains its location index and cell ID, followed
+ * by whichever of the following columns are included (all are by default):
+ * the centre coordinates; theta (and phi in 3D); length; radius; and the
+ * number of machines in each state.
+ *
+ * The output file is called capsuledata.dat by default.
+ */
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM>
+class CapsuleDataWriter : public AbstractCellWriter<ELEMENT_DIM, SPACE_DIM>
+{
+public:
+
+    /** The optional columns that may be output for each cell. */
+    enum CapsuleDataColumn
+    {
+        LOCATION = 1u,
+        ORIENTATION = 2u,
+        LENGTH = 4u,
+        RADIUS = 8u,
+        MACHINE_STATE_COUNTS = 16u
+    };
+
+private:
+
+    /** Bitwise OR of the CapsuleDataColumn values to output. */
+    unsigned mIncludedColumns;
+
+    /** Number of machine states to count per cell. Defaults to 6. */
+    unsigned mNumMachineStates;
+
+    /** Per-cell machine state counts, reused between cells to avoid reallocation. */
+    std::vector<unsigned> mMachineStateCounts;
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    CapsuleDataWriter()
+        : AbstractCellWriter<ELEMENT_DIM, SPACE_DIM>("capsuledata.dat"),
+          mIncludedColumns(LOCATION | ORIENTATION | LENGTH | RADIUS | MACHINE_STATE_COUNTS),
+          mNumMachineStates(6u)
+    {
+        this->mVtkCellDataName = "Capsule length";
+    }
+
+    /**
+     * @param column a column
+     * @return whether the column is output
+     */
+    bool IsColumnIncluded(CapsuleDataColumn column) const
+    {
+        return (mIncludedColumns & column) != 0u;
+    }
+
+    /**
+     * Set whether a column is output.
+     *
+     * @param column the column
+     * @param included whether to output it
+     */
+    void SetColumnIncluded(CapsuleDataColumn column, bool included)
+    {
+        if (included)
+        {
+            mIncludedColumns |= column;
+        }
+        else
+        {
+            mIncludedColumns &= ~static_cast<unsigned>(column);
+        }
+    }
+
+    /**
+     * @return mNumMachineStates
+     */
+    unsigned GetNumMachineStates() const
+    {
+        return mNumMachineStates;
+    }
+
+    /**
+     * Set mNumMachineStates. Machines in states outside [0, numMachineStates) are not counted.
+     *
+     * @param numMachineStates the new value
+     */
+    void SetNumMachineStates(unsigned numMachineStates)
+    {
+        if (numMachineStates == 0)
+        {
+            EXCEPTION("The number of machine states must be positive");
+        }
+        mNumMachineStates = numMachineStates;
+    }
+
+    /**
+     * Overridden GetCellDataForVtkOutput() method.
+     *
+     * @param pCell a cell
+     * @param pCellPopulation a pointer to the cell population owning the cell
+     * @return the capsule length of the cell
+     */
+    double GetCellDataForVtkOutput(CellPtr pCell, AbstractCellPopulation<ELEMENT_DIM, SPACE_DIM>* pCellPopulation)
+    {
+        unsigned location_index = pCellPopulation->GetLocationIndexUsingCell(pCell);
+        return pCellPopulation->GetNode(location_index)->rGetNodeAttributes()[NA_LENGTH];
+    }
+
+    /**
+     * Overridden VisitCell() method.
+     *
+     * Write all included columns for this cell to file.
+     *
+     * @param pCell a cell
+     * @param pCellPopulation a pointer to the cell population owning the cell
+     */
+    void VisitCell(CellPtr pCell, AbstractCellPopulation<ELEMENT_DIM, SPACE_DIM>* pCellPopulation)
+    {
+        unsigned location_index = pCellPopulation->GetLocationIndexUsingCell(pCell);
+        Node<SPACE_DIM>* p_node = pCellPopulation->GetNode(location_index);
+        const std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+
+        *this->mpOutStream << location_index << " " << pCell->GetCellId() << " ";
+
+        if (IsColumnIncluded(LOCATION))
+        {
+            const c_vector<double, SPACE_DIM>& r_location = p_node->rGetLocation();
+            for (unsigned i=0; i<SPACE_DIM; i++)
+            {
+                *this->mpOutStream << r_location[i] << " ";
+            }
+        }
+        if (IsColumnIncluded(ORIENTATION))
+        {
+            *this->mpOutStream << r_attributes[NA_THETA] << " ";
+            if (SPACE_DIM == 3)
+            {
+                *this->mpOutStream << r_attributes[NA_PHI] << " ";
+            }
+        }
+        if (IsColumnIncluded(LENGTH))
+        {
+            *this->mpOutStream << r_attributes[NA_LENGTH] << " ";
+        }
+        if (IsColumnIncluded(RADIUS))
+        {
+            *this->mpOutStream << r_attributes[NA_RADIUS] << " ";
+        }
+        if (IsColumnIncluded(MACHINE_STATE_COUNTS))
+        {
+            mMachineStateCounts.assign(mNumMachineStates, 0u);
+
+            CellPropertyCollection collection = pCell->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+            if (collection.GetSize() == 1)
+            {
+                boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+                for (const auto& r_pair : p_property->rGetMachineData())
+                {
+                    if (r_pair.first < mNumMachineStates)
+                    {
+                        mMachineStateCounts[r_pair.first]++;
+                    }
+                }
+            }
+            for (unsigned state=0; state<mNumMachineStates; state++)
+            {
+                *this->mpOutStream << mMachineStateCounts[state] << " ";
+            }
+        }
+    }
+};
+
+#endif /*CAPSULEDATAWRITER_HPP_*/
@@ -0,0 +1,309 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEDIFFUSIONFORCE_HPP_
+#define CAPSULEDIFFUSIONFORCE_HPP_
+
+#include <cmath>
+#include <vector>
+
+#include "AbstractForce.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "AbstractOffLatticeCellPopulation.hpp"
+#include "Exception.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "SimulationTime.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+
+/**
+ * A Brownian force for capsules, in place of DiffusionForce, which treats each
+ * capsule as a sphere and does not rotate it.
+ *
+ * Each capsule is treated as a rod of total length L = NA_LENGTH + 2 NA_RADIUS
+ * and aspect ratio p = L / (2 NA_RADIUS). Its translational diffusion
+ * coefficients along and across its axis, and its rotational diffusion
+ * coefficient, follow Tirado, Martinez and Garcia de la Torre (J. Chem. Phys.
+ * 81:2047, 1984):
+ *
+ *     D_par  = kT (ln p + g_par)  / (2 pi eta L)
+ *     D_perp = kT (ln p + g_perp) / (4 pi eta L)
+ *     D_rot  = 3 kT (ln p + g_rot) / (pi eta L^3)
+ *
+ * Here g_par, g_perp and g_rot are the end corrections, which are quadratics
+ * in 1/p. The formulae are fitted for 2 <= p <= 20, and reduce to within six
+ * percent of the Stokes-Einstein values for translation of a sphere.
+ *
+ * As in DiffusionForce, the random force on a capsule is
+ * nu sqrt(2 D dt) / dt times a standard normal deviate in each direction,
+ * where nu is the damping constant of the population. The random torque
+ * added to NA_APPLIED_THETA is I sqrt(2 D_rot dt) / dt times a standard
+ * normal deviate, where I is the moment of inertia that
+ * ForwardEulerNumericalMethodForCapsules divides the torque by. Over a time t
+ * a free capsule then has <dtheta^2> = 2 D_rot t and a displacement along its
+ * axis with <dx^2> = 2 D_par t. In 3D, NA_PHI gets no rotational noise, since
+ * no torque on it is available.
+ *
+ * All the standard normal deviates for a step are generated together before
+ * the loop over capsules. The uniform deviates are drawn from the
+ * RandomNumberGenerator singleton, so runs stay reproducible for a given
+ * seed. They are then transformed in pairs by a branch-free Box-Muller loop
+ * over contiguous arrays. The loop calls log, cos and sin from the maths
+ * library, so it is not vectorised unless a vector maths library is
+ * available.
+ *
+ * This class is not archived.
+ */
+template<unsigned DIM>
+class CapsuleDiffusionForce : public AbstractForce<DIM>
+{
+private:
+
+    /** Absolute temperature in Kelvin. Defaults to 296, as in DiffusionForce. */
+    double mAbsoluteTemperature;
+
+    /** Viscosity of the medium in kg/(um h), as in DiffusionForce. Defaults to 3.204e-6. */
+    double mViscosity;
+
+    /** Used for the capsule moments of inertia. */
+    ForwardEulerNumericalMethodForCapsules<DIM,DIM> mNumericalMethod;
+
+    /** Uniform deviates for the current step. */
+    std::vector<double> mUniforms;
+
+    /** Standard normal deviates for the current step. */
+    std::vector<double> mNormals;
+
+    /**
+     * Fill mNormals with at least numNormals standard normal deviates.
+     *
+     * @param numNormals the number of deviates needed
+     */
+    void GenerateStandardNormals(unsigned numNormals)
+    {
+        const unsigned num_pairs = (numNormals + 1)/2;
+        mUniforms.resize(2*num_pairs);
+        mNormals.resize(2*num_pairs);
+
+        RandomNumberGenerator* p_gen = RandomNumberGenerator::Instance();
+        for (unsigned i=0; i<2*num_pairs; i++)
+        {
+            mUniforms[i] = p_gen->ranf();
+        }
+
+        // ranf() is in [0,1), so 1 - u is in (0,1] and its logarithm is finite
+        const double* p_uniforms = mUniforms.data();
+        double* p_normals = mNormals.data();
+        for (unsigned pair=0; pair<num_pairs; pair++)
+        {
+            const double radius = sqrt(-2.0*log(1.0 - p_uniforms[2*pair]));
+            const double angle = 2.0*M_PI*p_uniforms[2*pair + 1];
+            p_normals[2*pair] = radius*cos(angle);
+            p_normals[2*pair + 1] = radius*sin(angle);
+        }
+    }
+
+public:
+
+    /** Boltzmann constant in kg um^2 / (h^2 K), as in DiffusionForce. */
+    static constexpr double BOLTZMANN_CONSTANT = 4.97033568e-7;
+
+    /**
+     * Constructor.
+     */
+    CapsuleDiffusionForce()
+        : AbstractForce<DIM>(),
+          mAbsoluteTemperature(296.0),
+          mViscosity(3.204e-6)
+    {
+    }
+
+    /**
+     * Calculate the diffusion coefficients of a capsule.
+     *
+     * @param length the capsule length, NA_LENGTH
+     * @param radius the capsule radius, NA_RADIUS
+     * @param rParallel set to the translational diffusion coefficient along the axis
+     * @param rPerpendicular set to the translational diffusion coefficient across the axis
+     * @param rRotational set to the rotational diffusion coefficient
+     */
+    void CalculateDiffusionCoefficients(double length, double radius,
+                                        double& rParallel, double& rPerpendicular, double& rRotational) const
+    {
+        const double total_length = length + 2.0*radius;
+        const double inverse_ratio = 2.0*radius/total_length;
+        const double log_ratio = -log(inverse_ratio);
+        const double thermal_energy = BOLTZMANN_CONSTANT*mAbsoluteTemperature;
+
+        const double end_parallel = -0.207 + 0.980*inverse_ratio - 0.133*inverse_ratio*inverse_ratio;
+        const double end_perpendicular = 0.839 + 0.185*inverse_ratio + 0.233*inverse_ratio*inverse_ratio;
+        const double end_rotational = -0.662 + 0.917*inverse_ratio - 0.050*inverse_ratio*inverse_ratio;
+
+        rParallel = thermal_energy*(log_ratio + end_parallel)/(2.0*M_PI*mViscosity*total_length);
+        rPerpendicular = thermal_energy*(log_ratio + end_perpendicular)/(4.0*M_PI*mViscosity*total_length);
+        rRotational = 3.0*thermal_energy*(log_ratio + end_rotational)/(M_PI*mViscosity*total_length*total_length*total_length);
+    }
+
+    /**
+     * Overridden AddForceContribution() method.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    void AddForceContribution(AbstractCellPopulation<DIM>& rCellPopulation)
+    {
+        AbstractOffLatticeCellPopulation<DIM>* p_population = dynamic_cast<AbstractOffLatticeCellPopulation<DIM>*>(&rCellPopulation);
+        if (p_population == nullptr)
+        {
+            EXCEPTION("CapsuleDiffusionForce is to be used with an off-lattice cell population only");
+        }
+
+        const double dt = SimulationTime::Instance()->GetTimeStep();
+        const unsigned num_nodes = rCellPopulation.GetNumNodes();
+        GenerateStandardNormals((DIM + 1)*num_nodes);
+
+        const double* p_normals = mNormals.data();
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = rCellPopulation.rGetMesh().GetNodeIteratorBegin();
+             node_iter != rCellPopulation.rGetMesh().GetNodeIteratorEnd();
+             ++node_iter, p_normals += DIM + 1)
+        {
+            std::vector<double>& r_attributes = node_iter->rGetNodeAttributes();
+            const double radius = r_attributes[NA_RADIUS];
+            if (radius <= 0.0)
+            {
+                EXCEPTION("CapsuleDiffusionForce requires every capsule to have a positive NA_RADIUS");
+            }
+
+            double d_parallel;
+            double d_perpendicular;
+            double d_rotational;
+            CalculateDiffusionCoefficients(r_attributes[NA_LENGTH], radius, d_parallel, d_perpendicular, d_rotational);
+
+            const double damping = p_population->GetDampingConstant(node_iter->GetIndex());
+            const double parallel_scale = damping*sqrt(2.0*d_parallel*dt)/dt;
+            const double perpendicular_scale = damping*sqrt(2.0*d_perpendicular*dt)/dt;
+
+            // The axis and the directions across it
+            const double theta = r_attributes[NA_THETA];
+            c_vector<double, DIM> force_contribution;
+            if (DIM == 2)
+            {
+                const double cos_theta = cos(theta);
+                const double sin_theta = sin(theta);
+                const double along = parallel_scale*p_normals[0];
+                const double across = perpendicular_scale*p_normals[1];
+                force_contribution[0] = along*cos_theta - across*sin_theta;
+                force_contribution[1] = along*sin_theta + across*cos_theta;
+            }
+            else
+            {
+                const double phi = r_attributes[NA_PHI];
+                const double cos_theta = cos(theta);
+                const double sin_theta = sin(theta);
+                const double cos_phi = cos(phi);
+                const double sin_phi = sin(phi);
+                const double along = parallel_scale*p_normals[0];
+                const double across_polar = perpendicular_scale*p_normals[1];
+                const double across_azimuthal = perpendicular_scale*p_normals[2];
+                force_contribution[0] = along*cos_theta*sin_phi + across_polar*cos_theta*cos_phi - across_azimuthal*sin_theta;
+                force_contribution[1] = along*sin_theta*sin_phi + across_polar*sin_theta*cos_phi + across_azimuthal*cos_theta;
+                force_contribution[DIM-1] = along*cos_phi - across_polar*sin_phi;
+            }
+            node_iter->AddAppliedForceContribution(force_contribution);
+
+            const double moment_of_inertia = mNumericalMethod.CalculateMomentOfInertiaOfCapsule(r_attributes[NA_LENGTH], radius);
+            r_attributes[NA_APPLIED_THETA] += moment_of_inertia*sqrt(2.0*d_rotational*dt)/dt*p_normals[DIM];
+        }
+    }
+
+    /**
+     * @return mAbsoluteTemperature
+     */
+    double GetAbsoluteTemperature() const
+    {
+        return mAbsoluteTemperature;
+    }
+
+    /**
+     * Set mAbsoluteTemperature.
+     *
+     * @param absoluteTemperature the new value
+     */
+    void SetAbsoluteTemperature(double absoluteTemperature)
+    {
+        if (absoluteTemperature < 0.0)
+        {
+            EXCEPTION("The absolute temperature must be non-negative");
+        }
+        mAbsoluteTemperature = absoluteTemperature;
+    }
+
+    /**
+     * @return mViscosity
+     */
+    double GetViscosity() const
+    {
+        return mViscosity;
+    }
+
+    /**
+     * Set mViscosity.
+     *
+     * @param viscosity the new value
+     */
+    void SetViscosity(double viscosity)
+    {
+        if (viscosity <= 0.0)
+        {
+            EXCEPTION("The viscosity must be positive");
+        }
+        mViscosity = viscosity;
+    }
+
+    /**
+     * Overridden OutputForceParameters() method.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputForceParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<AbsoluteTemperature>" << mAbsoluteTemperature << "</AbsoluteTemperature>\n";
+        *rParamsFile << "\t\t\t<Viscosity>" << mViscosity << "</Viscosity>\n";
+
+        // Call method on direct parent class
+        AbstractForce<DIM>::OutputForceParameters(rParamsFile);
+    }
+};
+
+#endif /*CAPSULEDIFFUSIONFORCE_HPP_*/
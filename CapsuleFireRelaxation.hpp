@@ -0,0 +1,365 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEFIRERELAXATION_HPP_
+#define CAPSULEFIRERELAXATION_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "AbstractCellPopulation.hpp"
+#include "AbstractForce.hpp"
+#include "Exception.hpp"
+#include "Warnings.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * Relaxes a capsule configuration towards force balance with the FIRE
+ * algorithm (Bitzek et al., Phys. Rev. Lett. 97:170201, 2006), for example
+ * before Solve() or after a bulk load or a burst of divisions, instead of
+ * running many small forward Euler steps.
+ *
+ * The degrees of freedom are the capsule centres and NA_THETA. Forces come
+ * from rGetAppliedForce() and torques from NA_APPLIED_THETA, as filled in by
+ * the given forces (normally a CapsuleForce). Each capsule has the mass and
+ * moment of inertia used by ForwardEulerNumericalMethodForCapsules. NA_PHI is
+ * not changed, since no torque on it is available.
+ *
+ * Each iteration updates the population, so that node pairs follow the
+ * capsules, and recomputes all forces. The relaxation stops when no capsule
+ * has a force or torque larger than the force tolerance, or after the
+ * maximum number of iterations, with a warning. Cell ages and simulation time
+ * are not changed.
+ *
+ * This class is not archived.
+ */
+template<unsigned DIM>
+class CapsuleFireRelaxation
+{
+private:
+
+    /** Used for the capsule masses and moments of inertia. */
+    ForwardEulerNumericalMethodForCapsules<DIM,DIM> mNumericalMethod;
+
+    /** Initial FIRE time step. Defaults to 1/1200. */
+    double mInitialTimeStep;
+
+    /** Largest FIRE time step. Defaults to ten times the initial time step. */
+    double mMaxTimeStep;
+
+    /** Largest distance a capsule may move in one iteration. Defaults to 0.05. */
+    double mMaxDisplacement;
+
+    /** Largest force and torque on any capsule at convergence. Defaults to 1e-3. */
+    double mForceTolerance;
+
+    /** Largest number of iterations. Defaults to 10000. */
+    unsigned mMaxIterations;
+
+    /** Largest force or torque on any capsule at the end of the last relaxation. */
+    double mMaxResidual;
+
+    /** Velocities of the capsule centres, in node iteration order. */
+    std::vector<c_vector<double, DIM> > mVelocities;
+
+    /** Angular velocities of the capsules, in node iteration order. */
+    std::vector<double> mAngularVelocities;
+
+    /**
+     * Clear the forces and torques on all nodes and add the contribution of each force.
+     *
+     * @param rCellPopulation the cell population
+     * @param rForces the forces
+     */
+    void ComputeForces(AbstractCellPopulation<DIM,DIM>& rCellPopulation,
+                       const std::vector<boost::shared_ptr<AbstractForce<DIM,DIM> > >& rForces)
+    {
+        rCellPopulation.Update();
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = rCellPopulation.rGetMesh().GetNodeIteratorBegin();
+             node_iter != rCellPopulation.rGetMesh().GetNodeIteratorEnd();
+             ++node_iter)
+        {
+            node_iter->ClearAppliedForce();
+            node_iter->rGetNodeAttributes()[NA_APPLIED_THETA] = 0.0;
+        }
+        for (unsigned i=0; i<rForces.size(); i++)
+        {
+            rForces[i]->AddForceContribution(rCellPopulation);
+        }
+    }
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CapsuleFireRelaxation()
+        : mInitialTimeStep(1.0/1200.0),
+          mMaxTimeStep(10.0/1200.0),
+          mMaxDisplacement(0.05),
+          mForceTolerance(1e-3),
+          mMaxIterations(10000u),
+          mMaxResidual(0.0)
+    {
+    }
+
+    /**
+     * Relax the population.
+     *
+     * @param rCellPopulation the cell population
+     * @param rForces the forces, for example OffLatticeSimulation::rGetForceCollection()
+     * @return the number of iterations taken
+     */
+    unsigned Relax(AbstractCellPopulation<DIM,DIM>& rCellPopulation,
+                   const std::vector<boost::shared_ptr<AbstractForce<DIM,DIM> > >& rForces)
+    {
+        // Parameters recommended by Bitzek et al.
+        const unsigned min_steps_before_increase = 5;
+        const double time_step_increase = 1.1;
+        const double time_step_decrease = 0.5;
+        const double initial_mixing = 0.1;
+        const double mixing_decrease = 0.99;
+
+        const unsigned num_nodes = rCellPopulation.GetNumNodes();
+        mVelocities.assign(num_nodes, zero_vector<double>(DIM));
+        mAngularVelocities.assign(num_nodes, 0.0);
+
+        double dt = mInitialTimeStep;
+        double mixing = initial_mixing;
+        unsigned num_steps_downhill = 0;
+
+        unsigned iteration = 0;
+        for ( ; ; iteration++)
+        {
+            ComputeForces(rCellPopulation, rForces);
+
+            // Power, norms and the largest residual over all degrees of freedom
+            double power = 0.0;
+            double force_norm_squared = 0.0;
+            double velocity_norm_squared = 0.0;
+            mMaxResidual = 0.0;
+            unsigned node_count = 0;
+            for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = rCellPopulation.rGetMesh().GetNodeIteratorBegin();
+                 node_iter != rCellPopulation.rGetMesh().GetNodeIteratorEnd();
+                 ++node_iter, ++node_count)
+            {
+                const c_vector<double, DIM>& r_force = node_iter->rGetAppliedForce();
+                double torque = node_iter->rGetNodeAttributes()[NA_APPLIED_THETA];
+
+                power += inner_prod(r_force, mVelocities[node_count]) + torque*mAngularVelocities[node_count];
+                force_norm_squared += inner_prod(r_force, r_force) + torque*torque;
+                velocity_norm_squared += inner_prod(mVelocities[node_count], mVelocities[node_count])
+                                         + mAngularVelocities[node_count]*mAngularVelocities[node_count];
+                mMaxResidual = std::max(mMaxResidual, std::max(norm_2(r_force), fabs(torque)));
+            }
+
+            if (mMaxResidual <= mForceTolerance || iteration == mMaxIterations)
+            {
+                break;
+            }
+
+            // Steer the velocity towards the force while moving downhill, and stop when moving uphill
+            double force_norm = sqrt(force_norm_squared);
+            double velocity_scale = force_norm > 0.0 ? sqrt(velocity_norm_squared)/force_norm : 0.0;
+            if (power > 0.0)
+            {
+                if (num_steps_downhill > min_steps_before_increase)
+                {
+                    dt = std::min(dt*time_step_increase, mMaxTimeStep);
+                    mixing *= mixing_decrease;
+                }
+                num_steps_downhill++;
+            }
+            else
+            {
+                dt *= time_step_decrease;
+                mixing = initial_mixing;
+                num_steps_downhill = 0;
+            }
+
+            // Semi-implicit Euler step, limited to the maximum displacement
+            node_count = 0;
+            for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = rCellPopulation.rGetMesh().GetNodeIteratorBegin();
+                 node_iter != rCellPopulation.rGetMesh().GetNodeIteratorEnd();
+                 ++node_iter, ++node_count)
+            {
+                std::vector<double>& r_attributes = node_iter->rGetNodeAttributes();
+                const c_vector<double, DIM>& r_force = node_iter->rGetAppliedForce();
+                double torque = r_attributes[NA_APPLIED_THETA];
+
+                c_vector<double, DIM>& r_velocity = mVelocities[node_count];
+                double& r_angular_velocity = mAngularVelocities[node_count];
+                if (power > 0.0)
+                {
+                    r_velocity = (1.0 - mixing)*r_velocity + mixing*velocity_scale*r_force;
+                    r_angular_velocity = (1.0 - mixing)*r_angular_velocity + mixing*velocity_scale*torque;
+                }
+                else
+                {
+                    r_velocity = zero_vector<double>(DIM);
+                    r_angular_velocity = 0.0;
+                }
+
+                double mass = mNumericalMethod.CalculateMassOfCapsule(r_attributes[NA_LENGTH], r_attributes[NA_RADIUS]);
+                double moment_of_inertia = mNumericalMethod.CalculateMomentOfInertiaOfCapsule(r_attributes[NA_LENGTH], r_attributes[NA_RADIUS]);
+                r_velocity += dt*r_force/mass;
+                r_angular_velocity += dt*torque/moment_of_inertia;
+
+                c_vector<double, DIM> displacement = dt*r_velocity;
+                double distance = norm_2(displacement);
+                if (distance > mMaxDisplacement)
+                {
+                    displacement *= mMaxDisplacement/distance;
+                }
+                node_iter->rGetModifiableLocation() += displacement;
+                r_attributes[NA_THETA] += dt*r_angular_velocity;
+            }
+        }
+
+        if (mMaxResidual > mForceTolerance)
+        {
+            WARNING("Capsule relaxation did not converge in " << mMaxIterations << " iterations; the largest force is " << mMaxResidual);
+        }
+        return iteration;
+    }
+
+    /**
+     * @return the largest force or torque on any capsule at the end of the last relaxation
+     */
+    double GetMaxResidual() const
+    {
+        return mMaxResidual;
+    }
+
+    /**
+     * @return mInitialTimeStep
+     */
+    double GetInitialTimeStep() const
+    {
+        return mInitialTimeStep;
+    }
+
+    /**
+     * @return mMaxTimeStep
+     */
+    double GetMaxTimeStep() const
+    {
+        return mMaxTimeStep;
+    }
+
+    /**
+     * Set mInitialTimeStep and mMaxTimeStep.
+     *
+     * @param initialTimeStep the initial FIRE time step
+     * @param maxTimeStep the largest FIRE time step
+     */
+    void SetTimeSteps(double initialTimeStep, double maxTimeStep)
+    {
+        if (initialTimeStep <= 0.0 || maxTimeStep < initialTimeStep)
+        {
+            EXCEPTION("The time steps must be positive, with the maximum no smaller than the initial time step");
+        }
+        mInitialTimeStep = initialTimeStep;
+        mMaxTimeStep = maxTimeStep;
+    }
+
+    /**
+     * @return mMaxDisplacement
+     */
+    double GetMaxDisplacement() const
+    {
+        return mMaxDisplacement;
+    }
+
+    /**
+     * Set mMaxDisplacement.
+     *
+     * @param maxDisplacement the largest distance a capsule may move in one iteration
+     */
+    void SetMaxDisplacement(double maxDisplacement)
+    {
+        if (maxDisplacement <= 0.0)
+        {
+            EXCEPTION("The maximum displacement must be positive");
+        }
+        mMaxDisplacement = maxDisplacement;
+    }
+
+    /**
+     * @return mForceTolerance
+     */
+    double GetForceTolerance() const
+    {
+        return mForceTolerance;
+    }
+
+    /**
+     * Set mForceTolerance.
+     *
+     * @param forceTolerance the largest force and torque on any capsule at convergence
+     */
+    void SetForceTolerance(double forceTolerance)
+    {
+        if (forceTolerance <= 0.0)
+        {
+            EXCEPTION("The force tolerance must be positive");
+        }
+        mForceTolerance = forceTolerance;
+    }
+
+    /**
+     * @return mMaxIterations
+     */
+    unsigned GetMaxIterations() const
+    {
+        return mMaxIterations;
+    }
+
+    /**
+     * Set mMaxIterations.
+     *
+     * @param maxIterations the largest number of iterations
+     */
+    void SetMaxIterations(unsigned maxIterations)
+    {
+        mMaxIterations = maxIterations;
+    }
+};
+
+#endif /*CAPSULEFIRERELAXATION_HPP_*/
@@ -0,0 +1,181 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEINITIALCONDITIONEXPORTMODIFIER_HPP_
+#define CAPSULEINITIALCONDITIONEXPORTMODIFIER_HPP_
+
+#include <sstream>
+#include <string>
+
+#include "AbstractCellBasedSimulationModifier.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+#include "OutputFileHandler.hpp"
+#include "SimulationTime.hpp"
+#include "CapsuleInitialConditionFile.hpp"
+
+/**
+ * A modifier that exports the state of the population at every
+ * mExportTimestepMultiple-th time step, in the format of
+ * CapsuleInitialConditionFile. The files are named
+ * initialconditions_<time step>.bin and go in the simulation output
+ * directory. A later run can load any of them with
+ * CapsuleInitialConditionFile::Load() and start from that state.
+ *
+ * This modifier is not archived.
+ */
+template<unsigned DIM>
+class CapsuleInitialConditionExportModifier : public AbstractCellBasedSimulationModifier<DIM,DIM>
+{
+private:
+
+    /** Number of time steps between exports. Defaults to 1200. */
+    unsigned mExportTimestepMultiple;
+
+    /** Whether to export the initial state as well. Defaults to true. */
+    bool mExportInitialState;
+
+    /** Full path of the output directory, ending in a slash. */
+    std::string mOutputDirectoryFullPath;
+
+    /**
+     * Export the current state.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    void Export(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        std::stringstream file_name;
+        file_name << mOutputDirectoryFullPath << "initialconditions_" << SimulationTime::Instance()->GetTimeStepsElapsed() << ".bin";
+        CapsuleInitialConditionFile<DIM>::Export(rCellPopulation, file_name.str());
+    }
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    CapsuleInitialConditionExportModifier()
+        : AbstractCellBasedSimulationModifier<DIM,DIM>(),
+          mExportTimestepMultiple(1200u),
+          mExportInitialState(true)
+    {
+    }
+
+    /**
+     * @return mExportTimestepMultiple
+     */
+    unsigned GetExportTimestepMultiple() const
+    {
+        return mExportTimestepMultiple;
+    }
+
+    /**
+     * Set mExportTimestepMultiple.
+     *
+     * @param exportTimestepMultiple the number of time steps between exports
+     */
+    void SetExportTimestepMultiple(unsigned exportTimestepMultiple)
+    {
+        if (exportTimestepMultiple == 0)
+        {
+            EXCEPTION("The export timestep multiple must be positive");
+        }
+        mExportTimestepMultiple = exportTimestepMultiple;
+    }
+
+    /**
+     * @return mExportInitialState
+     */
+    bool GetExportInitialState() const
+    {
+        return mExportInitialState;
+    }
+
+    /**
+     * Set mExportInitialState.
+     *
+     * @param exportInitialState whether to export the initial state
+     */
+    void SetExportInitialState(bool exportInitialState)
+    {
+        mExportInitialState = exportInitialState;
+    }
+
+    /**
+     * Overridden SetupSolve() method.
+     *
+     * @param rCellPopulation reference to the cell population
+     * @param outputDirectory the output directory, relative to where Chaste output is stored
+     */
+    virtual void SetupSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation, std::string outputDirectory)
+    {
+        OutputFileHandler output_file_handler(outputDirectory, false);
+        mOutputDirectoryFullPath = output_file_handler.GetOutputDirectoryFullPath();
+        if (mExportInitialState)
+        {
+            Export(rCellPopulation);
+        }
+    }
+
+    /**
+     * Overridden UpdateAtEndOfTimeStep() method.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfTimeStep(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        if (SimulationTime::Instance()->GetTimeStepsElapsed() % mExportTimestepMultiple == 0)
+        {
+            Export(rCellPopulation);
+        }
+    }
+
+    /**
+     * Overridden OutputSimulationModifierParameters() method.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputSimulationModifierParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<ExportTimestepMultiple>" << mExportTimestepMultiple << "</ExportTimestepMultiple>\n";
+        *rParamsFile << "\t\t\t<ExportInitialState>" << mExportInitialState << "</ExportInitialState>\n";
+
+        // Next, call method on direct parent class
+        AbstractCellBasedSimulationModifier<DIM,DIM>::OutputSimulationModifierParameters(rParamsFile);
+    }
+};
+
+#endif /*CAPSULEINITIALCONDITIONEXPORTMODIFIER_HPP_*/
@@ -0,0 +1,327 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEINITIALCONDITIONFILE_HPP_
+#define CAPSULEINITIALCONDITIONFILE_HPP_
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+#include "SimulationTime.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "CapsulePopulationBuilder.hpp"
+
+/**
+ * Reads and writes capsule colony initial conditions in a flat binary format
+ * designed to be memory mapped.
+ *
+ * The file starts with a 48-byte header:
+ * - the magic string "CAPSINIT"
+ * - the uint32 version and dimension
+ * - the double time at which the state was taken
+ * - the uint64 numbers of capsules n, machines m and machine coordinates c
+ *
+ * The header is followed by these arrays, with no padding:
+ * - locations, DIM*n doubles
+ * - thetas, phis, lengths, radii and birth times, n doubles each
+ * - machine offsets, n+1 uint64
+ * - machine coordinate offsets, m+1 uint64
+ * - machine coordinates, c doubles
+ * - machine states, m uint32
+ *
+ * Every array before the machine states has 8-byte elements and starts on an
+ * 8-byte boundary. The machine layout is that of CapsulePopulationBuilder
+ * and CapsulePopulationCheckpoint. Values are in native byte order.
+ *
+ * Load() maps the file read-only and hands pointers into the mapping to
+ * CapsulePopulationBuilder, so no text is parsed and each array is copied
+ * once. Export() writes the current state of a population. At most one
+ * TypeSixMachineProperty per cell is exported.
+ */
+template<unsigned DIM>
+class CapsuleInitialConditionFile
+{
+private:
+
+    /** Size of the header in bytes. */
+    static const size_t HEADER_SIZE = 48u;
+
+    /** File format version. */
+    static const uint32_t VERSION = 1u;
+
+    /**
+     * Write an array with fwrite.
+     *
+     * @param pFile the file
+     * @param rArray the array
+     */
+    template<typename T>
+    static void WriteArray(FILE* pFile, const std::vector<T>& rArray)
+    {
+        if (!rArray.empty())
+        {
+            fwrite(rArray.data(), sizeof(T), rArray.size(), pFile);
+        }
+    }
+
+public:
+
+    /**
+     * Write the state of a population to a file.
+     *
+     * @param rCellPopulation the cell population
+     * @param rFileName the absolute path of the file
+     */
+    static void Export(AbstractCellPopulation<DIM,DIM>& rCellPopulation, const std::string& rFileName)
+    {
+        const unsigned num_cells = rCellPopulation.GetNumRealCells();
+
+        std::vector<double> locations;
+        std::vector<double> thetas;
+        std::vector<double> phis;
+        std::vector<double> lengths;
+        std::vector<double> radii;
+        std::vector<double> birth_times;
+        std::vector<uint64_t> machine_offsets;
+        std::vector<uint64_t> coordinate_offsets;
+        std::vector<double> coordinates;
+        std::vector<uint32_t> states;
+
+        locations.reserve(DIM*num_cells);
+        thetas.reserve(num_cells);
+        phis.reserve(num_cells);
+        lengths.reserve(num_cells);
+        radii.reserve(num_cells);
+        birth_times.reserve(num_cells);
+        machine_offsets.reserve(num_cells + 1);
+        machine_offsets.push_back(0u);
+        coordinate_offsets.push_back(0u);
+
+        for (typename AbstractCellPopulation<DIM,DIM>::Iterator cell_iter = rCellPopulation.Begin();
+             cell_iter != rCellPopulation.End();
+             ++cell_iter)
+        {
+            Node<DIM>* p_node = rCellPopulation.GetNode(rCellPopulation.GetLocationIndexUsingCell(*cell_iter));
+            const c_vector<double, DIM>& r_location = p_node->rGetLocation();
+            locations.insert(locations.end(), r_location.begin(), r_location.end());
+
+            const std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+            thetas.push_back(r_attributes[NA_THETA]);
+            phis.push_back(r_attributes[NA_PHI]);
+            lengths.push_back(r_attributes[NA_LENGTH]);
+            radii.push_back(r_attributes[NA_RADIUS]);
+            birth_times.push_back(cell_iter->GetBirthTime());
+
+            CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+            if (collection.GetSize() == 1)
+            {
+                boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+                for (const auto& r_pair : p_property->rGetMachineData())
+                {
+                    states.push_back(r_pair.first);
+                    coordinates.insert(coordinates.end(), r_pair.second.begin(), r_pair.second.end());
+                    coordinate_offsets.push_back(coordinates.size());
+                }
+            }
+            machine_offsets.push_back(states.size());
+        }
+
+        FILE* p_file = fopen(rFileName.c_str(), "wb");
+        if (p_file == nullptr)
+        {
+            EXCEPTION("Could not open initial condition file " << rFileName << " for writing");
+        }
+
+        uint32_t version = VERSION;
+        uint32_t dim = DIM;
+        double time = SimulationTime::Instance()->GetTime();
+        uint64_t counts[3] = {thetas.size(), states.size(), coordinates.size()};
+        fwrite("CAPSINIT", 1, 8, p_file);
+        fwrite(&version, sizeof(version), 1, p_file);
+        fwrite(&dim, sizeof(dim), 1, p_file);
+        fwrite(&time, sizeof(time), 1, p_file);
+        fwrite(counts, sizeof(uint64_t), 3, p_file);
+
+        WriteArray(p_file, locations);
+        WriteArray(p_file, thetas);
+        WriteArray(p_file, phis);
+        WriteArray(p_file, lengths);
+        WriteArray(p_file, radii);
+        WriteArray(p_file, birth_times);
+        WriteArray(p_file, machine_offsets);
+        WriteArray(p_file, coordinate_offsets);
+        WriteArray(p_file, coordinates);
+        WriteArray(p_file, states);
+
+        bool failed = (ferror(p_file) != 0);
+        failed = (fclose(p_file) != 0) || failed;
+        if (failed)
+        {
+            EXCEPTION("Error writing initial condition file " << rFileName);
+        }
+    }
+
+    /**
+     * Map a file and pass its contents to a builder, replacing any capsules
+     * the builder already holds.
+     *
+     * @param rFileName the absolute path of the file
+     * @param rBuilder the builder
+     * @param shiftToTimeZero if true (the default), birth times are shifted so
+     *     that cell ages are preserved in a simulation starting at time zero
+     * @return the time at which the state was taken
+     */
+    template<class CELL_CYCLE_MODEL>
+    static double Load(const std::string& rFileName, CapsulePopulationBuilder<CELL_CYCLE_MODEL, DIM>& rBuilder,
+                       bool shiftToTimeZero=true)
+    {
+        int fd = open(rFileName.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            EXCEPTION("Could not open initial condition file " << rFileName);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < HEADER_SIZE)
+        {
+            close(fd);
+            EXCEPTION("Initial condition file " << rFileName << " is too short");
+        }
+        const size_t file_size = file_stat.st_size;
+        void* p_map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p_map == MAP_FAILED)
+        {
+            EXCEPTION("Could not map initial condition file " << rFileName);
+        }
+        const char* p_data = static_cast<const char*>(p_map);
+
+        uint32_t version;
+        uint32_t dim;
+        double time;
+        uint64_t counts[3];
+        memcpy(&version, p_data + 8, sizeof(version));
+        memcpy(&dim, p_data + 12, sizeof(dim));
+        memcpy(&time, p_data + 16, sizeof(time));
+        memcpy(counts, p_data + 24, sizeof(counts));
+        const uint64_t n = counts[0];
+        const uint64_t m = counts[1];
+        const uint64_t c = counts[2];
+
+        std::string error;
+        if (memcmp(p_data, "CAPSINIT", 8) != 0)
+        {
+            error = "is not a capsule initial condition file";
+        }
+        else if (version != VERSION)
+        {
+            error = "has an unsupported version";
+        }
+        else if (dim != DIM)
+        {
+            error = "has the wrong dimension";
+        }
+        // Bound the counts by the file size first, so that the expected size cannot overflow
+        else if (n > file_size/(sizeof(double)*(DIM + 6)) || m > file_size/(sizeof(uint64_t) + sizeof(uint32_t))
+                 || c > file_size/sizeof(double)
+                 || file_size != HEADER_SIZE + sizeof(double)*((DIM + 5)*n + c) + sizeof(uint64_t)*(n + m + 2) + sizeof(uint32_t)*m)
+        {
+            error = "has the wrong size";
+        }
+        else if (n > UINT_MAX)
+        {
+            error = "has too many capsules";
+        }
+        if (!error.empty())
+        {
+            munmap(p_map, file_size);
+            EXCEPTION("Initial condition file " << rFileName << " " << error);
+        }
+
+        const double* p_doubles = reinterpret_cast<const double*>(p_data + HEADER_SIZE);
+        const double* p_locations = p_doubles;
+        const double* p_thetas = p_locations + DIM*n;
+        const double* p_phis = p_thetas + n;
+        const double* p_lengths = p_phis + n;
+        const double* p_radii = p_lengths + n;
+        const double* p_birth_times = p_radii + n;
+        const uint64_t* p_machine_offsets = reinterpret_cast<const uint64_t*>(p_birth_times + n);
+        const uint64_t* p_coordinate_offsets = p_machine_offsets + n + 1;
+        const double* p_coordinates = reinterpret_cast<const double*>(p_coordinate_offsets + m + 1);
+        const uint32_t* p_states = reinterpret_cast<const uint32_t*>(p_coordinates + c);
+
+        std::vector<double> shifted_birth_times;
+        if (shiftToTimeZero)
+        {
+            shifted_birth_times.resize(n);
+            for (uint64_t i=0; i<n; i++)
+            {
+                shifted_birth_times[i] = p_birth_times[i] - time;
+            }
+            p_birth_times = shifted_birth_times.data();
+        }
+
+        try
+        {
+            if (p_machine_offsets[n] != m || p_coordinate_offsets[m] != c)
+            {
+                EXCEPTION("Initial condition file " << rFileName << " has inconsistent machine offsets");
+            }
+            rBuilder.SetCapsules(n, p_locations, p_thetas, p_phis, p_lengths, p_radii, p_birth_times);
+            rBuilder.SetMachines(p_machine_offsets, p_states, p_coordinate_offsets, p_coordinates);
+        }
+        catch (Exception&)
+        {
+            munmap(p_map, file_size);
+            throw;
+        }
+
+        munmap(p_map, file_size);
+        return time;
+    }
+};
+
+#endif /*CAPSULEINITIALCONDITIONFILE_HPP_*/
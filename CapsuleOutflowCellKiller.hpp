@@ -0,0 +1,154 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEOUTFLOWCELLKILLER_HPP_
+#define CAPSULEOUTFLOWCELLKILLER_HPP_
+
+#include <cfloat>
+
+#include "AbstractCellKiller.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+
+/**
+ * A cell killer that removes capsules flowing out of the ends of a channel
+ * along the x axis, so that a growing colony reaches a steady size. Use it
+ * with the channel walls of CapsuleWallBoundaryCondition.
+ *
+ * A cell is killed once the x coordinate of its centre is below the lower
+ * outlet or above the upper outlet. An outlet at -DBL_MAX or DBL_MAX is
+ * closed. A mother-machine trap therefore has one closed outlet, and an
+ * open channel has two outlets.
+ *
+ * This class is not archived.
+ */
+template<unsigned DIM>
+class CapsuleOutflowCellKiller : public AbstractCellKiller<DIM>
+{
+private:
+
+    /** Cells whose centre has x below this are killed. */
+    double mLowerOutlet;
+
+    /** Cells whose centre has x above this are killed. */
+    double mUpperOutlet;
+
+    /** Number of cells killed by this killer. */
+    unsigned mNumCellsRemoved;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param pCellPopulation pointer to the cell population
+     * @param lowerOutlet cells whose centre has x below this are killed; -DBL_MAX for a closed end
+     * @param upperOutlet cells whose centre has x above this are killed; DBL_MAX for a closed end
+     */
+    CapsuleOutflowCellKiller(AbstractCellPopulation<DIM>* pCellPopulation,
+                             double lowerOutlet=-DBL_MAX,
+                             double upperOutlet=DBL_MAX)
+        : AbstractCellKiller<DIM>(pCellPopulation),
+          mLowerOutlet(lowerOutlet),
+          mUpperOutlet(upperOutlet),
+          mNumCellsRemoved(0u)
+    {
+        if (lowerOutlet >= upperOutlet)
+        {
+            EXCEPTION("The lower outlet must be below the upper outlet");
+        }
+    }
+
+    /**
+     * @return mLowerOutlet
+     */
+    double GetLowerOutlet() const
+    {
+        return mLowerOutlet;
+    }
+
+    /**
+     * @return mUpperOutlet
+     */
+    double GetUpperOutlet() const
+    {
+        return mUpperOutlet;
+    }
+
+    /**
+     * @return the number of cells killed by this killer
+     */
+    unsigned GetNumCellsRemoved() const
+    {
+        return mNumCellsRemoved;
+    }
+
+    /**
+     * Overridden CheckAndLabelCellsForApoptosisOrDeath() method.
+     *
+     * Kill every cell whose centre has passed an outlet.
+     */
+    void CheckAndLabelCellsForApoptosisOrDeath()
+    {
+        for (typename AbstractCellPopulation<DIM>::Iterator cell_iter = this->mpCellPopulation->Begin();
+             cell_iter != this->mpCellPopulation->End();
+             ++cell_iter)
+        {
+            unsigned node_index = this->mpCellPopulation->GetLocationIndexUsingCell(*cell_iter);
+            double x = this->mpCellPopulation->GetNode(node_index)->rGetLocation()[0];
+            if ((x < mLowerOutlet || x > mUpperOutlet) && !cell_iter->IsDead())
+            {
+                cell_iter->Kill();
+                mNumCellsRemoved++;
+            }
+        }
+    }
+
+    /**
+     * Overridden OutputCellKillerParameters() method.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputCellKillerParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<LowerOutlet>" << mLowerOutlet << "</LowerOutlet>\n";
+        *rParamsFile << "\t\t\t<UpperOutlet>" << mUpperOutlet << "</UpperOutlet>\n";
+
+        // Call method on direct parent class
+        AbstractCellKiller<DIM>::OutputCellKillerParameters(rParamsFile);
+    }
+};
+
+#endif /*CAPSULEOUTFLOWCELLKILLER_HPP_*/
@@ -0,0 +1,270 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEPERFCOUNTERS_HPP_
+#define CAPSULEPERFCOUNTERS_HPP_
+
+#include <cstring>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * A group of hardware performance counters for the calling thread, read
+ * through the Linux perf_event_open interface. The counters are CPU cycles,
+ * retired instructions, last-level cache misses and branch mispredictions,
+ * counted in user space only.
+ *
+ * Open() fails if the cycle counter cannot be opened, for example on
+ * systems other than Linux, inside containers without access to the PMU,
+ * or when /proc/sys/kernel/perf_event_paranoid forbids it. Any of the other
+ * counters that the CPU does not support are left out of the group and read
+ * as zero. If the kernel multiplexes the group with other events, the values
+ * are scaled up by the ratio of the time enabled to the time running, so they
+ * are estimates.
+ *
+ * The object owns the counter file descriptors, so it cannot be copied.
+ */
+class CapsulePerfCounters
+{
+public:
+
+    /** Number of counters. */
+    static const unsigned NUM_COUNTERS = 4u;
+
+    /** The counters. */
+    enum Counter
+    {
+        CYCLES = 0,
+        INSTRUCTIONS,
+        LLC_MISSES,
+        BRANCH_MISSES
+    };
+
+private:
+
+    /** File descriptor of each counter, or -1 if it is not open. */
+    int mFileDescriptors[NUM_COUNTERS];
+
+    /** Position of each counter in a group read, or -1 if it is not open. */
+    int mGroupPositions[NUM_COUNTERS];
+
+    /** Number of open counters. */
+    unsigned mNumOpen;
+
+#ifdef __linux__
+    /**
+     * Open one counter.
+     *
+     * @param config the PERF_COUNT_HW_* event
+     * @param groupFd the group leader, or -1 to create a leader
+     * @return the file descriptor, or -1 on failure
+     */
+    int OpenCounter(uint64_t config, int groupFd)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = (groupFd == -1) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+    }
+#endif
+
+public:
+
+    /**
+     * Constructor. The counters are not opened until Open() is called.
+     */
+    CapsulePerfCounters()
+        : mNumOpen(0u)
+    {
+        for (unsigned i=0; i<NUM_COUNTERS; i++)
+        {
+            mFileDescriptors[i] = -1;
+            mGroupPositions[i] = -1;
+        }
+    }
+
+    /**
+     * Destructor. Closes the counters.
+     */
+    ~CapsulePerfCounters()
+    {
+        Close();
+    }
+
+    /** Not copyable, as a copy would close the same file descriptors. */
+    CapsulePerfCounters(const CapsulePerfCounters&) = delete;
+
+    /** Not copyable, as a copy would close the same file descriptors. */
+    CapsulePerfCounters& operator=(const CapsulePerfCounters&) = delete;
+
+    /**
+     * Open and start the counters for the calling thread.
+     *
+     * @return whether at least the cycle counter could be opened
+     */
+    bool Open()
+    {
+        if (mNumOpen > 0)
+        {
+            return true;
+        }
+#ifdef __linux__
+        const uint64_t configs[NUM_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES,
+                                                PERF_COUNT_HW_INSTRUCTIONS,
+                                                PERF_COUNT_HW_CACHE_MISSES,
+                                                PERF_COUNT_HW_BRANCH_MISSES};
+        for (unsigned i=0; i<NUM_COUNTERS; i++)
+        {
+            int fd = OpenCounter(configs[i], mFileDescriptors[CYCLES]);
+            if (fd == -1)
+            {
+                if (i == CYCLES)
+                {
+                    return false;
+                }
+                continue;
+            }
+            mFileDescriptors[i] = fd;
+            mGroupPositions[i] = mNumOpen;
+            mNumOpen++;
+        }
+        ioctl(mFileDescriptors[CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(mFileDescriptors[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Close the counters.
+     */
+    void Close()
+    {
+        for (unsigned i=0; i<NUM_COUNTERS; i++)
+        {
+#ifdef __linux__
+            if (mFileDescriptors[i] != -1)
+            {
+                close(mFileDescriptors[i]);
+            }
+#endif
+            mFileDescriptors[i] = -1;
+            mGroupPositions[i] = -1;
+        }
+        mNumOpen = 0;
+    }
+
+    /**
+     * @return whether the counters are open
+     */
+    bool IsOpen() const
+    {
+        return mNumOpen > 0;
+    }
+
+    /**
+     * @param counter a counter
+     * @return whether the counter is open
+     */
+    bool IsCounterOpen(unsigned counter) const
+    {
+        return mGroupPositions[counter] != -1;
+    }
+
+    /**
+     * Read the current values of all counters with a single system call,
+     * scaled for multiplexing. Counters that are not open read as zero.
+     *
+     * @param values filled with the value of each counter, or with zeros if
+     *     the read fails
+     * @return whether the counters are open and were read; false if the read
+     *     failed or the group has not yet been scheduled on the CPU
+     */
+    bool Read(uint64_t values[NUM_COUNTERS]) const
+    {
+        for (unsigned i=0; i<NUM_COUNTERS; i++)
+        {
+            values[i] = 0u;
+        }
+#ifdef __linux__
+        if (mNumOpen > 0)
+        {
+            // Group read format: the number of counters, the times enabled and running, then the values
+            uint64_t buffer[NUM_COUNTERS + 3] = {0};
+            ssize_t expected_bytes = (3 + mNumOpen)*sizeof(uint64_t);
+            if (read(mFileDescriptors[CYCLES], buffer, sizeof(buffer)) != expected_bytes || buffer[2] == 0u)
+            {
+                return false;
+            }
+            const double scale = static_cast<double>(buffer[1])/static_cast<double>(buffer[2]);
+            for (unsigned i=0; i<NUM_COUNTERS; i++)
+            {
+                if (mGroupPositions[i] != -1)
+                {
+                    uint64_t value = buffer[3 + mGroupPositions[i]];
+                    values[i] = (buffer[2] < buffer[1]) ? static_cast<uint64_t>(value*scale) : value;
+                }
+            }
+            return true;
+        }
+#endif
+        return false;
+    }
+
+    /**
+     * @param counter a counter
+     * @return the name of the counter, as used in output files
+     */
+    static const char* GetCounterName(unsigned counter)
+    {
+        static const char* names[NUM_COUNTERS] = {"cycles", "instructions", "llc_misses", "branch_misses"};
+        return names[counter];
+    }
+};
+
+#endif /*CAPSULEPERFCOUNTERS_HPP_*/
@@ -0,0 +1,388 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEPOPULATIONBUILDER_HPP_
+#define CAPSULEPOPULATIONBUILDER_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Cell.hpp"
+#include "Exception.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "SmartPointers.hpp"
+#include "UblasCustomFunctions.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * Builds the mesh and cells of a NodeBasedCellPopulationWithCapsules in bulk
+ * from flat arrays, in the manner of CellsGenerator.
+ *
+ * Capsules are given either one at a time with AddCapsule() and AddMachine(),
+ * or all at once with SetCapsules() and SetMachines(), which copy from
+ * contiguous arrays. The arrays hold, for n capsules:
+ * - locations: DIM*n values, capsule by capsule
+ * - thetas, phis, lengths, radii and birth times: n values each; phis are
+ *   stored in NA_PHI but only used in 3D
+ *
+ * Machines are held in the same layout as in CapsulePopulationCheckpoint:
+ * - machine offsets: n+1 values; the machines of capsule i are
+ *   [offsets[i], offsets[i+1])
+ * - machine states: one value per machine
+ * - machine coordinate offsets: one more value than there are machines
+ * - machine coordinates: flat, delimited by the coordinate offsets
+ *
+ * GenerateMesh() and GenerateCells() then create all nodes, attribute
+ * vectors, cells, cell cycle models and TypeSixMachineProperty objects, with
+ * the outer containers reserved to their final size. The inner vectors and
+ * the nodes are still allocated one by one, and ConstructNodesWithoutMesh()
+ * copies each node, so GenerateMesh() allocates a temporary node per capsule
+ * as well. One mutation state is shared by all cells, as in the hand-written
+ * set-up loops. Node i and cell i correspond, so the results can be passed
+ * straight to the population constructor:
+ *
+ *     CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+ *     ...
+ *     NodesOnlyMesh<2> mesh;
+ *     builder.GenerateMesh(mesh, 100.0);
+ *     std::vector<CellPtr> cells;
+ *     builder.GenerateCells(cells, p_type);
+ *     NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+ */
+template<class CELL_CYCLE_MODEL, unsigned DIM>
+class CapsulePopulationBuilder
+{
+private:
+
+    /** Capsule centres, DIM values per capsule. */
+    std::vector<double> mLocations;
+
+    /** Capsule azimuthal angles. */
+    std::vector<double> mThetas;
+
+    /** Capsule polar angles. */
+    std::vector<double> mPhis;
+
+    /** Capsule lengths. */
+    std::vector<double> mLengths;
+
+    /** Capsule radii. */
+    std::vector<double> mRadii;
+
+    /** Cell birth times. */
+    std::vector<double> mBirthTimes;
+
+    /** Offsets of each capsule's machines; one more entry than capsules. */
+    std::vector<uint64_t> mMachineOffsets;
+
+    /** State of each machine. */
+    std::vector<uint32_t> mMachineStates;
+
+    /** Offsets of each machine's coordinates; one more entry than machines. */
+    std::vector<uint64_t> mMachineCoordinateOffsets;
+
+    /** Machine coordinates. */
+    std::vector<double> mMachineCoordinates;
+
+    /** Called on each new cell cycle model, with the capsule index. */
+    std::function<void(CELL_CYCLE_MODEL*, unsigned)> mCellCycleModelInitialiser;
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    CapsulePopulationBuilder()
+    {
+        mMachineOffsets.push_back(0u);
+        mMachineCoordinateOffsets.push_back(0u);
+    }
+
+    /**
+     * Reserve storage for capsules added with AddCapsule() and AddMachine().
+     *
+     * @param numCapsules the expected number of capsules
+     * @param numMachines the expected total number of machines
+     * @param numMachineCoordinates the expected total number of machine coordinates
+     */
+    void Reserve(unsigned numCapsules, unsigned numMachines, unsigned numMachineCoordinates)
+    {
+        mLocations.reserve(DIM*numCapsules);
+        mThetas.reserve(numCapsules);
+        mPhis.reserve(numCapsules);
+        mLengths.reserve(numCapsules);
+        mRadii.reserve(numCapsules);
+        mBirthTimes.reserve(numCapsules);
+        mMachineOffsets.reserve(numCapsules + 1);
+        mMachineStates.reserve(numMachines);
+        mMachineCoordinateOffsets.reserve(numMachines + 1);
+        mMachineCoordinates.reserve(numMachineCoordinates);
+    }
+
+    /**
+     * Add a capsule with no machines.
+     *
+     * @param rLocation the centre
+     * @param theta the azimuthal angle
+     * @param phi the polar angle, only used in 3D
+     * @param length the length
+     * @param radius the radius
+     * @param birthTime the birth time of the cell
+     * @return the index of the capsule
+     */
+    unsigned AddCapsule(const c_vector<double, DIM>& rLocation, double theta, double phi,
+                        double length, double radius, double birthTime)
+    {
+        for (unsigned i=0; i<DIM; i++)
+        {
+            mLocations.push_back(rLocation[i]);
+        }
+        mThetas.push_back(theta);
+        mPhis.push_back(phi);
+        mLengths.push_back(length);
+        mRadii.push_back(radius);
+        mBirthTimes.push_back(birthTime);
+        mMachineOffsets.push_back(mMachineStates.size());
+        return mThetas.size() - 1;
+    }
+
+    /**
+     * Add a machine to the most recently added capsule.
+     *
+     * @param state the machine state
+     * @param rCoordinates the machine coordinates on the capsule
+     */
+    void AddMachine(unsigned state, const std::vector<double>& rCoordinates)
+    {
+        if (mThetas.empty())
+        {
+            EXCEPTION("A capsule must be added before its machines");
+        }
+        mMachineStates.push_back(state);
+        mMachineCoordinates.insert(mMachineCoordinates.end(), rCoordinates.begin(), rCoordinates.end());
+        mMachineCoordinateOffsets.push_back(mMachineCoordinates.size());
+        mMachineOffsets.back() = mMachineStates.size();
+    }
+
+    /**
+     * Replace all capsules by copying from contiguous arrays. All capsules are
+     * left without machines until SetMachines() is called.
+     *
+     * @param numCapsules the number of capsules
+     * @param pLocations DIM*numCapsules centre coordinates
+     * @param pThetas numCapsules azimuthal angles
+     * @param pPhis numCapsules polar angles, or nullptr for zeros
+     * @param pLengths numCapsules lengths
+     * @param pRadii numCapsules radii
+     * @param pBirthTimes numCapsules birth times
+     */
+    void SetCapsules(unsigned numCapsules, const double* pLocations, const double* pThetas, const double* pPhis,
+                     const double* pLengths, const double* pRadii, const double* pBirthTimes)
+    {
+        mLocations.assign(pLocations, pLocations + DIM*numCapsules);
+        mThetas.assign(pThetas, pThetas + numCapsules);
+        if (pPhis == nullptr)
+        {
+            mPhis.assign(numCapsules, 0.0);
+        }
+        else
+        {
+            mPhis.assign(pPhis, pPhis + numCapsules);
+        }
+        mLengths.assign(pLengths, pLengths + numCapsules);
+        mRadii.assign(pRadii, pRadii + numCapsules);
+        mBirthTimes.assign(pBirthTimes, pBirthTimes + numCapsules);
+
+        mMachineOffsets.assign(numCapsules + 1, 0u);
+        mMachineStates.clear();
+        mMachineCoordinateOffsets.assign(1u, 0u);
+        mMachineCoordinates.clear();
+    }
+
+    /**
+     * Replace all machines by copying from contiguous arrays, in the layout
+     * described in the class documentation.
+     *
+     * @param pMachineOffsets GetNumCapsules()+1 machine offsets
+     * @param pMachineStates the machine states
+     * @param pMachineCoordinateOffsets one more machine coordinate offset than machines
+     * @param pMachineCoordinates the machine coordinates
+     */
+    void SetMachines(const uint64_t* pMachineOffsets, const uint32_t* pMachineStates,
+                     const uint64_t* pMachineCoordinateOffsets, const double* pMachineCoordinates)
+    {
+        const unsigned num_capsules = GetNumCapsules();
+        if (pMachineOffsets[0] != 0u || pMachineCoordinateOffsets[0] != 0u)
+        {
+            EXCEPTION("Machine offsets must start at zero");
+        }
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            if (pMachineOffsets[i + 1] < pMachineOffsets[i])
+            {
+                EXCEPTION("Machine offsets must not decrease");
+            }
+        }
+        const uint64_t num_machines = pMachineOffsets[num_capsules];
+        for (uint64_t i=0; i<num_machines; i++)
+        {
+            if (pMachineCoordinateOffsets[i + 1] < pMachineCoordinateOffsets[i])
+            {
+                EXCEPTION("Machine coordinate offsets must not decrease");
+            }
+        }
+        const uint64_t num_coordinates = pMachineCoordinateOffsets[num_machines];
+
+        mMachineOffsets.assign(pMachineOffsets, pMachineOffsets + num_capsules + 1);
+        mMachineStates.assign(pMachineStates, pMachineStates + num_machines);
+        mMachineCoordinateOffsets.assign(pMachineCoordinateOffsets, pMachineCoordinateOffsets + num_machines + 1);
+        mMachineCoordinates.assign(pMachineCoordinates, pMachineCoordinates + num_coordinates);
+    }
+
+    /**
+     * Set a function to be called on each new cell cycle model, with the
+     * capsule index, for example to set the durations of a
+     * UniformCellCycleModel.
+     *
+     * @param initialiser the function
+     */
+    void SetCellCycleModelInitialiser(std::function<void(CELL_CYCLE_MODEL*, unsigned)> initialiser)
+    {
+        mCellCycleModelInitialiser = initialiser;
+    }
+
+    /**
+     * @return the number of capsules
+     */
+    unsigned GetNumCapsules() const
+    {
+        return mThetas.size();
+    }
+
+    /**
+     * @return the total number of machines
+     */
+    unsigned GetNumMachines() const
+    {
+        return mMachineStates.size();
+    }
+
+    /**
+     * Construct the nodes of the mesh and set their capsule attributes.
+     *
+     * @param rMesh an empty mesh
+     * @param maxCutOffLength the interaction cut-off passed to ConstructNodesWithoutMesh()
+     */
+    void GenerateMesh(NodesOnlyMesh<DIM>& rMesh, double maxCutOffLength) const
+    {
+        const unsigned num_capsules = GetNumCapsules();
+
+        // ConstructNodesWithoutMesh() copies the locations only
+        std::vector<Node<DIM>*> nodes;
+        nodes.reserve(num_capsules);
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            c_vector<double, DIM> location;
+            for (unsigned d=0; d<DIM; d++)
+            {
+                location[d] = mLocations[DIM*i + d];
+            }
+            nodes.push_back(new Node<DIM>(i, location));
+        }
+        rMesh.ConstructNodesWithoutMesh(nodes, maxCutOffLength);
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            delete nodes[i];
+        }
+
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            Node<DIM>* p_node = rMesh.GetNode(i);
+            p_node->AddNodeAttribute(0.0);
+            std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+            r_attributes.resize(NA_VEC_LENGTH);
+            r_attributes[NA_THETA] = mThetas[i];
+            r_attributes[NA_PHI] = mPhis[i];
+            r_attributes[NA_LENGTH] = mLengths[i];
+            r_attributes[NA_RADIUS] = mRadii[i];
+        }
+    }
+
+    /**
+     * Create one cell per capsule, in capsule order. Every cell gets a
+     * TypeSixMachineProperty, which is empty if the capsule has no machines,
+     * as code elsewhere assumes the property is present.
+     *
+     * @param rCells an empty vector of cells
+     * @param pCellProliferativeType the proliferative type of every cell
+     */
+    void GenerateCells(std::vector<CellPtr>& rCells, boost::shared_ptr<AbstractCellProperty> pCellProliferativeType) const
+    {
+        const unsigned num_capsules = GetNumCapsules();
+        rCells.clear();
+        rCells.reserve(num_capsules);
+
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            CELL_CYCLE_MODEL* p_model = new CELL_CYCLE_MODEL();
+            if (mCellCycleModelInitialiser)
+            {
+                mCellCycleModelInitialiser(p_model, i);
+            }
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(pCellProliferativeType);
+            p_cell->SetBirthTime(mBirthTimes[i]);
+
+            MAKE_PTR(TypeSixMachineProperty, p_property);
+            std::vector<std::pair<unsigned, std::vector<double>> >& r_data = p_property->rGetMachineData();
+            r_data.reserve(mMachineOffsets[i + 1] - mMachineOffsets[i]);
+            for (uint64_t machine = mMachineOffsets[i]; machine < mMachineOffsets[i + 1]; machine++)
+            {
+                r_data.emplace_back(mMachineStates[machine],
+                                    std::vector<double>(mMachineCoordinates.begin() + mMachineCoordinateOffsets[machine],
+                                                        mMachineCoordinates.begin() + mMachineCoordinateOffsets[machine + 1]));
+            }
+            p_cell->AddCellProperty(p_property);
+
+            rCells.push_back(p_cell);
+        }
+    }
+};
+
+#endif /*CAPSULEPOPULATIONBUILDER_HPP_*/
@@ -0,0 +1,567 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEPOPULATIONCHECKPOINT_HPP_
+#define CAPSULEPOPULATIONCHECKPOINT_HPP_
+
+// Must be included before any other serialization headers
+#include "CheckpointArchiveTypes.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+#include "NoCellCycleModel.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "SimulationTime.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+#include "UniformCellCycleModel.hpp"
+
+/**
+ * A fast binary checkpoint of a capsule cell population.
+ *
+ * The state of each cell (centre, node attribute vector, birth time, cell cycle
+ * duration and TypeSixMachineProperty data) is stored as flat arrays and written
+ * to file with one bulk write per array, together with the simulation time and
+ * the internal state of the RandomNumberGenerator. CapsuleForce,
+ * ForwardEulerNumericalMethodForCapsules and TypeSixMachineModifier carry only
+ * parameters, which are set up by the driver code as usual.
+ *
+ * To restart, load the file, call RestoreSimulationTime(), construct a
+ * population with the same number of cells in the same order (for example with
+ * the cell cycle models and properties used in the original run), then call
+ * Restore(). The restored centres, attributes and machine data are bitwise
+ * identical to those saved.
+ *
+ * Only UniformCellCycleModel and NoCellCycleModel are supported, and cell
+ * properties other than TypeSixMachineProperty are not stored. Cell IDs are
+ * stored for reference but are not restored.
+ */
+template<unsigned DIM>
+class CapsulePopulationCheckpoint
+{
+private:
+
+    /** Identifies a checkpoint file. */
+    static constexpr const char* MAGIC = "CAPSCKPT";
+
+    /** Version of the file layout. */
+    static const uint32_t VERSION = 1u;
+
+    /** The simulation time at which the checkpoint was taken. */
+    double mTime;
+
+    /** Number of attributes stored for each node. */
+    uint64_t mNumAttributes;
+
+    /** Centres, DIM values per cell. */
+    std::vector<double> mLocations;
+
+    /** Node attributes, mNumAttributes values per cell. */
+    std::vector<double> mAttributes;
+
+    /** Cell IDs. */
+    std::vector<uint32_t> mCellIds;
+
+    /** Birth times. */
+    std::vector<double> mBirthTimes;
+
+    /** Cell cycle durations, or NaN for cells with a NoCellCycleModel. */
+    std::vector<double> mCellCycleDurations;
+
+    /** Offsets of each cell's machines in mMachineStates; one more entry than cells. */
+    std::vector<uint64_t> mMachineOffsets;
+
+    /** State of each machine. */
+    std::vector<uint32_t> mMachineStates;
+
+    /** Offsets of each machine's coordinates in mMachineCoordinates; one more entry than machines. */
+    std::vector<uint64_t> mMachineCoordinateOffsets;
+
+    /** Coordinates of each machine. */
+    std::vector<double> mMachineCoordinates;
+
+    /** Serialized state of the random number generator. */
+    std::string mRandomNumberGeneratorState;
+
+    /**
+     * Write a vector to a binary stream, preceded by its length.
+     *
+     * @param rFile the stream
+     * @param rVector the vector
+     */
+    template<typename T>
+    static void WriteArray(std::ofstream& rFile, const std::vector<T>& rVector)
+    {
+        uint64_t size = rVector.size();
+        rFile.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        if (size > 0)
+        {
+            rFile.write(reinterpret_cast<const char*>(rVector.data()), size*sizeof(T));
+        }
+    }
+
+    /**
+     * Read a vector written by WriteArray(). If the stored length is longer
+     * than the rest of the file, the vector is left empty and the stream is
+     * put in a failed state.
+     *
+     * @param rFile the stream
+     * @param rVector the vector to fill
+     * @param fileSize the length of the file in bytes
+     */
+    template<typename T>
+    static void ReadArray(std::ifstream& rFile, std::vector<T>& rVector, uint64_t fileSize)
+    {
+        uint64_t size = 0;
+        rFile.read(reinterpret_cast<char*>(&size), sizeof(size));
+        rVector.clear();
+        if (!rFile.good())
+        {
+            return;
+        }
+        const uint64_t position = static_cast<uint64_t>(rFile.tellg());
+        if (position > fileSize || size > (fileSize - position)/sizeof(T))
+        {
+            rFile.setstate(std::ios::failbit);
+            return;
+        }
+        rVector.resize(size);
+        if (size > 0)
+        {
+            rFile.read(reinterpret_cast<char*>(rVector.data()), size*sizeof(T));
+        }
+    }
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    CapsulePopulationCheckpoint()
+        : mTime(0.0),
+          mNumAttributes(0u)
+    {
+    }
+
+    /**
+     * Store the state of a population, the simulation time and the random
+     * number generator.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    void Capture(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        mTime = SimulationTime::Instance()->GetTime();
+
+        const unsigned num_cells = rCellPopulation.GetNumRealCells();
+        mNumAttributes = 0;
+        mLocations.clear();
+        mAttributes.clear();
+        mCellIds.clear();
+        mBirthTimes.clear();
+        mCellCycleDurations.clear();
+        mMachineOffsets.clear();
+        mMachineStates.clear();
+        mMachineCoordinateOffsets.clear();
+        mMachineCoordinates.clear();
+
+        mLocations.reserve(DIM*num_cells);
+        mCellIds.reserve(num_cells);
+        mBirthTimes.reserve(num_cells);
+        mCellCycleDurations.reserve(num_cells);
+        mMachineOffsets.reserve(num_cells + 1);
+        mMachineOffsets.push_back(0u);
+        mMachineCoordinateOffsets.push_back(0u);
+
+        for (typename AbstractCellPopulation<DIM,DIM>::Iterator cell_iter = rCellPopulation.Begin();
+             cell_iter != rCellPopulation.End();
+             ++cell_iter)
+        {
+            Node<DIM>* p_node = rCellPopulation.GetNode(rCellPopulation.GetLocationIndexUsingCell(*cell_iter));
+            const std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+            if (mCellIds.empty())
+            {
+                mNumAttributes = r_attributes.size();
+                mAttributes.reserve(mNumAttributes*num_cells);
+            }
+            else if (r_attributes.size() != mNumAttributes)
+            {
+                EXCEPTION("All nodes must have the same number of attributes to be checkpointed");
+            }
+
+            const c_vector<double, DIM>& r_location = p_node->rGetLocation();
+            mLocations.insert(mLocations.end(), r_location.begin(), r_location.end());
+            mAttributes.insert(mAttributes.end(), r_attributes.begin(), r_attributes.end());
+
+            mCellIds.push_back(cell_iter->GetCellId());
+            mBirthTimes.push_back(cell_iter->GetBirthTime());
+
+            AbstractCellCycleModel* p_model = cell_iter->GetCellCycleModel();
+            if (dynamic_cast<UniformCellCycleModel*>(p_model) != nullptr)
+            {
+                mCellCycleDurations.push_back(static_cast<UniformCellCycleModel*>(p_model)->GetCellCycleDuration());
+            }
+            else if (dynamic_cast<NoCellCycleModel*>(p_model) != nullptr)
+            {
+                mCellCycleDurations.push_back(std::numeric_limits<double>::quiet_NaN());
+            }
+            else
+            {
+                EXCEPTION("CapsulePopulationCheckpoint only supports UniformCellCycleModel and NoCellCycleModel");
+            }
+
+            CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+            if (collection.GetSize() == 1)
+            {
+                boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+                for (const auto& r_pair : p_property->rGetMachineData())
+                {
+                    mMachineStates.push_back(r_pair.first);
+                    mMachineCoordinates.insert(mMachineCoordinates.end(), r_pair.second.begin(), r_pair.second.end());
+                    mMachineCoordinateOffsets.push_back(mMachineCoordinates.size());
+                }
+            }
+            mMachineOffsets.push_back(mMachineStates.size());
+        }
+
+        std::ostringstream rng_stream;
+        {
+            boost::archive::text_oarchive output_arch(rng_stream);
+            const RandomNumberGenerator& r_gen = *RandomNumberGenerator::Instance();
+            output_arch << r_gen;
+        }
+        mRandomNumberGeneratorState = rng_stream.str();
+    }
+
+    /**
+     * Write the stored state to a binary file.
+     *
+     * @param rFileName the absolute path of the file
+     */
+    void Save(const std::string& rFileName) const
+    {
+        std::ofstream file(rFileName.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            EXCEPTION("Could not open checkpoint file " << rFileName << " for writing");
+        }
+
+        uint32_t version = VERSION;
+        uint32_t dim = DIM;
+        file.write(MAGIC, 8);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        file.write(reinterpret_cast<const char*>(&dim), sizeof(dim));
+        file.write(reinterpret_cast<const char*>(&mTime), sizeof(mTime));
+        file.write(reinterpret_cast<const char*>(&mNumAttributes), sizeof(mNumAttributes));
+
+        WriteArray(file, mLocations);
+        WriteArray(file, mAttributes);
+        WriteArray(file, mCellIds);
+        WriteArray(file, mBirthTimes);
+        WriteArray(file, mCellCycleDurations);
+        WriteArray(file, mMachineOffsets);
+        WriteArray(file, mMachineStates);
+        WriteArray(file, mMachineCoordinateOffsets);
+        WriteArray(file, mMachineCoordinates);
+        WriteArray(file, std::vector<char>(mRandomNumberGeneratorState.begin(), mRandomNumberGeneratorState.end()));
+
+        if (!file.good())
+        {
+            EXCEPTION("Error writing checkpoint file " << rFileName);
+        }
+    }
+
+    /**
+     * Read the stored state from a binary file written by Save().
+     *
+     * @param rFileName the absolute path of the file
+     */
+    void Load(const std::string& rFileName)
+    {
+        std::ifstream file(rFileName.c_str(), std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+        {
+            EXCEPTION("Could not open checkpoint file " << rFileName);
+        }
+        const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+        file.seekg(0);
+
+        char magic[8];
+        uint32_t version = 0;
+        uint32_t dim = 0;
+        file.read(magic, 8);
+        file.read(reinterpret_cast<char*>(&version), sizeof(version));
+        file.read(reinterpret_cast<char*>(&dim), sizeof(dim));
+        if (!file.good() || std::string(magic, 8) != MAGIC || version != VERSION)
+        {
+            EXCEPTION(rFileName << " is not a capsule population checkpoint file");
+        }
+        if (dim != DIM)
+        {
+            EXCEPTION("Checkpoint file " << rFileName << " is for dimension " << dim << ", not " << DIM);
+        }
+        file.read(reinterpret_cast<char*>(&mTime), sizeof(mTime));
+        file.read(reinterpret_cast<char*>(&mNumAttributes), sizeof(mNumAttributes));
+
+        ReadArray(file, mLocations, file_size);
+        ReadArray(file, mAttributes, file_size);
+        ReadArray(file, mCellIds, file_size);
+        ReadArray(file, mBirthTimes, file_size);
+        ReadArray(file, mCellCycleDurations, file_size);
+        ReadArray(file, mMachineOffsets, file_size);
+        ReadArray(file, mMachineStates, file_size);
+        ReadArray(file, mMachineCoordinateOffsets, file_size);
+        ReadArray(file, mMachineCoordinates, file_size);
+        std::vector<char> rng_state;
+        ReadArray(file, rng_state, file_size);
+        mRandomNumberGeneratorState.assign(rng_state.begin(), rng_state.end());
+
+        if (!file.good())
+        {
+            EXCEPTION("Checkpoint file " << rFileName << " is truncated");
+        }
+    }
+
+    /**
+     * Reset SimulationTime to start at the stored time. Call this before
+     * creating the cells of the restarted population.
+     */
+    void RestoreSimulationTime() const
+    {
+        SimulationTime::Destroy();
+        SimulationTime::Instance()->SetStartTime(mTime);
+    }
+
+    /**
+     * Copy the stored state into a population with the same number of cells,
+     * matched in iteration order, and restore the random number generator.
+     * The stored arrays are first checked against the number of cells, and
+     * the machine offsets are checked as in CapsulePopulationBuilder::SetMachines().
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    void Restore(AbstractCellPopulation<DIM,DIM>& rCellPopulation) const
+    {
+        if (rCellPopulation.GetNumRealCells() != GetNumCells())
+        {
+            EXCEPTION("The population has " << rCellPopulation.GetNumRealCells()
+                      << " cells but the checkpoint has " << GetNumCells());
+        }
+
+        const uint64_t num_cells = GetNumCells();
+        const bool attributes_match = (num_cells == 0) ? mAttributes.empty()
+            : (mAttributes.size() % num_cells == 0 && mAttributes.size()/num_cells == mNumAttributes);
+        if (mLocations.size() != DIM*num_cells || !attributes_match || mBirthTimes.size() != num_cells
+            || mCellCycleDurations.size() != num_cells || mMachineOffsets.size() != num_cells + 1
+            || mMachineCoordinateOffsets.size() != mMachineStates.size() + 1)
+        {
+            EXCEPTION("The checkpoint arrays do not match its " << num_cells << " cells");
+        }
+        if (mMachineOffsets[0] != 0u || mMachineCoordinateOffsets[0] != 0u)
+        {
+            EXCEPTION("Checkpoint machine offsets must start at zero");
+        }
+        for (uint64_t i=0; i<num_cells; i++)
+        {
+            if (mMachineOffsets[i + 1] < mMachineOffsets[i])
+            {
+                EXCEPTION("Checkpoint machine offsets must not decrease");
+            }
+        }
+        if (mMachineOffsets[num_cells] != mMachineStates.size())
+        {
+            EXCEPTION("Checkpoint machine offsets must end at the number of machines");
+        }
+        for (uint64_t i=0; i<mMachineStates.size(); i++)
+        {
+            if (mMachineCoordinateOffsets[i + 1] < mMachineCoordinateOffsets[i])
+            {
+                EXCEPTION("Checkpoint machine coordinate offsets must not decrease");
+            }
+        }
+        if (mMachineCoordinateOffsets[mMachineStates.size()] != mMachineCoordinates.size())
+        {
+            EXCEPTION("Checkpoint machine coordinate offsets must end at the number of coordinates");
+        }
+
+        unsigned cell_index = 0;
+        for (typename AbstractCellPopulation<DIM,DIM>::Iterator cell_iter = rCellPopulation.Begin();
+             cell_iter != rCellPopulation.End();
+             ++cell_iter, ++cell_index)
+        {
+            Node<DIM>* p_node = rCellPopulation.GetNode(rCellPopulation.GetLocationIndexUsingCell(*cell_iter));
+
+            c_vector<double, DIM>& r_location = p_node->rGetModifiableLocation();
+            for (unsigned i=0; i<DIM; i++)
+            {
+                r_location[i] = mLocations[DIM*cell_index + i];
+            }
+
+            if (!p_node->HasNodeAttributes())
+            {
+                p_node->AddNodeAttribute(0.0);
+            }
+            std::vector<double>& r_attributes = p_node->rGetNodeAttributes();
+            r_attributes.assign(mAttributes.begin() + mNumAttributes*cell_index,
+                                mAttributes.begin() + mNumAttributes*(cell_index + 1));
+
+            cell_iter->SetBirthTime(mBirthTimes[cell_index]);
+
+            // Fix the duration drawn by the model, then restore its bounds for future divisions
+            double duration = mCellCycleDurations[cell_index];
+            if (!std::isnan(duration))
+            {
+                UniformCellCycleModel* p_model = dynamic_cast<UniformCellCycleModel*>(cell_iter->GetCellCycleModel());
+                if (p_model == nullptr)
+                {
+                    EXCEPTION("Cell " << cell_index << " must have a UniformCellCycleModel to be restored");
+                }
+                double min_duration = p_model->GetMinCellCycleDuration();
+                double max_duration = p_model->GetMaxCellCycleDuration();
+                p_model->SetMinCellCycleDuration(duration);
+                p_model->SetMaxCellCycleDuration(duration);
+                p_model->Initialise();
+                p_model->SetMinCellCycleDuration(min_duration);
+                p_model->SetMaxCellCycleDuration(max_duration);
+            }
+
+            CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+            if (collection.GetSize() == 1)
+            {
+                boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+                std::vector<std::pair<unsigned, std::vector<double>> >& r_data = p_property->rGetMachineData();
+                r_data.clear();
+                r_data.reserve(mMachineOffsets[cell_index + 1] - mMachineOffsets[cell_index]);
+                for (uint64_t machine = mMachineOffsets[cell_index]; machine < mMachineOffsets[cell_index + 1]; machine++)
+                {
+                    r_data.emplace_back(mMachineStates[machine],
+                                        std::vector<double>(mMachineCoordinates.begin() + mMachineCoordinateOffsets[machine],
+                                                            mMachineCoordinates.begin() + mMachineCoordinateOffsets[machine + 1]));
+                }
+            }
+            else if (mMachineOffsets[cell_index + 1] > mMachineOffsets[cell_index])
+            {
+                EXCEPTION("Cell " << cell_index << " needs a TypeSixMachineProperty to restore its machines");
+            }
+        }
+
+        // Restored last, as Initialise() above draws random numbers
+        std::istringstream rng_stream(mRandomNumberGeneratorState);
+        boost::archive::text_iarchive input_arch(rng_stream);
+        input_arch >> *RandomNumberGenerator::Instance();
+    }
+
+    /** @return the simulation time at which the checkpoint was taken */
+    double GetTime() const
+    {
+        return mTime;
+    }
+
+    /** @return the number of cells stored */
+    unsigned GetNumCells() const
+    {
+        return mCellIds.size();
+    }
+
+    /** @return the number of attributes stored for each node */
+    unsigned GetNumAttributes() const
+    {
+        return mNumAttributes;
+    }
+
+    /** @return the centres, DIM values per cell */
+    const std::vector<double>& rGetLocations() const
+    {
+        return mLocations;
+    }
+
+    /** @return the node attributes, GetNumAttributes() values per cell */
+    const std::vector<double>& rGetAttributes() const
+    {
+        return mAttributes;
+    }
+
+    /** @return the cell IDs at the time of the checkpoint */
+    const std::vector<uint32_t>& rGetCellIds() const
+    {
+        return mCellIds;
+    }
+
+    /** @return the birth times */
+    const std::vector<double>& rGetBirthTimes() const
+    {
+        return mBirthTimes;
+    }
+
+    /** @return the cell cycle durations, NaN for cells with a NoCellCycleModel */
+    const std::vector<double>& rGetCellCycleDurations() const
+    {
+        return mCellCycleDurations;
+    }
+
+    /** @return the offsets of each cell's machines; one more entry than cells */
+    const std::vector<uint64_t>& rGetMachineOffsets() const
+    {
+        return mMachineOffsets;
+    }
+
+    /** @return the state of each machine */
+    const std::vector<uint32_t>& rGetMachineStates() const
+    {
+        return mMachineStates;
+    }
+
+    /** @return the offsets of each machine's coordinates; one more entry than machines */
+    const std::vector<uint64_t>& rGetMachineCoordinateOffsets() const
+    {
+        return mMachineCoordinateOffsets;
+    }
+
+    /** @return the coordinates of each machine */
+    const std::vector<double>& rGetMachineCoordinates() const
+    {
+        return mMachineCoordinates;
+    }
+};
+
+#endif /*CAPSULEPOPULATIONCHECKPOINT_HPP_*/
@@ -0,0 +1,301 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEPROFILEOUTPUTMODIFIER_HPP_
+#define CAPSULEPROFILEOUTPUTMODIFIER_HPP_
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AbstractCellBasedSimulationModifier.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "CellBasedEventHandler.hpp"
+#include "Exception.hpp"
+#include "OutputFileHandler.hpp"
+#include "SimulationTime.hpp"
+#include "Warnings.hpp"
+#include "CapsuleProfiler.hpp"
+
+/**
+ * A modifier that writes the CapsuleProfiler phases, aggregated over each
+ * sampling interval, to capsuleprofile.dat in the simulation output directory.
+ *
+ * Each row holds the time at the end of the interval, the phase name, the wall
+ * time in seconds, the number of timed calls, the phase counter and the
+ * cycles, instructions, last-level cache misses and branch mispredictions
+ * counted during the phase. The hardware counts are zero unless
+ * SetUseHardwareCounters(true) was called and perf_event_open is available
+ * (see CapsulePerfCounters). Rows are also written for the population update,
+ * birth, death and output events of CellBasedEventHandler, which cover the
+ * box-collection updates and cell writers that the Profiled* wrappers cannot
+ * reach; these have no calls, counter or hardware counts. At the end of the
+ * solve, one row per phase with time "total" gives the whole run.
+ *
+ * Profiler phases are only written when CAPSULE_PROFILING is defined. This
+ * modifier is not archived.
+ */
+template<unsigned DIM>
+class CapsuleProfileOutputModifier : public AbstractCellBasedSimulationModifier<DIM,DIM>
+{
+private:
+
+    /** Number of time steps per interval. Defaults to 1. */
+    unsigned mSamplingTimestepMultiple;
+
+    /** Whether to read hardware performance counters. Defaults to false. */
+    bool mUseHardwareCounters;
+
+    /** The output file. */
+    out_stream mpProfileFile;
+
+    /** The CellBasedEventHandler events that are written. */
+    std::vector<unsigned> mEvents;
+
+    /** Names of the events in mEvents. */
+    std::vector<std::string> mEventNames;
+
+    /** Elapsed times of the events in mEvents at the end of the previous interval, in ms. */
+    std::vector<double> mPreviousEventTimes;
+
+    /** Elapsed times of the events in mEvents at the start of the solve, in ms. */
+    std::vector<double> mStartEventTimes;
+
+    /**
+     * Write one row per phase and event for the interval ending now.
+     *
+     * @param rTime the time column
+     */
+    void WriteInterval(const std::string& rTime)
+    {
+        if (CapsuleProfiler::IsEnabled())
+        {
+            const std::vector<CapsuleProfiler::Phase>& r_phases = CapsuleProfiler::rGetPhases();
+            for (unsigned i=0; i<r_phases.size(); i++)
+            {
+                *mpProfileFile << rTime << "\t" << r_phases[i].mName << "\t" << r_phases[i].mIntervalSeconds
+                               << "\t" << r_phases[i].mIntervalCalls << "\t" << r_phases[i].mIntervalCount;
+                WriteHardwareCounts(r_phases[i].mIntervalHardwareCounts);
+            }
+            CapsuleProfiler::ResetInterval();
+        }
+
+        for (unsigned i=0; i<mEvents.size(); i++)
+        {
+            double elapsed = CellBasedEventHandler::GetElapsedTime(mEvents[i]);
+            *mpProfileFile << rTime << "\t" << mEventNames[i] << "\t" << 1e-3*(elapsed - mPreviousEventTimes[i]) << "\t0\t0";
+            WriteHardwareCounts(nullptr);
+            mPreviousEventTimes[i] = elapsed;
+        }
+    }
+
+    /**
+     * Write the hardware counter columns and end the row.
+     *
+     * @param counts the counter values, or nullptr for zeros
+     */
+    void WriteHardwareCounts(const uint64_t* counts)
+    {
+        for (unsigned i=0; i<CapsulePerfCounters::NUM_COUNTERS; i++)
+        {
+            *mpProfileFile << "\t" << ((counts == nullptr) ? 0u : counts[i]);
+        }
+        *mpProfileFile << "\n";
+    }
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    CapsuleProfileOutputModifier()
+        : AbstractCellBasedSimulationModifier<DIM,DIM>(),
+          mSamplingTimestepMultiple(1u),
+          mUseHardwareCounters(false)
+    {
+        mEvents.push_back(CellBasedEventHandler::UPDATECELLPOPULATION);
+        mEventNames.push_back("UpdateCellPopulation");
+        mEvents.push_back(CellBasedEventHandler::BIRTH);
+        mEventNames.push_back("Birth");
+        mEvents.push_back(CellBasedEventHandler::DEATH);
+        mEventNames.push_back("Death");
+        mEvents.push_back(CellBasedEventHandler::OUTPUT);
+        mEventNames.push_back("Output");
+    }
+
+    /**
+     * @return mSamplingTimestepMultiple
+     */
+    unsigned GetSamplingTimestepMultiple() const
+    {
+        return mSamplingTimestepMultiple;
+    }
+
+    /**
+     * Set mSamplingTimestepMultiple.
+     *
+     * @param samplingTimestepMultiple the number of time steps per interval
+     */
+    void SetSamplingTimestepMultiple(unsigned samplingTimestepMultiple)
+    {
+        if (samplingTimestepMultiple == 0)
+        {
+            EXCEPTION("The sampling timestep multiple must be positive");
+        }
+        mSamplingTimestepMultiple = samplingTimestepMultiple;
+    }
+
+    /**
+     * @return mUseHardwareCounters
+     */
+    bool GetUseHardwareCounters() const
+    {
+        return mUseHardwareCounters;
+    }
+
+    /**
+     * Set mUseHardwareCounters.
+     *
+     * @param useHardwareCounters whether to read hardware performance counters
+     */
+    void SetUseHardwareCounters(bool useHardwareCounters)
+    {
+        mUseHardwareCounters = useHardwareCounters;
+    }
+
+    /**
+     * Overridden SetupSolve() method. Opens the output file, resets the profiler
+     * and opens the hardware counters if requested.
+     *
+     * @param rCellPopulation reference to the cell population
+     * @param outputDirectory the output directory, relative to where Chaste output is stored
+     */
+    virtual void SetupSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation, std::string outputDirectory)
+    {
+        OutputFileHandler output_file_handler(outputDirectory, false);
+        mpProfileFile = output_file_handler.OpenOutputFile("capsuleprofile.dat");
+        *mpProfileFile << "time\tphase\tseconds\tcalls\tcount";
+        for (unsigned i=0; i<CapsulePerfCounters::NUM_COUNTERS; i++)
+        {
+            *mpProfileFile << "\t" << CapsulePerfCounters::GetCounterName(i);
+        }
+        *mpProfileFile << "\n";
+
+        if (mUseHardwareCounters && CapsuleProfiler::IsEnabled() && !CapsuleProfiler::EnableHardwareCounters())
+        {
+            WARNING("Hardware performance counters are unavailable; their columns in capsuleprofile.dat will be zero");
+        }
+
+        CapsuleProfiler::Reset();
+        mPreviousEventTimes.resize(mEvents.size());
+        mStartEventTimes.resize(mEvents.size());
+        for (unsigned i=0; i<mEvents.size(); i++)
+        {
+            mPreviousEventTimes[i] = CellBasedEventHandler::GetElapsedTime(mEvents[i]);
+            mStartEventTimes[i] = mPreviousEventTimes[i];
+        }
+    }
+
+    /**
+     * Overridden UpdateAtEndOfTimeStep() method. Writes the interval at each sampling step.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfTimeStep(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        SimulationTime* p_time = SimulationTime::Instance();
+        if (p_time->GetTimeStepsElapsed() % mSamplingTimestepMultiple == 0)
+        {
+            std::stringstream time;
+            time << p_time->GetTime();
+            WriteInterval(time.str());
+        }
+    }
+
+    /**
+     * Overridden UpdateAtEndOfSolve() method. Writes the run totals and closes the file.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        unsigned long num_failed_hardware_reads = 0;
+        if (CapsuleProfiler::IsEnabled())
+        {
+            const std::vector<CapsuleProfiler::Phase>& r_phases = CapsuleProfiler::rGetPhases();
+            for (unsigned i=0; i<r_phases.size(); i++)
+            {
+                *mpProfileFile << "total\t" << r_phases[i].mName << "\t" << r_phases[i].mTotalSeconds
+                               << "\t" << r_phases[i].mTotalCalls << "\t" << r_phases[i].mTotalCount;
+                WriteHardwareCounts(r_phases[i].mTotalHardwareCounts);
+                num_failed_hardware_reads += r_phases[i].mTotalFailedHardwareReads;
+            }
+        }
+        for (unsigned i=0; i<mEvents.size(); i++)
+        {
+            double elapsed = CellBasedEventHandler::GetElapsedTime(mEvents[i]);
+            *mpProfileFile << "total\t" << mEventNames[i] << "\t" << 1e-3*(elapsed - mStartEventTimes[i]) << "\t0\t0";
+            WriteHardwareCounts(nullptr);
+        }
+        mpProfileFile->close();
+
+        if (mUseHardwareCounters)
+        {
+            CapsuleProfiler::DisableHardwareCounters();
+        }
+        if (num_failed_hardware_reads > 0)
+        {
+            WARNING("Hardware performance counters could not be read for " << num_failed_hardware_reads
+                    << " timed calls; their counts are left out of capsuleprofile.dat");
+        }
+    }
+
+    /**
+     * Overridden OutputSimulationModifierParameters() method.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputSimulationModifierParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<SamplingTimestepMultiple>" << mSamplingTimestepMultiple << "</SamplingTimestepMultiple>\n";
+        *rParamsFile << "\t\t\t<CapsuleProfiling>" << CapsuleProfiler::IsEnabled() << "</CapsuleProfiling>\n";
+        *rParamsFile << "\t\t\t<UseHardwareCounters>" << mUseHardwareCounters << "</UseHardwareCounters>\n";
+
+        // Next, call method on direct parent class
+        AbstractCellBasedSimulationModifier<DIM,DIM>::OutputSimulationModifierParameters(rParamsFile);
+    }
+};
+
+#endif /*CAPSULEPROFILEOUTPUTMODIFIER_HPP_*/
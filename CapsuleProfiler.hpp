@@ -0,0 +1,369 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEPROFILER_HPP_
+#define CAPSULEPROFILER_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "CapsulePerfCounters.hpp"
+#include "CapsuleTraceRecorder.hpp"
+
+/**
+ * Low-overhead per-phase timers and counters for capsule simulations.
+ *
+ * Phases are registered by name and identified by a small index. Each phase
+ * accumulates wall time, a number of calls and a free counter, both for the
+ * current sampling interval and for the whole run. The scoped timer
+ * CapsuleProfilerScope and the CAPSULE_PROFILE_SCOPE and CAPSULE_PROFILE_COUNT
+ * macros add to them; CapsuleProfileOutputModifier writes and resets the
+ * interval values. While CapsuleTraceRecorder is enabled, each timed scope is
+ * also recorded as a trace event. After EnableHardwareCounters(), each timed
+ * scope also adds the change in the CapsulePerfCounters hardware counters of
+ * the main thread to its phase; nested phases count inclusively.
+ *
+ * The macros and the Profiled* wrapper classes only record anything when
+ * CAPSULE_PROFILING is defined at compile time, and cost nothing otherwise.
+ * The profiler is not thread safe, matching the serial simulation loop.
+ */
+class CapsuleProfiler
+{
+public:
+
+    /** Accumulated values for one phase. */
+    struct Phase
+    {
+        /** The phase name. */
+        std::string mName;
+
+        /** Wall time in seconds in the current interval. */
+        double mIntervalSeconds;
+
+        /** Number of timed calls in the current interval. */
+        unsigned long mIntervalCalls;
+
+        /** Counter value in the current interval. */
+        unsigned long mIntervalCount;
+
+        /** Wall time in seconds since the last Reset(). */
+        double mTotalSeconds;
+
+        /** Number of timed calls since the last Reset(). */
+        unsigned long mTotalCalls;
+
+        /** Counter value since the last Reset(). */
+        unsigned long mTotalCount;
+
+        /** Hardware counter values in the current interval. */
+        uint64_t mIntervalHardwareCounts[CapsulePerfCounters::NUM_COUNTERS];
+
+        /** Hardware counter values since the last Reset(). */
+        uint64_t mTotalHardwareCounts[CapsulePerfCounters::NUM_COUNTERS];
+
+        /** Number of timed calls since the last Reset() whose hardware counters could not be read. */
+        unsigned long mTotalFailedHardwareReads;
+
+        /** Index of the phase name in CapsuleTraceRecorder. */
+        unsigned mTraceName;
+    };
+
+private:
+
+    /** @return the registered phases */
+    static std::vector<Phase>& rPhases()
+    {
+        static std::vector<Phase> phases;
+        return phases;
+    }
+
+    /** @return the hardware counters, which are only opened by EnableHardwareCounters() */
+    static CapsulePerfCounters& rCounters()
+    {
+        static CapsulePerfCounters counters;
+        return counters;
+    }
+
+public:
+
+    /**
+     * Register a phase, or look up an existing one.
+     *
+     * @param rName the phase name
+     * @return the index of the phase
+     */
+    static unsigned RegisterPhase(const std::string& rName)
+    {
+        std::vector<Phase>& r_phases = rPhases();
+        for (unsigned i=0; i<r_phases.size(); i++)
+        {
+            if (r_phases[i].mName == rName)
+            {
+                return i;
+            }
+        }
+        Phase phase = Phase();
+        phase.mName = rName;
+        phase.mTraceName = CapsuleTraceRecorder::RegisterName(rName);
+        r_phases.push_back(phase);
+        return r_phases.size() - 1;
+    }
+
+    /**
+     * Add a timed call to a phase.
+     *
+     * @param phase the phase index
+     * @param seconds the wall time of the call
+     */
+    static void AddTime(unsigned phase, double seconds)
+    {
+        Phase& r_phase = rPhases()[phase];
+        r_phase.mIntervalSeconds += seconds;
+        r_phase.mIntervalCalls++;
+        r_phase.mTotalSeconds += seconds;
+        r_phase.mTotalCalls++;
+    }
+
+    /**
+     * Add to the counter of a phase.
+     *
+     * @param phase the phase index
+     * @param count the amount to add
+     */
+    static void AddCount(unsigned phase, unsigned long count)
+    {
+        Phase& r_phase = rPhases()[phase];
+        r_phase.mIntervalCount += count;
+        r_phase.mTotalCount += count;
+    }
+
+    /**
+     * Add hardware counter values to a phase.
+     *
+     * @param phase the phase index
+     * @param counts the change in each counter
+     */
+    static void AddHardwareCounts(unsigned phase, const uint64_t counts[CapsulePerfCounters::NUM_COUNTERS])
+    {
+        Phase& r_phase = rPhases()[phase];
+        for (unsigned i=0; i<CapsulePerfCounters::NUM_COUNTERS; i++)
+        {
+            r_phase.mIntervalHardwareCounts[i] += counts[i];
+            r_phase.mTotalHardwareCounts[i] += counts[i];
+        }
+    }
+
+    /**
+     * Record that the hardware counters could not be read for a timed call of
+     * a phase, so that its counts were left out.
+     *
+     * @param phase the phase index
+     */
+    static void AddFailedHardwareRead(unsigned phase)
+    {
+        rPhases()[phase].mTotalFailedHardwareReads++;
+    }
+
+    /**
+     * Open the hardware counters for the calling thread, which should be the
+     * thread that runs the simulation.
+     *
+     * @return whether the counters are available
+     */
+    static bool EnableHardwareCounters()
+    {
+        return rCounters().Open();
+    }
+
+    /**
+     * Close the hardware counters.
+     */
+    static void DisableHardwareCounters()
+    {
+        rCounters().Close();
+    }
+
+    /**
+     * @return the hardware counters; IsOpen() tells whether they are in use
+     */
+    static const CapsulePerfCounters& rGetHardwareCounters()
+    {
+        return rCounters();
+    }
+
+    /**
+     * @return the registered phases
+     */
+    static const std::vector<Phase>& rGetPhases()
+    {
+        return rPhases();
+    }
+
+    /**
+     * Zero the interval values of all phases.
+     */
+    static void ResetInterval()
+    {
+        std::vector<Phase>& r_phases = rPhases();
+        for (unsigned i=0; i<r_phases.size(); i++)
+        {
+            r_phases[i].mIntervalSeconds = 0.0;
+            r_phases[i].mIntervalCalls = 0u;
+            r_phases[i].mIntervalCount = 0u;
+            for (unsigned j=0; j<CapsulePerfCounters::NUM_COUNTERS; j++)
+            {
+                r_phases[i].mIntervalHardwareCounts[j] = 0u;
+            }
+        }
+    }
+
+    /**
+     * Zero all values of all phases. The phases stay registered.
+     */
+    static void Reset()
+    {
+        ResetInterval();
+        std::vector<Phase>& r_phases = rPhases();
+        for (unsigned i=0; i<r_phases.size(); i++)
+        {
+            r_phases[i].mTotalSeconds = 0.0;
+            r_phases[i].mTotalCalls = 0u;
+            r_phases[i].mTotalCount = 0u;
+            r_phases[i].mTotalFailedHardwareReads = 0u;
+            for (unsigned j=0; j<CapsulePerfCounters::NUM_COUNTERS; j++)
+            {
+                r_phases[i].mTotalHardwareCounts[j] = 0u;
+            }
+        }
+    }
+
+    /**
+     * @return whether the profiler was compiled in
+     */
+    static bool IsEnabled()
+    {
+#ifdef CAPSULE_PROFILING
+        return true;
+#else
+        return false;
+#endif
+    }
+};
+
+/**
+ * Times the enclosing scope and adds it to a CapsuleProfiler phase.
+ */
+class CapsuleProfilerScope
+{
+private:
+
+    /** The phase index. */
+    unsigned mPhase;
+
+    /** Time at which the scope was entered. */
+    std::chrono::steady_clock::time_point mStart;
+
+    /** Whether hardware counters were read on entry. */
+    bool mReadHardwareCounters;
+
+    /** Whether the read on entry succeeded. */
+    bool mStartHardwareReadSucceeded;
+
+    /** Hardware counter values on entry. */
+    uint64_t mStartHardwareCounts[CapsulePerfCounters::NUM_COUNTERS];
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param phase the phase index
+     */
+    explicit CapsuleProfilerScope(unsigned phase)
+        : mPhase(phase),
+          mReadHardwareCounters(CapsuleProfiler::rGetHardwareCounters().IsOpen()),
+          mStartHardwareReadSucceeded(false)
+    {
+        if (mReadHardwareCounters)
+        {
+            mStartHardwareReadSucceeded = CapsuleProfiler::rGetHardwareCounters().Read(mStartHardwareCounts);
+        }
+        mStart = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * Destructor. Adds the elapsed time and hardware counts to the phase, and
+     * records a trace event if tracing is enabled.
+     */
+    ~CapsuleProfilerScope()
+    {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        if (mReadHardwareCounters)
+        {
+            uint64_t counts[CapsulePerfCounters::NUM_COUNTERS];
+            if (CapsuleProfiler::rGetHardwareCounters().Read(counts) && mStartHardwareReadSucceeded)
+            {
+                // Scaled estimates of a multiplexed counter can go down slightly
+                for (unsigned i=0; i<CapsulePerfCounters::NUM_COUNTERS; i++)
+                {
+                    counts[i] = (counts[i] > mStartHardwareCounts[i]) ? counts[i] - mStartHardwareCounts[i] : 0u;
+                }
+                CapsuleProfiler::AddHardwareCounts(mPhase, counts);
+            }
+            else
+            {
+                CapsuleProfiler::AddFailedHardwareRead(mPhase);
+            }
+        }
+        CapsuleProfiler::AddTime(mPhase, std::chrono::duration<double>(end - mStart).count());
+        if (CapsuleTraceRecorder::IsEnabled())
+        {
+            CapsuleTraceRecorder::RecordComplete(CapsuleProfiler::rGetPhases()[mPhase].mTraceName, mStart, end);
+        }
+    }
+};
+
+#ifdef CAPSULE_PROFILING
+/** Time the enclosing scope under the phase with index PHASE. */
+#define CAPSULE_PROFILE_SCOPE(PHASE) CapsuleProfilerScope capsule_profiler_scope_(PHASE)
+/** Add COUNT to the counter of the phase with index PHASE. */
+#define CAPSULE_PROFILE_COUNT(PHASE, COUNT) CapsuleProfiler::AddCount(PHASE, COUNT)
+#else
+#define CAPSULE_PROFILE_SCOPE(PHASE)
+#define CAPSULE_PROFILE_COUNT(PHASE, COUNT)
+#endif
+
+#endif /*CAPSULEPROFILER_HPP_*/
@@ -0,0 +1,306 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULESTEADYSTATESIMULATION_HPP_
+#define CAPSULESTEADYSTATESIMULATION_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "SimulationTime.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * An OffLatticeSimulation of capsules that stops once the population has
+ * reached mechanical equilibrium, rather than always running to the end time.
+ *
+ * After each time step the largest force on any capsule centre, the largest
+ * torque (NA_APPLIED_THETA), and the largest change in any capsule centre or
+ * angle over the step are compared with their tolerances. When all three
+ * have stayed below their tolerances for the required number of consecutive
+ * steps, the simulation stops. The count restarts whenever the number of
+ * capsules changes, so a division or a kill must settle again.
+ *
+ * This is intended for runs whose only purpose is to find an equilibrium,
+ * such as a fixed set of capsules without proliferation.
+ */
+template<unsigned DIM>
+class CapsuleSteadyStateSimulation : public OffLatticeSimulation<DIM>
+{
+private:
+
+    /** Largest force on any capsule at steady state. Defaults to 1e-3. */
+    double mForceTolerance;
+
+    /** Largest torque on any capsule at steady state. Defaults to 1e-3. */
+    double mTorqueTolerance;
+
+    /** Largest change in any capsule centre or angle per step at steady state. Defaults to 1e-6. */
+    double mDisplacementTolerance;
+
+    /** Number of consecutive steps below all tolerances needed to stop. Defaults to 100. */
+    unsigned mNumQuiescentStepsRequired;
+
+    /** Number of consecutive steps so far below all tolerances. */
+    unsigned mNumQuiescentSteps;
+
+    /** Whether the simulation stopped at steady state. */
+    bool mSteadyStateReached;
+
+    /** Largest force at the last check. */
+    double mMaxForce;
+
+    /** Largest torque at the last check. */
+    double mMaxTorque;
+
+    /** Largest change in a capsule centre or angle at the last check. */
+    double mMaxDisplacement;
+
+    /** Capsule centres at the previous check, in node iteration order. */
+    std::vector<c_vector<double, DIM> > mPreviousLocations;
+
+    /** Capsule angles NA_THETA and NA_PHI at the previous check, in node iteration order. */
+    std::vector<double> mPreviousAngles;
+
+    /**
+     * Store the current capsule centres and angles.
+     */
+    void StoreState()
+    {
+        const unsigned num_nodes = this->mrCellPopulation.GetNumNodes();
+        mPreviousLocations.resize(num_nodes);
+        mPreviousAngles.resize(2*num_nodes);
+
+        unsigned node_count = 0;
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = this->mrCellPopulation.rGetMesh().GetNodeIteratorBegin();
+             node_iter != this->mrCellPopulation.rGetMesh().GetNodeIteratorEnd();
+             ++node_iter, ++node_count)
+        {
+            mPreviousLocations[node_count] = node_iter->rGetLocation();
+            mPreviousAngles[2*node_count] = node_iter->rGetNodeAttributes()[NA_THETA];
+            mPreviousAngles[2*node_count + 1] = node_iter->rGetNodeAttributes()[NA_PHI];
+        }
+    }
+
+protected:
+
+    /**
+     * Overridden StoppingEventHasOccurred() method.
+     *
+     * @return whether the population has been at steady state for the required number of steps
+     */
+    virtual bool StoppingEventHasOccurred()
+    {
+        // No forces have been computed before the first step
+        if (SimulationTime::Instance()->GetTimeStepsElapsed() == 0 || mPreviousLocations.size() != this->mrCellPopulation.GetNumNodes())
+        {
+            mNumQuiescentSteps = 0;
+            StoreState();
+            return false;
+        }
+
+        mMaxForce = 0.0;
+        mMaxTorque = 0.0;
+        mMaxDisplacement = 0.0;
+        unsigned node_count = 0;
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = this->mrCellPopulation.rGetMesh().GetNodeIteratorBegin();
+             node_iter != this->mrCellPopulation.rGetMesh().GetNodeIteratorEnd();
+             ++node_iter, ++node_count)
+        {
+            const std::vector<double>& r_attributes = node_iter->rGetNodeAttributes();
+            mMaxForce = std::max(mMaxForce, norm_2(node_iter->rGetAppliedForce()));
+            mMaxTorque = std::max(mMaxTorque, fabs(r_attributes[NA_APPLIED_THETA]));
+            mMaxDisplacement = std::max(mMaxDisplacement, norm_2(node_iter->rGetLocation() - mPreviousLocations[node_count]));
+            mMaxDisplacement = std::max(mMaxDisplacement, fabs(r_attributes[NA_THETA] - mPreviousAngles[2*node_count]));
+            mMaxDisplacement = std::max(mMaxDisplacement, fabs(r_attributes[NA_PHI] - mPreviousAngles[2*node_count + 1]));
+        }
+        StoreState();
+
+        if (mMaxForce <= mForceTolerance && mMaxTorque <= mTorqueTolerance && mMaxDisplacement <= mDisplacementTolerance)
+        {
+            mNumQuiescentSteps++;
+        }
+        else
+        {
+            mNumQuiescentSteps = 0;
+        }
+
+        mSteadyStateReached = (mNumQuiescentSteps >= mNumQuiescentStepsRequired);
+        return mSteadyStateReached;
+    }
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param rCellPopulation the cell population
+     * @param deleteCellPopulationInDestructor whether to delete the cell population on destruction
+     * @param initialiseCells whether to initialise cells
+     */
+    CapsuleSteadyStateSimulation(AbstractCellPopulation<DIM>& rCellPopulation,
+                                 bool deleteCellPopulationInDestructor=false,
+                                 bool initialiseCells=true)
+        : OffLatticeSimulation<DIM>(rCellPopulation, deleteCellPopulationInDestructor, initialiseCells),
+          mForceTolerance(1e-3),
+          mTorqueTolerance(1e-3),
+          mDisplacementTolerance(1e-6),
+          mNumQuiescentStepsRequired(100u),
+          mNumQuiescentSteps(0u),
+          mSteadyStateReached(false),
+          mMaxForce(0.0),
+          mMaxTorque(0.0),
+          mMaxDisplacement(0.0)
+    {
+    }
+
+    /**
+     * Set the tolerances.
+     *
+     * @param forceTolerance the largest force on any capsule at steady state
+     * @param torqueTolerance the largest torque on any capsule at steady state
+     * @param displacementTolerance the largest change in any capsule centre or angle per step at steady state
+     */
+    void SetTolerances(double forceTolerance, double torqueTolerance, double displacementTolerance)
+    {
+        if (forceTolerance < 0.0 || torqueTolerance < 0.0 || displacementTolerance < 0.0)
+        {
+            EXCEPTION("The steady state tolerances must be non-negative");
+        }
+        mForceTolerance = forceTolerance;
+        mTorqueTolerance = torqueTolerance;
+        mDisplacementTolerance = displacementTolerance;
+    }
+
+    /**
+     * @return mForceTolerance
+     */
+    double GetForceTolerance() const
+    {
+        return mForceTolerance;
+    }
+
+    /**
+     * @return mTorqueTolerance
+     */
+    double GetTorqueTolerance() const
+    {
+        return mTorqueTolerance;
+    }
+
+    /**
+     * @return mDisplacementTolerance
+     */
+    double GetDisplacementTolerance() const
+    {
+        return mDisplacementTolerance;
+    }
+
+    /**
+     * @return mNumQuiescentStepsRequired
+     */
+    unsigned GetNumQuiescentStepsRequired() const
+    {
+        return mNumQuiescentStepsRequired;
+    }
+
+    /**
+     * Set mNumQuiescentStepsRequired.
+     *
+     * @param numQuiescentStepsRequired the number of consecutive steps below all tolerances needed to stop
+     */
+    void SetNumQuiescentStepsRequired(unsigned numQuiescentStepsRequired)
+    {
+        if (numQuiescentStepsRequired == 0)
+        {
+            EXCEPTION("The number of quiescent steps required must be positive");
+        }
+        mNumQuiescentStepsRequired = numQuiescentStepsRequired;
+    }
+
+    /**
+     * @return whether the simulation stopped at steady state
+     */
+    bool HasReachedSteadyState() const
+    {
+        return mSteadyStateReached;
+    }
+
+    /**
+     * @return the largest force on any capsule at the last check
+     */
+    double GetMaxForce() const
+    {
+        return mMaxForce;
+    }
+
+    /**
+     * @return the largest torque on any capsule at the last check
+     */
+    double GetMaxTorque() const
+    {
+        return mMaxTorque;
+    }
+
+    /**
+     * @return the largest change in any capsule centre or angle over the last step
+     */
+    double GetMaxDisplacement() const
+    {
+        return mMaxDisplacement;
+    }
+
+    /**
+     * Overridden OutputSimulationParameters() method.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputSimulationParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t<ForceTolerance>" << mForceTolerance << "</ForceTolerance>\n";
+        *rParamsFile << "\t\t<TorqueTolerance>" << mTorqueTolerance << "</TorqueTolerance>\n";
+        *rParamsFile << "\t\t<DisplacementTolerance>" << mDisplacementTolerance << "</DisplacementTolerance>\n";
+        *rParamsFile << "\t\t<NumQuiescentStepsRequired>" << mNumQuiescentStepsRequired << "</NumQuiescentStepsRequired>\n";
+
+        // Call method on direct parent class
+        OffLatticeSimulation<DIM>::OutputSimulationParameters(rParamsFile);
+    }
+};
+
+#endif /*CAPSULESTEADYSTATESIMULATION_HPP_*/
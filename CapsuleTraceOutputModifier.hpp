@@ -0,0 +1,273 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULETRACEOUTPUTMODIFIER_HPP_
+#define CAPSULETRACEOUTPUTMODIFIER_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include "AbstractCellBasedSimulationModifier.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "CellId.hpp"
+#include "Exception.hpp"
+#include "OutputFileHandler.hpp"
+#include "SimulationTime.hpp"
+#include "CapsuleTraceRecorder.hpp"
+
+/**
+ * A modifier that writes a Chrome trace-event JSON file, trace.json, to the
+ * simulation output directory. The file can be opened in chrome://tracing
+ * or Perfetto.
+ *
+ * While the simulation runs, CapsuleTraceRecorder is enabled. The trace
+ * holds:
+ * - one "TimeStep" event per time step
+ * - a "NumCells" counter
+ * - "DivisionBurst" and "KillWave" instant events carrying the number of
+ *   births and deaths in a step
+ * - when CAPSULE_PROFILING is defined, one event for every CapsuleProfiler
+ *   phase and CAPSULE_TRACE_SCOPE, such as the Profiled* wrappers and the
+ *   writes and flushes of AsynchronousCapsuleOutputModifier, each on the
+ *   track of the thread that recorded it
+ *
+ * The per-thread buffers are drained to the file every
+ * mDrainTimestepMultiple steps, so long runs need only bounded memory. Events
+ * lost to buffer wrap-around are counted.
+ *
+ * Only one instance should be used at a time, as the recorder is global.
+ * This modifier is not archived.
+ */
+template<unsigned DIM>
+class CapsuleTraceOutputModifier : public AbstractCellBasedSimulationModifier<DIM,DIM>
+{
+private:
+
+    /** Number of time steps between drains of the trace buffers. Defaults to 100. */
+    unsigned mDrainTimestepMultiple;
+
+    /** The output file. */
+    out_stream mpTraceFile;
+
+    /** Whether no event has been written to the file yet. */
+    bool mFirstEvent;
+
+    /** Number of events lost to buffer wrap-around. */
+    unsigned long mNumLostEvents;
+
+    /** Time at which the previous time step ended. */
+    std::chrono::steady_clock::time_point mPreviousStepEnd;
+
+    /** Number of cells at the end of the previous time step. */
+    unsigned mPreviousNumCells;
+
+    /** Number of cell IDs issued by CellId at the end of the previous time step. */
+    unsigned mPreviousNumCellIds;
+
+    /** Index of the "TimeStep" event name. */
+    unsigned mStepName;
+
+    /** Index of the "DivisionBurst" event name. */
+    unsigned mDivisionName;
+
+    /** Index of the "KillWave" event name. */
+    unsigned mKillName;
+
+    /** Index of the "NumCells" counter name. */
+    unsigned mNumCellsName;
+
+    /**
+     * Count the cells born since the previous call and update
+     * mPreviousNumCellIds. Every new cell takes the next ID from CellId, so
+     * the cells need not be visited.
+     *
+     * @return the number of new cells
+     */
+    unsigned CountNewCells()
+    {
+        unsigned num_cell_ids = CellId::Instance()->GetMaxCellId();
+        unsigned num_new_cells = num_cell_ids - mPreviousNumCellIds;
+        mPreviousNumCellIds = num_cell_ids;
+        return num_new_cells;
+    }
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    CapsuleTraceOutputModifier()
+        : AbstractCellBasedSimulationModifier<DIM,DIM>(),
+          mDrainTimestepMultiple(100u),
+          mFirstEvent(true),
+          mNumLostEvents(0u),
+          mPreviousNumCells(0u),
+          mPreviousNumCellIds(0u),
+          mStepName(CapsuleTraceRecorder::RegisterName("TimeStep")),
+          mDivisionName(CapsuleTraceRecorder::RegisterName("DivisionBurst")),
+          mKillName(CapsuleTraceRecorder::RegisterName("KillWave")),
+          mNumCellsName(CapsuleTraceRecorder::RegisterName("NumCells"))
+    {
+    }
+
+    /**
+     * @return mDrainTimestepMultiple
+     */
+    unsigned GetDrainTimestepMultiple() const
+    {
+        return mDrainTimestepMultiple;
+    }
+
+    /**
+     * Set mDrainTimestepMultiple.
+     *
+     * @param drainTimestepMultiple the number of time steps between drains
+     */
+    void SetDrainTimestepMultiple(unsigned drainTimestepMultiple)
+    {
+        if (drainTimestepMultiple == 0)
+        {
+            EXCEPTION("The drain timestep multiple must be positive");
+        }
+        mDrainTimestepMultiple = drainTimestepMultiple;
+    }
+
+    /**
+     * @return the number of events lost to buffer wrap-around
+     */
+    unsigned long GetNumLostEvents() const
+    {
+        return mNumLostEvents;
+    }
+
+    /**
+     * Overridden SetupSolve() method. Opens the trace file and starts recording.
+     *
+     * @param rCellPopulation reference to the cell population
+     * @param outputDirectory the output directory, relative to where Chaste output is stored
+     */
+    virtual void SetupSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation, std::string outputDirectory)
+    {
+        OutputFileHandler output_file_handler(outputDirectory, false);
+        mpTraceFile = output_file_handler.OpenOutputFile("trace.json");
+        *mpTraceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        mFirstEvent = true;
+        mNumLostEvents = 0;
+
+        // Discard anything recorded before this solve
+        std::stringstream discarded;
+        bool first = true;
+        CapsuleTraceRecorder::Drain(discarded, first);
+
+        CapsuleTraceRecorder::SetThreadName("Simulation");
+
+        CountNewCells();
+        mPreviousNumCells = rCellPopulation.GetNumRealCells();
+
+        CapsuleTraceRecorder::SetEnabled(true);
+        CapsuleTraceRecorder::RecordCounter(mNumCellsName, mPreviousNumCells);
+        mPreviousStepEnd = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * Overridden UpdateAtEndOfTimeStep() method. Records the step and drains
+     * the buffers every mDrainTimestepMultiple steps.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfTimeStep(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        CapsuleTraceRecorder::RecordComplete(mStepName, mPreviousStepEnd, now);
+
+        unsigned num_births = CountNewCells();
+        unsigned num_cells = rCellPopulation.GetNumRealCells();
+
+        // Cells added other than by division would make this negative
+        int num_deaths = std::max(static_cast<int>(mPreviousNumCells + num_births) - static_cast<int>(num_cells), 0);
+        if (num_births > 0)
+        {
+            CapsuleTraceRecorder::RecordInstant(mDivisionName, num_births);
+        }
+        if (num_deaths > 0)
+        {
+            CapsuleTraceRecorder::RecordInstant(mKillName, num_deaths);
+        }
+        if (num_cells != mPreviousNumCells)
+        {
+            CapsuleTraceRecorder::RecordCounter(mNumCellsName, num_cells);
+        }
+        mPreviousNumCells = num_cells;
+
+        if (SimulationTime::Instance()->GetTimeStepsElapsed() % mDrainTimestepMultiple == 0)
+        {
+            mNumLostEvents += CapsuleTraceRecorder::Drain(*mpTraceFile, mFirstEvent);
+        }
+
+        // Time spent draining is attributed to the next step
+        mPreviousStepEnd = now;
+    }
+
+    /**
+     * Overridden UpdateAtEndOfSolve() method. Stops recording and completes the file.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfSolve(AbstractCellPopulation<DIM,DIM>& rCellPopulation)
+    {
+        CapsuleTraceRecorder::SetEnabled(false);
+        mNumLostEvents += CapsuleTraceRecorder::Drain(*mpTraceFile, mFirstEvent);
+        CapsuleTraceRecorder::WriteThreadNames(*mpTraceFile, mFirstEvent);
+        *mpTraceFile << "\n]}\n";
+        mpTraceFile->close();
+    }
+
+    /**
+     * Overridden OutputSimulationModifierParameters() method.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputSimulationModifierParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<DrainTimestepMultiple>" << mDrainTimestepMultiple << "</DrainTimestepMultiple>\n";
+
+        // Next, call method on direct parent class
+        AbstractCellBasedSimulationModifier<DIM,DIM>::OutputSimulationModifierParameters(rParamsFile);
+    }
+};
+
+#endif /*CAPSULETRACEOUTPUTMODIFIER_HPP_*/
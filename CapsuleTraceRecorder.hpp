@@ -0,0 +1,525 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULETRACERECORDER_HPP_
+#define CAPSULETRACERECORDER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Records timed events into per-thread ring buffers for export in the
+ * Chrome trace-event JSON format, which can be viewed in chrome://tracing or
+ * Perfetto.
+ *
+ * Each thread that records an event gets its own buffer, registered once
+ * under a mutex. After that, recording is lock free: the owning thread
+ * writes a slot and then publishes it with a release store of the write
+ * count. Drain() is called from a single consumer thread. It copies out the
+ * events published since the previous drain and writes them as JSON. Slot
+ * reuse is checked as in a sequence lock: a fence in the producer orders the
+ * previous publish before the slot is overwritten, and a fence in the
+ * consumer orders the copy before the write count is loaded again. Events
+ * that a producer has overwritten, or may be overwriting, are counted as lost
+ * rather than written. The buffer of a thread that has exited is released
+ * once it has been drained.
+ *
+ * Complete events ("X") carry a duration. Instant events ("i") and counter
+ * events ("C") carry a value. Recording only happens while SetEnabled(true)
+ * is in force. Timestamps are in microseconds from the first use of the
+ * recorder. Each buffer is a separate track, numbered in order of first use
+ * and optionally named with SetThreadName().
+ */
+class CapsuleTraceRecorder
+{
+public:
+
+    /** A recorded event. */
+    struct Event
+    {
+        /** Index of the event name. */
+        unsigned mName;
+
+        /** Trace-event phase: 'X', 'i' or 'C'. */
+        char mType;
+
+        /** Start time in microseconds. */
+        double mTimestamp;
+
+        /** Duration in microseconds, for complete events. */
+        double mDuration;
+
+        /** Value, for instant and counter events. */
+        long mValue;
+    };
+
+private:
+
+    /** A single-producer, single-consumer ring buffer owned by one thread. */
+    struct ThreadBuffer
+    {
+        /** The events; the size is a power of two. */
+        std::vector<Event> mEvents;
+
+        /** Number of events ever written. */
+        std::atomic<unsigned long> mWriteCount;
+
+        /** Number of events already drained. */
+        unsigned long mReadCount;
+
+        /** Track number in the trace. */
+        unsigned mThreadId;
+
+        /** Track name in the trace, empty if not set. */
+        std::string mThreadName;
+
+        /** Whether the owning thread has exited. */
+        std::atomic<bool> mThreadExited;
+    };
+
+    /** Marks the buffer of a thread as released when the thread exits. */
+    struct ThreadBufferHandle
+    {
+        /** The buffer of the thread, or null if it has not recorded anything. */
+        ThreadBuffer* mpBuffer = nullptr;
+
+        /** Destructor, run when the thread exits. */
+        ~ThreadBufferHandle()
+        {
+            if (mpBuffer != nullptr)
+            {
+                mpBuffer->mThreadExited.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    /** Shared state, accessed under the mutex except for mEnabled. */
+    struct State
+    {
+        /** Guards registration of buffers and names. */
+        std::mutex mMutex;
+
+        /** Buffers of live threads, and of exited threads that still hold events. */
+        std::vector<std::unique_ptr<ThreadBuffer> > mBuffers;
+
+        /** Track numbers and names of released buffers, until written by WriteThreadNames(). */
+        std::vector<std::pair<unsigned, std::string> > mReleasedThreadNames;
+
+        /** Track number of the next buffer. */
+        unsigned mNextThreadId = 0u;
+
+        /** Event names, in a deque so that references stay valid. */
+        std::deque<std::string> mNames;
+
+        /** Capacity of buffers created from now on. */
+        unsigned mBufferCapacity = 1u << 16;
+
+        /** Whether events are being recorded. */
+        std::atomic<bool> mEnabled{false};
+
+        /** Time origin of the trace. */
+        std::chrono::steady_clock::time_point mEpoch = std::chrono::steady_clock::now();
+    };
+
+    /** @return the shared state */
+    static State& rState()
+    {
+        static State state;
+        return state;
+    }
+
+    /** @return the buffer of the calling thread, created on first use */
+    static ThreadBuffer& rGetThreadBuffer()
+    {
+        static thread_local ThreadBufferHandle handle;
+        if (handle.mpBuffer == nullptr)
+        {
+            State& r_state = rState();
+            std::lock_guard<std::mutex> lock(r_state.mMutex);
+            std::unique_ptr<ThreadBuffer> p_new_buffer(new ThreadBuffer());
+            p_new_buffer->mEvents.resize(r_state.mBufferCapacity);
+            p_new_buffer->mWriteCount.store(0u);
+            p_new_buffer->mReadCount = 0u;
+            p_new_buffer->mThreadId = r_state.mNextThreadId++;
+            p_new_buffer->mThreadExited.store(false);
+            handle.mpBuffer = p_new_buffer.get();
+            r_state.mBuffers.push_back(std::move(p_new_buffer));
+        }
+        return *(handle.mpBuffer);
+    }
+
+    /**
+     * Append an event to the buffer of the calling thread.
+     *
+     * @param rEvent the event
+     */
+    static void Push(const Event& rEvent)
+    {
+        ThreadBuffer& r_buffer = rGetThreadBuffer();
+        unsigned long index = r_buffer.mWriteCount.load(std::memory_order_relaxed);
+
+        // The store that published the previous event must be visible before the slot is reused
+        std::atomic_thread_fence(std::memory_order_release);
+        r_buffer.mEvents[index & (r_buffer.mEvents.size() - 1)] = rEvent;
+        r_buffer.mWriteCount.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     * Write a string as a JSON string literal.
+     *
+     * @param rStream the stream
+     * @param rString the string
+     */
+    static void WriteJsonString(std::ostream& rStream, const std::string& rString)
+    {
+        rStream << '"';
+        for (unsigned i=0; i<rString.size(); i++)
+        {
+            if (rString[i] == '"' || rString[i] == '\\')
+            {
+                rStream << '\\';
+            }
+            rStream << rString[i];
+        }
+        rStream << '"';
+    }
+
+public:
+
+    /**
+     * Register an event name, or look up an existing one.
+     *
+     * @param rName the name
+     * @return the index of the name
+     */
+    static unsigned RegisterName(const std::string& rName)
+    {
+        State& r_state = rState();
+        std::lock_guard<std::mutex> lock(r_state.mMutex);
+        for (unsigned i=0; i<r_state.mNames.size(); i++)
+        {
+            if (r_state.mNames[i] == rName)
+            {
+                return i;
+            }
+        }
+        r_state.mNames.push_back(rName);
+        return r_state.mNames.size() - 1;
+    }
+
+    /**
+     * Set the capacity of buffers created after this call. The capacity is
+     * rounded up to a power of two.
+     *
+     * @param capacity the number of events per thread buffer
+     */
+    static void SetBufferCapacity(unsigned capacity)
+    {
+        unsigned rounded = 1u;
+        while (rounded < capacity)
+        {
+            rounded *= 2;
+        }
+        State& r_state = rState();
+        std::lock_guard<std::mutex> lock(r_state.mMutex);
+        r_state.mBufferCapacity = rounded;
+    }
+
+    /**
+     * Name the track of the calling thread.
+     *
+     * @param rName the name
+     */
+    static void SetThreadName(const std::string& rName)
+    {
+        ThreadBuffer& r_buffer = rGetThreadBuffer();
+        std::lock_guard<std::mutex> lock(rState().mMutex);
+        r_buffer.mThreadName = rName;
+    }
+
+    /**
+     * Start or stop recording.
+     *
+     * @param enabled whether to record events
+     */
+    static void SetEnabled(bool enabled)
+    {
+        rState().mEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    /**
+     * @return whether events are being recorded
+     */
+    static bool IsEnabled()
+    {
+        return rState().mEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @param time a time point
+     * @return the time in microseconds since the trace origin
+     */
+    static double GetTimestamp(std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration<double, std::micro>(time - rState().mEpoch).count();
+    }
+
+    /**
+     * Record a complete event on the calling thread's track.
+     *
+     * @param name the name index
+     * @param start the start of the event
+     * @param end the end of the event
+     */
+    static void RecordComplete(unsigned name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+        if (IsEnabled())
+        {
+            double timestamp = GetTimestamp(start);
+            Event event = {name, 'X', timestamp, GetTimestamp(end) - timestamp, 0};
+            Push(event);
+        }
+    }
+
+    /**
+     * Record an instant event on the calling thread's track.
+     *
+     * @param name the name index
+     * @param value a value shown with the event
+     */
+    static void RecordInstant(unsigned name, long value)
+    {
+        if (IsEnabled())
+        {
+            Event event = {name, 'i', GetTimestamp(std::chrono::steady_clock::now()), 0.0, value};
+            Push(event);
+        }
+    }
+
+    /**
+     * Record a counter value.
+     *
+     * @param name the name index
+     * @param value the counter value
+     */
+    static void RecordCounter(unsigned name, long value)
+    {
+        if (IsEnabled())
+        {
+            Event event = {name, 'C', GetTimestamp(std::chrono::steady_clock::now()), 0.0, value};
+            Push(event);
+        }
+    }
+
+    /**
+     * Write all events published since the previous drain as comma-separated
+     * JSON trace events. Must only be called from one thread at a time.
+     *
+     * @param rStream the stream to write to
+     * @param rFirstEvent whether no event has been written to the stream yet;
+     *     updated on return
+     * @return the number of events lost because a buffer wrapped around
+     */
+    static unsigned long Drain(std::ostream& rStream, bool& rFirstEvent)
+    {
+        State& r_state = rState();
+        std::lock_guard<std::mutex> lock(r_state.mMutex);
+
+        unsigned long num_lost = 0;
+        for (unsigned b=0; b<r_state.mBuffers.size(); b++)
+        {
+            ThreadBuffer& r_buffer = *(r_state.mBuffers[b]);
+            const unsigned long capacity = r_buffer.mEvents.size();
+            const bool thread_exited = r_buffer.mThreadExited.load(std::memory_order_acquire);
+            unsigned long write_count = r_buffer.mWriteCount.load(std::memory_order_acquire);
+
+            // Event i lives in the slot that event i + capacity overwrites, which may be in progress
+            if (write_count - r_buffer.mReadCount >= capacity)
+            {
+                num_lost += write_count - r_buffer.mReadCount - capacity + 1;
+                r_buffer.mReadCount = write_count - capacity + 1;
+            }
+
+            for (unsigned long i=r_buffer.mReadCount; i<write_count; i++)
+            {
+                Event event = r_buffer.mEvents[i & (capacity - 1)];
+
+                // The producer may have started overwriting the slot while it was copied
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (r_buffer.mWriteCount.load(std::memory_order_relaxed) - i >= capacity)
+                {
+                    num_lost++;
+                    continue;
+                }
+
+                rStream << (rFirstEvent ? "" : ",\n") << "{\"name\":";
+                WriteJsonString(rStream, r_state.mNames[event.mName]);
+                rStream << ",\"ph\":\"" << event.mType << "\",\"ts\":" << event.mTimestamp
+                        << ",\"pid\":0,\"tid\":" << r_buffer.mThreadId;
+                if (event.mType == 'X')
+                {
+                    rStream << ",\"dur\":" << event.mDuration;
+                }
+                else if (event.mType == 'i')
+                {
+                    rStream << ",\"s\":\"t\",\"args\":{\"count\":" << event.mValue << "}";
+                }
+                else
+                {
+                    rStream << ",\"args\":{\"value\":" << event.mValue << "}";
+                }
+                rStream << "}";
+                rFirstEvent = false;
+            }
+            r_buffer.mReadCount = write_count;
+
+            // An exited thread records nothing more, so its buffer can go once drained
+            if (thread_exited)
+            {
+                if (!r_buffer.mThreadName.empty())
+                {
+                    r_state.mReleasedThreadNames.push_back(std::make_pair(r_buffer.mThreadId, r_buffer.mThreadName));
+                }
+                r_state.mBuffers.erase(r_state.mBuffers.begin() + b);
+                b--;
+            }
+        }
+        return num_lost;
+    }
+
+    /**
+     * @return the number of thread buffers currently held
+     */
+    static unsigned GetNumThreadBuffers()
+    {
+        State& r_state = rState();
+        std::lock_guard<std::mutex> lock(r_state.mMutex);
+        return r_state.mBuffers.size();
+    }
+
+    /**
+     * Write a thread_name metadata event for each named track. The names of
+     * released buffers are only written once.
+     *
+     * @param rStream the stream to write to
+     * @param rFirstEvent whether no event has been written to the stream yet;
+     *     updated on return
+     */
+    static void WriteThreadNames(std::ostream& rStream, bool& rFirstEvent)
+    {
+        State& r_state = rState();
+        std::lock_guard<std::mutex> lock(r_state.mMutex);
+        std::vector<std::pair<unsigned, std::string> > names;
+        names.swap(r_state.mReleasedThreadNames);
+        for (unsigned b=0; b<r_state.mBuffers.size(); b++)
+        {
+            if (!r_state.mBuffers[b]->mThreadName.empty())
+            {
+                names.push_back(std::make_pair(r_state.mBuffers[b]->mThreadId, r_state.mBuffers[b]->mThreadName));
+            }
+        }
+        for (unsigned i=0; i<names.size(); i++)
+        {
+            rStream << (rFirstEvent ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+                    << names[i].first << ",\"args\":{\"name\":";
+            WriteJsonString(rStream, names[i].second);
+            rStream << "}}";
+            rFirstEvent = false;
+        }
+    }
+};
+
+/**
+ * Records the enclosing scope as a complete event if tracing was enabled on entry.
+ */
+class CapsuleTraceScope
+{
+private:
+
+    /** The name index. */
+    unsigned mName;
+
+    /** Whether tracing was enabled on entry. */
+    bool mEnabled;
+
+    /** Time at which the scope was entered. */
+    std::chrono::steady_clock::time_point mStart;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param name the name index
+     */
+    explicit CapsuleTraceScope(unsigned name)
+        : mName(name),
+          mEnabled(CapsuleTraceRecorder::IsEnabled())
+    {
+        if (mEnabled)
+        {
+            mStart = std::chrono::steady_clock::now();
+        }
+    }
+
+    /**
+     * Destructor. Records the event.
+     */
+    ~CapsuleTraceScope()
+    {
+        if (mEnabled)
+        {
+            CapsuleTraceRecorder::RecordComplete(mName, mStart, std::chrono::steady_clock::now());
+        }
+    }
+};
+
+#ifdef CAPSULE_PROFILING
+/** Record the enclosing scope as a trace event named NAME. */
+#define CAPSULE_TRACE_SCOPE(NAME) \
+    static const unsigned capsule_trace_name_ = CapsuleTraceRecorder::RegisterName(NAME); \
+    CapsuleTraceScope capsule_trace_scope_(capsule_trace_name_)
+#else
+#define CAPSULE_TRACE_SCOPE(NAME)
+#endif
+
+#endif /*CAPSULETRACERECORDER_HPP_*/
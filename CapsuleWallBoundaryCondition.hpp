@@ -0,0 +1,509 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef CAPSULEWALLBOUNDARYCONDITION_HPP_
+#define CAPSULEWALLBOUNDARYCONDITION_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "AbstractCellPopulationBoundaryCondition.hpp"
+#include "AbstractCellPopulation.hpp"
+#include "Exception.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * A boundary condition that keeps whole capsules, including their end caps,
+ * inside a set of walls. Unlike point-based boundary conditions it uses
+ * NA_THETA, NA_PHI, NA_LENGTH and NA_RADIUS.
+ *
+ * The walls are any combination of:
+ * - plane walls, each a half-space given by a point and an inward normal,
+ *   such as a flat agar surface in 3D (AddPlaneWall())
+ * - the walls of a box (AddBoxWalls())
+ * - the walls of a channel that is open along the x axis (AddChannelWalls())
+ * - a circular well, which in 3D is a cylinder along the z axis
+ *   (SetCircularWell())
+ *
+ * A capsule that pierces a wall is moved back along the wall normal, keeping
+ * its orientation, until it just touches the wall. Moving a capsule off one
+ * wall can push it through another, for example in a wedge or where a well
+ * cuts a box, so the corrections are repeated until the capsule is clear of
+ * every wall. An exception is thrown if this takes more than
+ * MAX_NUM_CORRECTION_SWEEPS sweeps, as when the walls are too close together
+ * for the capsule to fit.
+ *
+ * Most capsules are far from every wall, so each call first copies the capsule
+ * centres and bounding-sphere radii into contiguous arrays. Branch-free
+ * loops over those arrays then mark the capsules whose bounding sphere reaches
+ * a wall, and only these capsules get the exact capsule test.
+ *
+ * This class is not archived.
+ */
+template<unsigned DIM>
+class CapsuleWallBoundaryCondition : public AbstractCellPopulationBoundaryCondition<DIM,DIM>
+{
+private:
+
+    /** Inward unit normals of the plane walls. */
+    std::vector<c_vector<double, DIM> > mWallNormals;
+
+    /** Offsets of the plane walls; the allowed side of wall i is normal_i.x >= offset_i. */
+    std::vector<double> mWallOffsets;
+
+    /** Whether there is a circular well. */
+    bool mHasWell;
+
+    /** Centre of the circular well; only the x and y components are used. */
+    c_vector<double, DIM> mWellCentre;
+
+    /** Radius of the circular well. */
+    double mWellRadius;
+
+    /** Capsules whose position is within this distance of being allowed are accepted by VerifyBoundaryCondition(). */
+    double mTolerance;
+
+    /** Maximum number of sweeps over the walls when moving a capsule back inside. */
+    static const unsigned MAX_NUM_CORRECTION_SWEEPS = 100;
+
+    /** Number of capsules given the exact test in the last call to ImposeBoundaryCondition(). */
+    unsigned mNumCapsulesNearWalls;
+
+    /** Capsule centres by coordinate, for the early-out test. */
+    std::vector<double> mCentres[DIM];
+
+    /** Bounding-sphere radius of each capsule, for the early-out test. */
+    std::vector<double> mBoundingRadii;
+
+    /** Scratch space for the early-out test. */
+    std::vector<double> mDistances;
+
+    /** Whether each capsule's bounding sphere reaches a wall. */
+    std::vector<uint8_t> mNearWall;
+
+    /** The nodes in the order of the arrays above. */
+    std::vector<Node<DIM>*> mNodes;
+
+    /**
+     * @param rAttributes the node attributes of a capsule
+     * @return the unit vector along the capsule axis
+     */
+    static c_vector<double, DIM> GetAxis(const std::vector<double>& rAttributes)
+    {
+        c_vector<double, DIM> axis;
+        const double theta = rAttributes[NA_THETA];
+        if (DIM == 2)
+        {
+            axis[0] = cos(theta);
+            axis[1] = sin(theta);
+        }
+        else
+        {
+            const double phi = rAttributes[NA_PHI];
+            axis[0] = cos(theta)*sin(phi);
+            axis[1] = sin(theta)*sin(phi);
+            axis[DIM-1] = cos(phi);
+        }
+        return axis;
+    }
+
+    /**
+     * @param rNode a capsule node
+     * @param wall a plane wall
+     * @return the distance by which the capsule pierces the wall; negative if it is clear
+     */
+    double GetPlanePenetration(Node<DIM>& rNode, unsigned wall) const
+    {
+        const std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+        const c_vector<double, DIM>& r_normal = mWallNormals[wall];
+        double lowest = inner_prod(r_normal, rNode.rGetLocation())
+                        - 0.5*r_attributes[NA_LENGTH]*fabs(inner_prod(r_normal, GetAxis(r_attributes)))
+                        - r_attributes[NA_RADIUS];
+        return mWallOffsets[wall] - lowest;
+    }
+
+    /**
+     * Find the end of a capsule furthest from the axis of the well.
+     *
+     * @param rNode a capsule node
+     * @param rOutward set to the unit vector from the well axis towards that end, in the x-y plane
+     * @return the distance by which the capsule pierces the well; negative if it is clear
+     */
+    double GetWellPenetration(Node<DIM>& rNode, c_vector<double, DIM>& rOutward) const
+    {
+        const std::vector<double>& r_attributes = rNode.rGetNodeAttributes();
+        c_vector<double, DIM> half_axis = 0.5*r_attributes[NA_LENGTH]*GetAxis(r_attributes);
+
+        double furthest = -1.0;
+        for (int sign=-1; sign<=1; sign+=2)
+        {
+            c_vector<double, DIM> end = rNode.rGetLocation() + double(sign)*half_axis - mWellCentre;
+            if (DIM == 3)
+            {
+                end[DIM-1] = 0.0;
+            }
+            double distance = norm_2(end);
+            if (distance > furthest)
+            {
+                furthest = distance;
+                rOutward = distance > 0.0 ? c_vector<double, DIM>(end/distance) : c_vector<double, DIM>(zero_vector<double>(DIM));
+            }
+        }
+        return furthest + r_attributes[NA_RADIUS] - mWellRadius;
+    }
+
+    /**
+     * Add a pair of walls normal to each coordinate axis from firstAxis onwards.
+     *
+     * @param rLowerCorner the lower corner
+     * @param rUpperCorner the upper corner
+     * @param firstAxis the first axis to add walls for
+     */
+    void AddWallPairs(const c_vector<double, DIM>& rLowerCorner, const c_vector<double, DIM>& rUpperCorner, unsigned firstAxis)
+    {
+        for (unsigned d=firstAxis; d<DIM; d++)
+        {
+            if (rLowerCorner[d] >= rUpperCorner[d])
+            {
+                EXCEPTION("The lower corner must be below the upper corner");
+            }
+        }
+        for (unsigned d=firstAxis; d<DIM; d++)
+        {
+            c_vector<double, DIM> normal = zero_vector<double>(DIM);
+            normal[d] = 1.0;
+            AddPlaneWall(rLowerCorner, normal);
+            normal[d] = -1.0;
+            AddPlaneWall(rUpperCorner, normal);
+        }
+    }
+
+    /**
+     * Copy the capsule centres and bounding radii into contiguous arrays and
+     * mark the capsules whose bounding sphere reaches a wall.
+     */
+    void MarkCapsulesNearWalls()
+    {
+        const unsigned num_nodes = this->mpCellPopulation->GetNumNodes();
+        mNodes.clear();
+        mNodes.reserve(num_nodes);
+        for (unsigned d=0; d<DIM; d++)
+        {
+            mCentres[d].resize(num_nodes);
+        }
+        mBoundingRadii.resize(num_nodes);
+
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
+             node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
+             ++node_iter)
+        {
+            const unsigned i = mNodes.size();
+            const c_vector<double, DIM>& r_location = node_iter->rGetLocation();
+            for (unsigned d=0; d<DIM; d++)
+            {
+                mCentres[d][i] = r_location[d];
+            }
+            const std::vector<double>& r_attributes = node_iter->rGetNodeAttributes();
+            mBoundingRadii[i] = 0.5*r_attributes[NA_LENGTH] + r_attributes[NA_RADIUS];
+            mNodes.push_back(&(*node_iter));
+        }
+
+        const unsigned num_capsules = mNodes.size();
+        mNearWall.assign(num_capsules, 0u);
+        mDistances.resize(num_capsules);
+        const double* p_radii = mBoundingRadii.data();
+        double* p_distances = mDistances.data();
+        uint8_t* p_near = mNearWall.data();
+
+        for (unsigned wall=0; wall<mWallNormals.size(); wall++)
+        {
+            // Signed distance from each bounding sphere to the wall, accumulated one coordinate at a time
+            const double offset = mWallOffsets[wall];
+            for (unsigned i=0; i<num_capsules; i++)
+            {
+                p_distances[i] = -p_radii[i] - offset;
+            }
+            for (unsigned d=0; d<DIM; d++)
+            {
+                const double normal = mWallNormals[wall][d];
+                const double* p_centres = mCentres[d].data();
+                for (unsigned i=0; i<num_capsules; i++)
+                {
+                    p_distances[i] += normal*p_centres[i];
+                }
+            }
+            for (unsigned i=0; i<num_capsules; i++)
+            {
+                p_near[i] |= static_cast<uint8_t>(p_distances[i] < 0.0);
+            }
+        }
+
+        if (mHasWell)
+        {
+            const double well_x = mWellCentre[0];
+            const double well_y = mWellCentre[1];
+            const double well_radius = mWellRadius;
+            const double* p_x = mCentres[0].data();
+            const double* p_y = mCentres[1].data();
+            for (unsigned i=0; i<num_capsules; i++)
+            {
+                const double dx = p_x[i] - well_x;
+                const double dy = p_y[i] - well_y;
+                const double clearance = well_radius - p_radii[i];
+                p_near[i] |= static_cast<uint8_t>((clearance < 0.0) | (dx*dx + dy*dy > clearance*clearance));
+            }
+        }
+    }
+
+public:
+
+    /**
+     * Constructor. There are no walls until some are added.
+     *
+     * @param pCellPopulation pointer to the cell population
+     */
+    CapsuleWallBoundaryCondition(AbstractCellPopulation<DIM,DIM>* pCellPopulation)
+        : AbstractCellPopulationBoundaryCondition<DIM,DIM>(pCellPopulation),
+          mHasWell(false),
+          mWellCentre(zero_vector<double>(DIM)),
+          mWellRadius(0.0),
+          mTolerance(1e-6),
+          mNumCapsulesNearWalls(0u)
+    {
+    }
+
+    /**
+     * Add a plane wall.
+     *
+     * @param rPoint a point on the wall
+     * @param rNormal a normal to the wall pointing towards the side where capsules are allowed
+     */
+    void AddPlaneWall(const c_vector<double, DIM>& rPoint, const c_vector<double, DIM>& rNormal)
+    {
+        double length = norm_2(rNormal);
+        if (length == 0.0)
+        {
+            EXCEPTION("The wall normal must be non-zero");
+        }
+        c_vector<double, DIM> unit_normal = rNormal/length;
+        mWallNormals.push_back(unit_normal);
+        mWallOffsets.push_back(inner_prod(unit_normal, rPoint));
+    }
+
+    /**
+     * Add the walls of an axis-aligned box, keeping capsules inside it.
+     *
+     * @param rLowerCorner the lower corner of the box
+     * @param rUpperCorner the upper corner of the box
+     */
+    void AddBoxWalls(const c_vector<double, DIM>& rLowerCorner, const c_vector<double, DIM>& rUpperCorner)
+    {
+        AddWallPairs(rLowerCorner, rUpperCorner, 0u);
+    }
+
+    /**
+     * Add the walls of an axis-aligned channel that is open along the x axis,
+     * keeping capsules inside it. The x components of the corners are ignored.
+     *
+     * @param rLowerCorner the lower corner of the channel
+     * @param rUpperCorner the upper corner of the channel
+     */
+    void AddChannelWalls(const c_vector<double, DIM>& rLowerCorner, const c_vector<double, DIM>& rUpperCorner)
+    {
+        AddWallPairs(rLowerCorner, rUpperCorner, 1u);
+    }
+
+    /**
+     * Set a circular well, keeping capsules inside it. In 3D the well is a
+     * cylinder along the z axis and the z component of the centre is ignored.
+     *
+     * @param rCentre the centre of the well
+     * @param radius the radius of the well
+     */
+    void SetCircularWell(const c_vector<double, DIM>& rCentre, double radius)
+    {
+        if (radius <= 0.0)
+        {
+            EXCEPTION("The well radius must be positive");
+        }
+        mHasWell = true;
+        mWellCentre = rCentre;
+        if (DIM == 3)
+        {
+            mWellCentre[DIM-1] = 0.0;
+        }
+        mWellRadius = radius;
+    }
+
+    /**
+     * @return the number of plane walls, including those of boxes and channels
+     */
+    unsigned GetNumPlaneWalls() const
+    {
+        return mWallNormals.size();
+    }
+
+    /**
+     * @return whether there is a circular well
+     */
+    bool HasCircularWell() const
+    {
+        return mHasWell;
+    }
+
+    /**
+     * @return the number of capsules given the exact test in the last call to ImposeBoundaryCondition()
+     */
+    unsigned GetNumCapsulesNearWalls() const
+    {
+        return mNumCapsulesNearWalls;
+    }
+
+    /**
+     * Overridden ImposeBoundaryCondition() method.
+     *
+     * Move each capsule that pierces a wall back inside along the wall normal.
+     *
+     * @param rOldLocations the node locations before any boundary conditions are applied
+     */
+    void ImposeBoundaryCondition(const std::map<Node<DIM>*, c_vector<double, DIM> >& rOldLocations)
+    {
+        MarkCapsulesNearWalls();
+
+        mNumCapsulesNearWalls = 0;
+        for (unsigned i=0; i<mNodes.size(); i++)
+        {
+            if (!mNearWall[i])
+            {
+                continue;
+            }
+            mNumCapsulesNearWalls++;
+
+            // Correcting one wall can push the capsule through another, so sweep over them all until none is pierced
+            Node<DIM>& r_node = *mNodes[i];
+            const double converged_penetration = 0.01*mTolerance;
+            bool is_inside = false;
+            for (unsigned sweep=0; sweep<MAX_NUM_CORRECTION_SWEEPS && !is_inside; sweep++)
+            {
+                is_inside = true;
+                for (unsigned wall=0; wall<mWallNormals.size(); wall++)
+                {
+                    double penetration = GetPlanePenetration(r_node, wall);
+                    if (penetration > 0.0)
+                    {
+                        r_node.rGetModifiableLocation() += penetration*mWallNormals[wall];
+                        is_inside = is_inside && (penetration <= converged_penetration);
+                    }
+                }
+                if (mHasWell)
+                {
+                    c_vector<double, DIM> outward;
+                    double penetration = GetWellPenetration(r_node, outward);
+                    if (penetration > 0.0)
+                    {
+                        r_node.rGetModifiableLocation() -= penetration*outward;
+                        is_inside = is_inside && (penetration <= converged_penetration);
+                    }
+                }
+            }
+            if (!is_inside)
+            {
+                EXCEPTION("Capsule " << r_node.GetIndex() << " could not be moved inside the walls in "
+                          << MAX_NUM_CORRECTION_SWEEPS << " sweeps");
+            }
+        }
+    }
+
+    /**
+     * Overridden VerifyBoundaryCondition() method.
+     *
+     * @return whether every capsule lies inside all the walls, to within a small tolerance
+     */
+    bool VerifyBoundaryCondition()
+    {
+        c_vector<double, DIM> outward;
+        for (typename AbstractMesh<DIM,DIM>::NodeIterator node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
+             node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
+             ++node_iter)
+        {
+            for (unsigned wall=0; wall<mWallNormals.size(); wall++)
+            {
+                if (GetPlanePenetration(*node_iter, wall) > mTolerance)
+                {
+                    return false;
+                }
+            }
+            if (mHasWell && GetWellPenetration(*node_iter, outward) > mTolerance)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Overridden OutputCellPopulationBoundaryConditionParameters() method.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    void OutputCellPopulationBoundaryConditionParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<NumPlaneWalls>" << mWallNormals.size() << "</NumPlaneWalls>\n";
+        for (unsigned wall=0; wall<mWallNormals.size(); wall++)
+        {
+            *rParamsFile << "\t\t\t<PlaneWall>";
+            for (unsigned d=0; d<DIM; d++)
+            {
+                *rParamsFile << mWallNormals[wall][d] << ",";
+            }
+            *rParamsFile << mWallOffsets[wall] << "</PlaneWall>\n";
+        }
+        if (mHasWell)
+        {
+            *rParamsFile << "\t\t\t<WellCentre>" << mWellCentre[0] << "," << mWellCentre[1] << "</WellCentre>\n";
+            *rParamsFile << "\t\t\t<WellRadius>" << mWellRadius << "</WellRadius>\n";
+        }
+
+        // Call method on direct parent class
+        AbstractCellPopulationBoundaryCondition<DIM,DIM>::OutputCellPopulationBoundaryConditionParameters(rParamsFile);
+    }
+};
+
+template<unsigned DIM>
+const unsigned CapsuleWallBoundaryCondition<DIM>::MAX_NUM_CORRECTION_SWEEPS;
+
+#endif /*CAPSULEWALLBOUNDARYCONDITION_HPP_*/
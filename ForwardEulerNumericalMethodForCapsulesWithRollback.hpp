@@ -0,0 +1,359 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef FORWARDEULERNUMERICALMETHODFORCAPSULESWITHROLLBACK_HPP_
+#define FORWARDEULERNUMERICALMETHODFORCAPSULESWITHROLLBACK_HPP_
+
+#include <cmath>
+#include <vector>
+
+#include "Exception.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "StepSizeException.hpp"
+#include "TypeSixSecretionEnumerations.hpp"
+
+/**
+ * A capsule forward Euler numerical method that recovers from blow-ups.
+ *
+ * Before each step the node locations and attributes are copied into a
+ * snapshot whose storage is reused from step to step. If the step produces a
+ * non-finite location or attribute, moves a capsule further than the maximum
+ * displacement, rotates it further than the maximum rotation (allowing for
+ * angles wrapping by 2 pi), or raises a StepSizeException, the snapshot is
+ * restored and the step is retried as two substeps of half the size, then
+ * four, and so on. The next step starts again at the normal dt.
+ *
+ * This guards against, for example, the large forces that CapsuleForce
+ * produces when two capsules are placed with a large overlap after division.
+ * An exception is thrown only if the step still fails after the maximum
+ * number of halvings.
+ */
+template<unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
+class ForwardEulerNumericalMethodForCapsulesWithRollback : public ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>
+{
+private:
+
+    /** Largest distance a capsule centre may move in one step. Defaults to 0.5. */
+    double mMaxDisplacement;
+
+    /** Largest change in a capsule angle in one step. Defaults to pi/4. */
+    double mMaxRotation;
+
+    /** Largest number of times a step may be halved before giving up. Defaults to 10. */
+    unsigned mMaxNumberOfHalvings;
+
+    /** Number of steps that have been rolled back and retried. */
+    unsigned mNumRollbacks;
+
+    /** Node locations at the start of the current step. */
+    std::vector<c_vector<double, SPACE_DIM> > mSnapshotLocations;
+
+    /** Node attributes at the start of the current step. */
+    std::vector<std::vector<double> > mSnapshotAttributes;
+
+    /** Node locations at the start of the whole step, as substeps overwrite the snapshot. */
+    std::vector<c_vector<double, SPACE_DIM> > mStartLocations;
+
+    /** Node attributes at the start of the whole step. */
+    std::vector<std::vector<double> > mStartAttributes;
+
+    /**
+     * @param newAngle an angle after a step
+     * @param oldAngle the same angle before the step
+     * @return the change in angle, wrapped into [-pi, pi]
+     */
+    static double AngleChange(double newAngle, double oldAngle)
+    {
+        return std::remainder(newAngle - oldAngle, 2.0*M_PI);
+    }
+
+    /**
+     * Copy the locations and attributes of all nodes into the snapshot,
+     * reusing the storage from the previous step.
+     */
+    void TakeSnapshot()
+    {
+        const unsigned num_nodes = this->mpCellPopulation->GetNumNodes();
+        mSnapshotLocations.resize(num_nodes);
+        mSnapshotAttributes.resize(num_nodes);
+
+        unsigned node_count = 0;
+        for (typename AbstractMesh<ELEMENT_DIM, SPACE_DIM>::NodeIterator node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
+             node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
+             ++node_iter, ++node_count)
+        {
+            if (node_count == mSnapshotLocations.size())
+            {
+                mSnapshotLocations.resize(node_count + 1);
+                mSnapshotAttributes.resize(node_count + 1);
+            }
+            mSnapshotLocations[node_count] = node_iter->rGetLocation();
+            mSnapshotAttributes[node_count] = node_iter->rGetNodeAttributes();
+        }
+        mSnapshotLocations.resize(node_count);
+        mSnapshotAttributes.resize(node_count);
+    }
+
+    /**
+     * Copy the snapshot back into the nodes.
+     */
+    void RestoreSnapshot()
+    {
+        unsigned node_count = 0;
+        for (typename AbstractMesh<ELEMENT_DIM, SPACE_DIM>::NodeIterator node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
+             node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
+             ++node_iter, ++node_count)
+        {
+            node_iter->rGetModifiableLocation() = mSnapshotLocations[node_count];
+            node_iter->rGetNodeAttributes() = mSnapshotAttributes[node_count];
+        }
+    }
+
+    /**
+     * @return whether every node is finite and within the displacement and
+     *     rotation limits relative to the snapshot
+     */
+    bool IsStateAcceptable()
+    {
+        const double max_displacement_squared = mMaxDisplacement*mMaxDisplacement;
+
+        unsigned node_count = 0;
+        for (typename AbstractMesh<ELEMENT_DIM, SPACE_DIM>::NodeIterator node_iter = this->mpCellPopulation->rGetMesh().GetNodeIteratorBegin();
+             node_iter != this->mpCellPopulation->rGetMesh().GetNodeIteratorEnd();
+             ++node_iter, ++node_count)
+        {
+            const c_vector<double, SPACE_DIM>& r_location = node_iter->rGetLocation();
+            double displacement_squared = 0.0;
+            for (unsigned i=0; i<SPACE_DIM; i++)
+            {
+                double displacement = r_location[i] - mSnapshotLocations[node_count][i];
+                displacement_squared += displacement*displacement;
+            }
+            // Written so that NaN fails the test
+            if (!(displacement_squared <= max_displacement_squared))
+            {
+                return false;
+            }
+
+            const std::vector<double>& r_attributes = node_iter->rGetNodeAttributes();
+            for (unsigned i=0; i<r_attributes.size(); i++)
+            {
+                if (!std::isfinite(r_attributes[i]))
+                {
+                    return false;
+                }
+            }
+            if (fabs(AngleChange(r_attributes[NA_THETA], mSnapshotAttributes[node_count][NA_THETA])) > mMaxRotation)
+            {
+                return false;
+            }
+            if (SPACE_DIM == 3 && fabs(AngleChange(r_attributes[NA_PHI], mSnapshotAttributes[node_count][NA_PHI])) > mMaxRotation)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Advance all nodes by dt in numSubsteps equal substeps, checking the state
+     * after each.
+     *
+     * @param dt the time step to advance by
+     * @param numSubsteps the number of substeps
+     * @return whether every substep was acceptable
+     */
+    bool TrySubsteps(double dt, unsigned numSubsteps)
+    {
+        const double substep = dt/numSubsteps;
+        for (unsigned i=0; i<numSubsteps; i++)
+        {
+            if (i > 0)
+            {
+                // Limits apply per substep
+                TakeSnapshot();
+            }
+            try
+            {
+                ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::UpdateAllNodePositions(substep);
+            }
+            catch (StepSizeException&)
+            {
+                return false;
+            }
+            if (!IsStateAcceptable())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+
+    /**
+     * Constructor.
+     */
+    ForwardEulerNumericalMethodForCapsulesWithRollback()
+        : ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>(),
+          mMaxDisplacement(0.5),
+          mMaxRotation(0.25*M_PI),
+          mMaxNumberOfHalvings(10u),
+          mNumRollbacks(0u)
+    {
+    }
+
+    /**
+     * Overridden UpdateAllNodePositions() method.
+     *
+     * @param dt the time step to advance by
+     */
+    virtual void UpdateAllNodePositions(double dt)
+    {
+        TakeSnapshot();
+        mStartLocations = mSnapshotLocations;
+        mStartAttributes = mSnapshotAttributes;
+
+        unsigned num_substeps = 1;
+        for (unsigned halvings = 0; halvings <= mMaxNumberOfHalvings; halvings++, num_substeps *= 2)
+        {
+            if (halvings > 0)
+            {
+                mSnapshotLocations = mStartLocations;
+                mSnapshotAttributes = mStartAttributes;
+                RestoreSnapshot();
+            }
+
+            if (TrySubsteps(dt, num_substeps))
+            {
+                return;
+            }
+
+            if (halvings == 0)
+            {
+                mNumRollbacks++;
+            }
+        }
+
+        mSnapshotLocations = mStartLocations;
+        mSnapshotAttributes = mStartAttributes;
+        RestoreSnapshot();
+        EXCEPTION("Capsule positions are still unstable after " << mMaxNumberOfHalvings << " halvings of the time step " << dt);
+    }
+
+    /**
+     * @return mMaxDisplacement
+     */
+    double GetMaxDisplacement() const
+    {
+        return mMaxDisplacement;
+    }
+
+    /**
+     * Set mMaxDisplacement.
+     *
+     * @param maxDisplacement the new value
+     */
+    void SetMaxDisplacement(double maxDisplacement)
+    {
+        mMaxDisplacement = maxDisplacement;
+    }
+
+    /**
+     * @return mMaxRotation
+     */
+    double GetMaxRotation() const
+    {
+        return mMaxRotation;
+    }
+
+    /**
+     * Set mMaxRotation.
+     *
+     * @param maxRotation the new value
+     */
+    void SetMaxRotation(double maxRotation)
+    {
+        mMaxRotation = maxRotation;
+    }
+
+    /**
+     * @return mMaxNumberOfHalvings
+     */
+    unsigned GetMaxNumberOfHalvings() const
+    {
+        return mMaxNumberOfHalvings;
+    }
+
+    /**
+     * Set mMaxNumberOfHalvings. At most 31 halvings are allowed, so that the
+     * number of substeps fits in an unsigned.
+     *
+     * @param maxNumberOfHalvings the new value
+     */
+    void SetMaxNumberOfHalvings(unsigned maxNumberOfHalvings)
+    {
+        if (maxNumberOfHalvings > 31u)
+        {
+            EXCEPTION("The maximum number of halvings must be at most 31");
+        }
+        mMaxNumberOfHalvings = maxNumberOfHalvings;
+    }
+
+    /**
+     * @return the number of steps that have been rolled back and retried
+     */
+    unsigned GetNumRollbacks() const
+    {
+        return mNumRollbacks;
+    }
+
+    /**
+     * Overridden OutputNumericalMethodParameters() method.
+     *
+     * @param rParamsFile the file stream to which the parameters are output
+     */
+    virtual void OutputNumericalMethodParameters(out_stream& rParamsFile)
+    {
+        *rParamsFile << "\t\t\t<MaxDisplacement>" << mMaxDisplacement << "</MaxDisplacement>\n";
+        *rParamsFile << "\t\t\t<MaxRotation>" << mMaxRotation << "</MaxRotation>\n";
+        *rParamsFile << "\t\t\t<MaxNumberOfHalvings>" << mMaxNumberOfHalvings << "</MaxNumberOfHalvings>\n";
+
+        // Call method on direct parent class
+        ForwardEulerNumericalMethodForCapsules<ELEMENT_DIM, SPACE_DIM>::OutputNumericalMethodParameters(rParamsFile);
+    }
+};
+
+#endif /*FORWARDEULERNUMERICALMETHODFORCAPSULESWITHROLLBACK_HPP_*/
@@ -0,0 +1,119 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef PROFILEDCELLWRITER_HPP_
+#define PROFILEDCELLWRITER_HPP_
+
+#include <memory>
+#include <string>
+
+#include "AbstractCellPopulation.hpp"
+#include "CapsuleProfiler.hpp"
+
+/**
+ * A cell writer that times each pass of WRITER over the population, from
+ * WriteTimeStamp() to CloseFile(), under a CapsuleProfiler phase named after
+ * the writer's output file, and counts the cells visited in the phase
+ * counter. Timing the whole pass keeps the clock reads out of the per-cell
+ * loop. The population visits all its writers cell by cell within one pass,
+ * so the time of each profiled writer includes the other writers. The writer
+ * is added through the shared pointer overload of AddCellWriter(), for example
+ *
+ *     boost::shared_ptr<ProfiledCellWriter<CapsuleOrientationWriter<2,2>, 2> > p_writer(new ProfiledCellWriter<CapsuleOrientationWriter<2,2>, 2>());
+ *     population.AddCellWriter(p_writer);
+ *
+ * Nothing is recorded unless CAPSULE_PROFILING is defined. This class is not
+ * archived.
+ */
+template<class WRITER, unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
+class ProfiledCellWriter : public WRITER
+{
+private:
+
+    /** The CapsuleProfiler phase index. */
+    unsigned mProfilePhase;
+
+#ifdef CAPSULE_PROFILING
+    /** Times the current pass, or null between passes. */
+    std::unique_ptr<CapsuleProfilerScope> mpPassScope;
+#endif
+
+public:
+
+    /**
+     * Default constructor.
+     */
+    ProfiledCellWriter()
+        : WRITER(),
+          mProfilePhase(CapsuleProfiler::RegisterPhase("CellWriter:" + this->GetFileName()))
+    {
+    }
+
+    /**
+     * Overridden WriteTimeStamp() method. Starts timing the pass.
+     */
+    virtual void WriteTimeStamp()
+    {
+#ifdef CAPSULE_PROFILING
+        mpPassScope.reset(new CapsuleProfilerScope(mProfilePhase));
+#endif
+        WRITER::WriteTimeStamp();
+    }
+
+    /**
+     * Overridden VisitCell() method.
+     *
+     * @param pCell a cell
+     * @param pCellPopulation a pointer to the cell population owning the cell
+     */
+    virtual void VisitCell(CellPtr pCell, AbstractCellPopulation<ELEMENT_DIM, SPACE_DIM>* pCellPopulation)
+    {
+        CAPSULE_PROFILE_COUNT(mProfilePhase, 1u);
+        WRITER::VisitCell(pCell, pCellPopulation);
+    }
+
+    /**
+     * Overridden CloseFile() method. Stops timing the pass.
+     */
+    virtual void CloseFile()
+    {
+        WRITER::CloseFile();
+#ifdef CAPSULE_PROFILING
+        mpPassScope.reset();
+#endif
+    }
+};
+
+#endif /*PROFILEDCELLWRITER_HPP_*/
@@ -0,0 +1,103 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef PROFILEDDIVISIONRULE_HPP_
+#define PROFILEDDIVISIONRULE_HPP_
+
+#include <string>
+#include <utility>
+
+#include "AbstractCentreBasedCellPopulation.hpp"
+#include "CapsuleProfiler.hpp"
+
+/**
+ * A division rule that times each call to CalculateCellDivisionVector() of
+ * RULE under a CapsuleProfiler phase, so that the call count is the number
+ * of divisions. For example
+ *
+ *     boost::shared_ptr<AbstractCentreBasedDivisionRule<2,2> > p_rule(new ProfiledDivisionRule<CapsuleBasedDivisionRule<2,2>, 2>());
+ *
+ * Constructor arguments are passed on to RULE. Nothing is recorded unless
+ * CAPSULE_PROFILING is defined. This class is not archived.
+ */
+template<class RULE, unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
+class ProfiledDivisionRule : public RULE
+{
+private:
+
+    /** The CapsuleProfiler phase index. */
+    unsigned mProfilePhase;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param args the arguments of the RULE constructor
+     */
+    template<typename... ARGS>
+    ProfiledDivisionRule(ARGS&&... args)
+        : RULE(std::forward<ARGS>(args)...),
+          mProfilePhase(CapsuleProfiler::RegisterPhase("DivisionRule"))
+    {
+    }
+
+    /**
+     * Set the name of the CapsuleProfiler phase. Defaults to "DivisionRule".
+     *
+     * @param rName the phase name
+     */
+    void SetProfilePhaseName(const std::string& rName)
+    {
+        mProfilePhase = CapsuleProfiler::RegisterPhase(rName);
+    }
+
+    /**
+     * Overridden CalculateCellDivisionVector() method.
+     *
+     * @param pParentCell the cell to divide
+     * @param rCellPopulation the cell population
+     * @return the locations of the two daughter cells
+     */
+    virtual std::pair<c_vector<double, SPACE_DIM>, c_vector<double, SPACE_DIM> > CalculateCellDivisionVector(
+        CellPtr pParentCell,
+        AbstractCentreBasedCellPopulation<ELEMENT_DIM, SPACE_DIM>& rCellPopulation)
+    {
+        CAPSULE_PROFILE_SCOPE(mProfilePhase);
+        return RULE::CalculateCellDivisionVector(pParentCell, rCellPopulation);
+    }
+};
+
+#endif /*PROFILEDDIVISIONRULE_HPP_*/
@@ -0,0 +1,109 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef PROFILEDFORCE_HPP_
+#define PROFILEDFORCE_HPP_
+
+#include <string>
+#include <utility>
+
+#include "AbstractCellPopulation.hpp"
+#include "NodeBasedCellPopulation.hpp"
+#include "CapsuleProfiler.hpp"
+
+/**
+ * A force that times each call to AddForceContribution() of FORCE under a
+ * CapsuleProfiler phase, and counts the node pairs it visits when used with a
+ * NodeBasedCellPopulation. For example
+ *
+ *     auto p_force = boost::make_shared<ProfiledForce<CapsuleForce<2>, 2> >();
+ *     p_force->SetProfilePhaseName("CapsuleForce");
+ *
+ * Constructor arguments are passed on to FORCE, and the methods of FORCE
+ * remain available. Nothing is recorded unless CAPSULE_PROFILING is defined.
+ * This class is not archived.
+ */
+template<class FORCE, unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
+class ProfiledForce : public FORCE
+{
+private:
+
+    /** The CapsuleProfiler phase index. */
+    unsigned mProfilePhase;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param args the arguments of the FORCE constructor
+     */
+    template<typename... ARGS>
+    ProfiledForce(ARGS&&... args)
+        : FORCE(std::forward<ARGS>(args)...),
+          mProfilePhase(CapsuleProfiler::RegisterPhase("Force"))
+    {
+    }
+
+    /**
+     * Set the name of the CapsuleProfiler phase. Defaults to "Force".
+     *
+     * @param rName the phase name
+     */
+    void SetProfilePhaseName(const std::string& rName)
+    {
+        mProfilePhase = CapsuleProfiler::RegisterPhase(rName);
+    }
+
+    /**
+     * Overridden AddForceContribution() method.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void AddForceContribution(AbstractCellPopulation<ELEMENT_DIM, SPACE_DIM>& rCellPopulation)
+    {
+#ifdef CAPSULE_PROFILING
+        NodeBasedCellPopulation<SPACE_DIM>* p_population = dynamic_cast<NodeBasedCellPopulation<SPACE_DIM>*>(&rCellPopulation);
+        if (p_population != nullptr)
+        {
+            CAPSULE_PROFILE_COUNT(mProfilePhase, p_population->rGetNodePairs().size());
+        }
+#endif
+        CAPSULE_PROFILE_SCOPE(mProfilePhase);
+        FORCE::AddForceContribution(rCellPopulation);
+    }
+};
+
+#endif /*PROFILEDFORCE_HPP_*/
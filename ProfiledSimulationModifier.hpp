@@ -0,0 +1,98 @@
+/*
+
+Copyright (c) 2005-2017, University of Oxford.
+All rights reserved.
+
+University of Oxford means the Chancellor, Masters and Scholars of the
+University of Oxford, having an administrative office at Wellington
+Square, Oxford OX1 2JD, UK.
+
+This file is part of Chaste.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+ * Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+ * Neither the name of the University of Oxford nor the names of its
+   contributors may be used to endorse or promote products derived from this
+   software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef PROFILEDSIMULATIONMODIFIER_HPP_
+#define PROFILEDSIMULATIONMODIFIER_HPP_
+
+#include <string>
+#include <utility>
+
+#include "AbstractCellPopulation.hpp"
+#include "CapsuleProfiler.hpp"
+
+/**
+ * A simulation modifier that times each call to UpdateAtEndOfTimeStep() of
+ * MODIFIER under a CapsuleProfiler phase, for example
+ *
+ *     auto p_modifier = boost::make_shared<ProfiledSimulationModifier<TypeSixMachineModifier<2>, 2> >();
+ *
+ * Constructor arguments are passed on to MODIFIER. Nothing is recorded unless
+ * CAPSULE_PROFILING is defined. This class is not archived.
+ */
+template<class MODIFIER, unsigned ELEMENT_DIM, unsigned SPACE_DIM=ELEMENT_DIM>
+class ProfiledSimulationModifier : public MODIFIER
+{
+private:
+
+    /** The CapsuleProfiler phase index. */
+    unsigned mProfilePhase;
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param args the arguments of the MODIFIER constructor
+     */
+    template<typename... ARGS>
+    ProfiledSimulationModifier(ARGS&&... args)
+        : MODIFIER(std::forward<ARGS>(args)...),
+          mProfilePhase(CapsuleProfiler::RegisterPhase("SimulationModifier"))
+    {
+    }
+
+    /**
+     * Set the name of the CapsuleProfiler phase. Defaults to "SimulationModifier".
+     *
+     * @param rName the phase name
+     */
+    void SetProfilePhaseName(const std::string& rName)
+    {
+        mProfilePhase = CapsuleProfiler::RegisterPhase(rName);
+    }
+
+    /**
+     * Overridden UpdateAtEndOfTimeStep() method.
+     *
+     * @param rCellPopulation reference to the cell population
+     */
+    virtual void UpdateAtEndOfTimeStep(AbstractCellPopulation<ELEMENT_DIM, SPACE_DIM>& rCellPopulation)
+    {
+        CAPSULE_PROFILE_SCOPE(mProfilePhase);
+        MODIFIER::UpdateAtEndOfTimeStep(rCellPopulation);
+    }
+};
+
+#endif /*PROFILEDSIMULATIONMODIFIER_HPP_*/
@@ -0,0 +1,253 @@
+#ifndef TESTASYNCHRONOUSCAPSULEOUTPUTMODIFIER_HPP_
+#define TESTASYNCHRONOUSCAPSULEOUTPUTMODIFIER_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <fstream>
+#include <future>
+#include <sstream>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "OutputFileHandler.hpp"
+#include "SimulationTime.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "CapsulePopulationBuilder.hpp"
+#include "AsynchronousCapsuleOutputModifier.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+/**
+ * An output modifier whose writer thread waits for a signal before writing
+ * each frame, so that the queue can be filled deterministically.
+ */
+class GatedCapsuleOutputModifier : public AsynchronousCapsuleOutputModifier<2>
+{
+private:
+
+    /** Future that becomes ready when the writer may proceed. */
+    std::shared_future<void> mGate;
+
+    /**
+     * Wait for the gate to open, then write the frame.
+     *
+     * @param rFrame the frame to write
+     */
+    virtual void WriteFrame(const Frame& rFrame)
+    {
+        mGate.wait();
+        AsynchronousCapsuleOutputModifier<2>::WriteFrame(rFrame);
+    }
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param gate future that becomes ready when the writer may proceed
+     */
+    GatedCapsuleOutputModifier(std::shared_future<void> gate)
+        : mGate(gate)
+    {
+    }
+};
+
+class TestAsynchronousCapsuleOutputModifier : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestParameters()
+    {
+        AsynchronousCapsuleOutputModifier<2> modifier;
+
+        TS_ASSERT_EQUALS(modifier.GetSamplingTimestepMultiple(), 1u);
+        TS_ASSERT_EQUALS(modifier.GetQueueCapacity(), 2u);
+        TS_ASSERT_EQUALS(modifier.GetNumMachineStates(), 6u);
+        TS_ASSERT_EQUALS(modifier.GetBackPressurePolicy(), AsynchronousCapsuleOutputModifier<2>::BLOCK);
+        TS_ASSERT_EQUALS(modifier.rGetOutputFileName(), "capsules.dat");
+
+        modifier.SetSamplingTimestepMultiple(10u);
+        modifier.SetQueueCapacity(4u);
+        modifier.SetNumMachineStates(3u);
+        modifier.SetBackPressurePolicy(AsynchronousCapsuleOutputModifier<2>::DROP_FRAME);
+        modifier.SetOutputFileName("frames.dat");
+
+        TS_ASSERT_EQUALS(modifier.GetSamplingTimestepMultiple(), 10u);
+        TS_ASSERT_EQUALS(modifier.GetQueueCapacity(), 4u);
+        TS_ASSERT_EQUALS(modifier.GetNumMachineStates(), 3u);
+        TS_ASSERT_EQUALS(modifier.GetBackPressurePolicy(), AsynchronousCapsuleOutputModifier<2>::DROP_FRAME);
+        TS_ASSERT_EQUALS(modifier.rGetOutputFileName(), "frames.dat");
+
+        TS_ASSERT_THROWS_THIS(modifier.SetSamplingTimestepMultiple(0u),
+            "The sampling timestep multiple must be positive");
+        TS_ASSERT_THROWS_THIS(modifier.SetQueueCapacity(0u),
+            "The queue capacity must be positive");
+        TS_ASSERT_THROWS_THIS(modifier.SetNumMachineStates(0u),
+            "The number of machine states must be positive");
+    }
+
+    void TestDroppedFramesWhenQueueIsFull()
+    {
+        EXIT_IF_PARALLEL;
+
+        SimulationTime::Instance()->SetEndTimeAndNumberOfTimeSteps(1.0, 10);
+
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(4.0, 4.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(4.0, 5.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        std::promise<void> gate;
+        GatedCapsuleOutputModifier modifier(gate.get_future().share());
+        modifier.SetQueueCapacity(1u);
+        modifier.SetBackPressurePolicy(AsynchronousCapsuleOutputModifier<2>::DROP_FRAME);
+
+        // The only frame holds the initial snapshot until the gate opens, so every further sample is dropped
+        modifier.SetupSolve(population, "TestDroppedFramesWhenQueueIsFull");
+        for (unsigned i=0; i<5; i++)
+        {
+            modifier.UpdateAtEndOfTimeStep(population);
+        }
+        TS_ASSERT_EQUALS(modifier.GetNumDroppedFrames(), 5u);
+
+        gate.set_value();
+        modifier.UpdateAtEndOfSolve(population);
+        TS_ASSERT_EQUALS(modifier.GetNumDroppedFrames(), 5u);
+
+        // Only the initial snapshot reaches the file
+        OutputFileHandler handler("TestDroppedFramesWhenQueueIsFull", false);
+        std::ifstream file((handler.GetOutputDirectoryFullPath() + "capsules.dat").c_str());
+        TS_ASSERT(file.is_open());
+        unsigned num_lines = 0;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            num_lines++;
+        }
+        TS_ASSERT_EQUALS(num_lines, 1u);
+    }
+
+    void TestAsynchronousOutputOfTwoCapsules()
+    {
+        EXIT_IF_PARALLEL;
+
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, Create_c_vector(4.0, 4.0)));
+        nodes.push_back(new Node<2>(1u, Create_c_vector(4.0, 5.0)));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            mesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = 0.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            UniformCellCycleModel* p_model = new UniformCellCycleModel();
+            p_model->SetMinCellCycleDuration(100.0);
+            p_model->SetMaxCellCycleDuration(101.0);
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+
+            std::vector<double> machine_angles;
+            machine_angles.push_back(0.0);
+            MAKE_PTR(TypeSixMachineProperty, p_property);
+            p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(i+1, machine_angles));
+            p_cell->AddCellProperty(p_property);
+
+            cells.push_back(p_cell);
+        }
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestAsynchronousOutputOfTwoCapsules");
+        simulator.SetDt(1.0/1200.0);
+        simulator.SetSamplingTimestepMultiple(10);
+        simulator.SetEndTime(100.0/1200.0);
+
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsules<2,2>>();
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<CapsuleForce<2>>();
+        simulator.AddForce(p_capsule_force);
+
+        MAKE_PTR(AsynchronousCapsuleOutputModifier<2>, p_modifier);
+        p_modifier->SetSamplingTimestepMultiple(10);
+        p_modifier->SetNumMachineStates(3);
+        simulator.AddSimulationModifier(p_modifier);
+
+        simulator.Solve();
+
+        TS_ASSERT_EQUALS(p_modifier->GetNumDroppedFrames(), 0u);
+
+        // The file is complete once Solve() returns: one line for time zero and one per sampling step
+        OutputFileHandler handler("TestAsynchronousOutputOfTwoCapsules/results_from_time_0", false);
+        std::ifstream file((handler.GetOutputDirectoryFullPath() + "capsules.dat").c_str());
+        TS_ASSERT(file.is_open());
+
+        std::vector<std::string> lines;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            lines.push_back(line);
+        }
+        TS_ASSERT_EQUALS(lines.size(), 11u);
+
+        // Each cell contributes index, id, x, y, theta, length, radius and three state counts
+        std::stringstream first_line(lines[0]);
+        double time;
+        first_line >> time;
+        TS_ASSERT_DELTA(time, 0.0, 1e-12);
+
+        std::vector<double> values;
+        double value;
+        while (first_line >> value)
+        {
+            values.push_back(value);
+        }
+        TS_ASSERT_EQUALS(values.size(), 20u);
+        TS_ASSERT_DELTA(values[2], 4.0, 1e-9);
+        TS_ASSERT_DELTA(values[3], 4.0, 1e-9);
+        TS_ASSERT_DELTA(values[5], 2.0, 1e-9);
+        TS_ASSERT_DELTA(values[6], 0.5, 1e-9);
+        TS_ASSERT_DELTA(values[7], 0.0, 1e-9);
+        TS_ASSERT_DELTA(values[8], 1.0, 1e-9);
+        TS_ASSERT_DELTA(values[9], 0.0, 1e-9);
+        TS_ASSERT_DELTA(values[18], 0.0, 1e-9);
+        TS_ASSERT_DELTA(values[19], 1.0, 1e-9);
+    }
+};
+
+#endif /*TESTASYNCHRONOUSCAPSULEOUTPUTMODIFIER_HPP_*/
@@ -0,0 +1,407 @@
+#ifndef TESTCAPSULECOLONYSCALINGBENCHMARK_HPP_
+#define TESTCAPSULECOLONYSCALINGBENCHMARK_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "NodeBasedCellPopulation.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "OutputFileHandler.hpp"
+#include "CellBasedEventHandler.hpp"
+#include "SimulationTime.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "CapsuleBasedDivisionRule.hpp"
+#include "TypeSixMachineModifier.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "TypeSixMachineCellKiller.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+/**
+ * An OffLatticeSimulation that writes one benchmark row each time the
+ * population first reaches one of a list of target sizes, and stops once
+ * the largest target is reached.
+ */
+template<unsigned DIM>
+class CapsuleScalingBenchmarkSimulation : public OffLatticeSimulation<DIM>
+{
+private:
+
+    /** Population sizes at which to write a row, in increasing order. */
+    std::vector<unsigned> mTargetNumCells;
+
+    /** Index into mTargetNumCells of the next target. */
+    unsigned mNextTarget;
+
+    /** Label written at the start of each row. */
+    std::string mLabel;
+
+    /** The benchmark output file. */
+    out_stream mpBenchmarkFile;
+
+    /** Wall-clock time at which the simulation was constructed. */
+    std::chrono::steady_clock::time_point mStartTime;
+
+    /** Whether to report the peak resident set size rather than the current one. */
+    bool mReportPeakResidentSetSize;
+
+    /**
+     * @param rField a field of /proc/self/status given in kB, such as VmHWM or VmRSS
+     * @return the value of the field, or 0 if it cannot be read
+     */
+    static unsigned long ReadProcessStatusKb(const std::string& rField)
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        const std::string prefix = rField + ":";
+        while (std::getline(status, line))
+        {
+            if (line.compare(0, prefix.size(), prefix) == 0)
+            {
+                unsigned long value = 0;
+                std::istringstream(line.substr(prefix.size())) >> value;
+                return value;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Write a benchmark row for the current state of the simulation.
+     *
+     * @param target the target population size that has been reached
+     */
+    void WriteRow(unsigned target)
+    {
+        double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStartTime).count();
+        unsigned num_steps = SimulationTime::Instance()->GetTimeStepsElapsed();
+
+        unsigned num_pairs = 0;
+        NodeBasedCellPopulation<DIM>* p_population = dynamic_cast<NodeBasedCellPopulation<DIM>*>(&(this->mrCellPopulation));
+        if (p_population != nullptr)
+        {
+            num_pairs = p_population->rGetNodePairs().size();
+        }
+
+        // CellBasedEventHandler reports times in milliseconds
+        *mpBenchmarkFile << mLabel << "\t" << DIM << "\t" << target
+                         << "\t" << this->mrCellPopulation.GetNumRealCells()
+                         << "\t" << SimulationTime::Instance()->GetTime()
+                         << "\t" << num_steps
+                         << "\t" << wall_time
+                         << "\t" << (wall_time > 0.0 ? num_steps/wall_time : 0.0)
+                         << "\t" << 1e-3*CellBasedEventHandler::GetElapsedTime(CellBasedEventHandler::FORCE)
+                         << "\t" << 1e-3*CellBasedEventHandler::GetElapsedTime(CellBasedEventHandler::POSITION)
+                         << "\t" << 1e-3*CellBasedEventHandler::GetElapsedTime(CellBasedEventHandler::UPDATECELLPOPULATION)
+                         << "\t" << 1e-3*CellBasedEventHandler::GetElapsedTime(CellBasedEventHandler::BIRTH)
+                         << "\t" << 1e-3*CellBasedEventHandler::GetElapsedTime(CellBasedEventHandler::DEATH)
+                         << "\t" << 1e-3*CellBasedEventHandler::GetElapsedTime(CellBasedEventHandler::OUTPUT)
+                         << "\t" << ReadProcessStatusKb(mReportPeakResidentSetSize ? "VmHWM" : "VmRSS")
+                         << "\t" << num_pairs << "\n";
+        mpBenchmarkFile->flush();
+    }
+
+protected:
+
+    /**
+     * Overridden StoppingEventHasOccurred() method.
+     *
+     * @return whether the largest target population size has been reached
+     */
+    virtual bool StoppingEventHasOccurred()
+    {
+        unsigned num_cells = this->mrCellPopulation.GetNumRealCells();
+        while (mNextTarget < mTargetNumCells.size() && num_cells >= mTargetNumCells[mNextTarget])
+        {
+            WriteRow(mTargetNumCells[mNextTarget]);
+            mNextTarget++;
+        }
+        return mNextTarget == mTargetNumCells.size();
+    }
+
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param rCellPopulation the cell population
+     * @param rTargetNumCells population sizes at which to write a row, in increasing order
+     * @param rLabel label written at the start of each row
+     * @param pBenchmarkFile the benchmark output file
+     * @param reportPeakResidentSetSize whether to report the peak resident set size (VmHWM)
+     *     rather than the current one (VmRSS)
+     */
+    CapsuleScalingBenchmarkSimulation(AbstractCellPopulation<DIM>& rCellPopulation,
+                                      const std::vector<unsigned>& rTargetNumCells,
+                                      const std::string& rLabel,
+                                      out_stream pBenchmarkFile,
+                                      bool reportPeakResidentSetSize)
+        : OffLatticeSimulation<DIM>(rCellPopulation),
+          mTargetNumCells(rTargetNumCells),
+          mNextTarget(0),
+          mLabel(rLabel),
+          mpBenchmarkFile(pBenchmarkFile),
+          mStartTime(std::chrono::steady_clock::now()),
+          mReportPeakResidentSetSize(reportPeakResidentSetSize)
+    {
+    }
+
+    /**
+     * Write a final row if the simulation ended before reaching the largest target.
+     */
+    void WriteFinalRow()
+    {
+        if (mNextTarget < mTargetNumCells.size())
+        {
+            WriteRow(0u);
+        }
+    }
+};
+
+/**
+ * Grows capsule colonies from a single capsule to fixed population sizes and
+ * writes steps per second, time per phase, peak RSS and pair counts to a
+ * tab-separated file in CapsuleColonyScalingBenchmark/. A target of 0 in the
+ * output marks a run that reached its end time first, for example because
+ * the killer held the population down.
+ *
+ * The peak_rss_kb column is VmHWM from /proc/self/status, whose high-water
+ * mark is reset before each configuration by writing 5 to
+ * /proc/self/clear_refs. Where that reset is not permitted the column is
+ * named rss_kb instead and holds the current VmRSS, which misses transient
+ * highs between rows.
+ *
+ * This is a profiling test and is listed in ProfileTestPack.txt, not in
+ * ContinuousTestPack.txt.
+ */
+class TestCapsuleColonyScalingBenchmark : public AbstractCellBasedTestSuite
+{
+private:
+
+    /**
+     * @param numCells a number of capsules
+     * @return the radius of a disc (2D) or ball (3D) that a colony of
+     *     numCells capsules fits in, with a margin, taking about 4 units of
+     *     area or volume per capsule
+     */
+    template<unsigned DIM>
+    double GetColonyRadius(unsigned numCells)
+    {
+        const double space_per_capsule = 4.0;
+        double radius = (DIM == 2) ? sqrt(numCells*space_per_capsule/M_PI)
+                                   : cbrt(0.75*numCells*space_per_capsule/M_PI);
+        return 1.5*radius + 10.0;
+    }
+
+    /**
+     * Reset the peak resident set size (VmHWM) of the process to its current value.
+     *
+     * @return whether the reset was permitted
+     */
+    static bool ResetPeakResidentSetSize()
+    {
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+        clear_refs.close();
+        return !clear_refs.fail();
+    }
+
+    /**
+     * Grow a colony from a single capsule and write benchmark rows.
+     *
+     * @param rLabel label for the configuration
+     * @param contactDependentFiring whether machines fire only on contact
+     * @param useKiller whether to add a TypeSixMachineCellKiller
+     */
+    template<unsigned DIM>
+    void RunBenchmark(const std::string& rLabel, bool contactDependentFiring, bool useKiller)
+    {
+        RandomNumberGenerator::Instance()->Reseed(0);
+
+        std::vector<Node<DIM>*> nodes;
+        nodes.push_back(new Node<DIM>(0u, zero_vector<double>(DIM)));
+
+        std::vector<unsigned> targets;
+        for (unsigned target = 10; target <= 100000; target *= 10)
+        {
+            targets.push_back(target);
+        }
+
+        // Size the boxes to the largest colony; the mesh enlarges them if it grows further
+        NodesOnlyMesh<DIM> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+        double colony_radius = GetColonyRadius<DIM>(targets.back());
+        c_vector<double, 2*DIM> domain_size;
+        for (unsigned i=0; i<DIM; i++)
+        {
+            domain_size[2*i] = -colony_radius;
+            domain_size[2*i+1] = colony_radius;
+        }
+        mesh.SetInitialBoxCollection(domain_size, 10.0);
+
+        mesh.GetNode(0u)->AddNodeAttribute(0.0);
+        mesh.GetNode(0u)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_THETA] = 0.0;
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_PHI] = 0.5*M_PI;
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+
+        std::vector<CellPtr> cells;
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+
+        UniformCellCycleModel* p_model = new UniformCellCycleModel();
+        p_model->SetMinCellCycleDuration(1.0);
+        p_model->SetMaxCellCycleDuration(1.6);
+        CellPtr p_cell(new Cell(p_state, p_model));
+        p_cell->SetCellProliferativeType(p_type);
+
+        // Machines are described by one angle in 2D and two in 3D
+        std::vector<double> machine_angles;
+        machine_angles.push_back(0.0);
+        if (DIM == 3)
+        {
+            machine_angles.push_back(0.0);
+        }
+        MAKE_PTR(TypeSixMachineProperty, p_property);
+        p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(1u, machine_angles));
+        p_cell->AddCellProperty(p_property);
+
+        p_cell->SetBirthTime(-0.9);
+        mesh.GetNode(0u)->rGetNodeAttributes()[NA_LENGTH] = 2.0 + 3.0*p_cell->GetBirthTime()/p_model->GetCellCycleDuration();
+        cells.push_back(p_cell);
+
+        NodeBasedCellPopulationWithCapsules<DIM> population(mesh, cells);
+
+        boost::shared_ptr<AbstractCentreBasedDivisionRule<DIM,DIM> > p_division_rule(new CapsuleBasedDivisionRule<DIM,DIM>());
+        population.SetCentreBasedDivisionRule(p_division_rule);
+
+        std::string output_directory = "CapsuleColonyScalingBenchmark/" + rLabel;
+        OutputFileHandler handler("CapsuleColonyScalingBenchmark", false);
+        out_stream p_file = handler.OpenOutputFile(rLabel + ".dat");
+
+        // Measure the peak of this configuration alone, or fall back to the current value
+        bool report_peak = ResetPeakResidentSetSize();
+        *p_file << "label\tdim\ttarget\tnum_cells\ttime\tsteps\twall_s\tsteps_per_s"
+                << "\tforce_s\tposition_s\tupdate_s\tbirth_s\tdeath_s\toutput_s"
+                << (report_peak ? "\tpeak_rss_kb" : "\trss_kb") << "\tnum_pairs\n";
+
+        CapsuleScalingBenchmarkSimulation<DIM> simulator(population, targets, rLabel, p_file, report_peak);
+        simulator.SetOutputDirectory(output_directory);
+        double dt = 1.0/1200.0;
+        simulator.SetDt(dt);
+
+        // Keep results output out of the measurement as far as possible
+        simulator.SetSamplingTimestepMultiple(120000);
+
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsules<DIM,DIM>>();
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<CapsuleForce<DIM>>();
+        p_capsule_force->SetYoungModulus(200.0);
+        simulator.AddForce(p_capsule_force);
+
+        if (useKiller)
+        {
+            MAKE_PTR_ARGS(TypeSixMachineCellKiller<DIM>, p_killer, (&population));
+            simulator.AddCellKiller(p_killer);
+        }
+
+        // No output directory is set, so no machine files are written during the measurement
+        MAKE_PTR(TypeSixMachineModifier<DIM>, p_modifier);
+        p_modifier->SetMachineParametersFromGercEtAl();
+        if (contactDependentFiring)
+        {
+            p_modifier->SetContactDependentFiring();
+        }
+        simulator.AddSimulationModifier(p_modifier);
+
+        // Without the killer 100k cells take about 17 doublings; allow for slower growth with it
+        simulator.SetEndTime(40.0);
+
+        CellBasedEventHandler::Reset();
+        simulator.Solve();
+        simulator.WriteFinalRow();
+        p_file->close();
+
+        CellBasedEventHandler::Headings();
+        CellBasedEventHandler::Report();
+
+        TS_ASSERT_LESS_THAN(0u, population.GetNumRealCells());
+    }
+
+public:
+
+    void Test2dGercNoKiller()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmark<2>("2d_gerc_no_killer", false, false);
+    }
+
+    void Test2dGercWithKiller()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmark<2>("2d_gerc_killer", false, true);
+    }
+
+    void Test2dContactDependentNoKiller()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmark<2>("2d_contact_no_killer", true, false);
+    }
+
+    void Test2dContactDependentWithKiller()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmark<2>("2d_contact_killer", true, true);
+    }
+
+    void Test3dGercNoKiller()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmark<3>("3d_gerc_no_killer", false, false);
+    }
+
+    void Test3dGercWithKiller()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmark<3>("3d_gerc_killer", false, true);
+    }
+
+    void Test3dContactDependentNoKiller()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmark<3>("3d_contact_no_killer", true, false);
+    }
+
+    void Test3dContactDependentWithKiller()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmark<3>("3d_contact_killer", true, true);
+    }
+};
+
+#endif /*TESTCAPSULECOLONYSCALINGBENCHMARK_HPP_*/
@@ -0,0 +1,241 @@
+#ifndef TESTCAPSULECOLONYSTATISTICSMODIFIER_HPP_
+#define TESTCAPSULECOLONYSTATISTICSMODIFIER_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <fstream>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "CellsGenerator.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "NoCellCycleModel.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "OutputFileHandler.hpp"
+#include "SmartPointers.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "CapsuleColonyStatisticsModifier.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleColonyStatisticsModifier : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestStatistics2d()
+    {
+        EXIT_IF_PARALLEL;
+
+        // Four parallel capsules at the corners of a square, with lengths 1 to 4
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, Create_c_vector(-1.0, -1.0)));
+        nodes.push_back(new Node<2>(1u, Create_c_vector(1.0, -1.0)));
+        nodes.push_back(new Node<2>(2u, Create_c_vector(1.0, 1.0)));
+        nodes.push_back(new Node<2>(3u, Create_c_vector(-1.0, 1.0)));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            mesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = (node_idx%2 == 0) ? 0.3 : 0.3 + M_PI;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 1.0 + node_idx;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        for (unsigned i=0; i<cells.size(); i++)
+        {
+            std::vector<double> machine_angles;
+            machine_angles.push_back(0.0);
+            MAKE_PTR(TypeSixMachineProperty, p_property);
+            p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(i%2, machine_angles));
+            cells[i]->AddCellProperty(p_property);
+        }
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        CapsuleColonyStatisticsModifier<2> modifier;
+        modifier.SetNumMachineStates(3u);
+        modifier.SetLengthHistogramBins(4u, 0.5, 4.5);
+        modifier.ComputeStatistics(population);
+
+        TS_ASSERT_EQUALS(modifier.GetNumCells(), 4u);
+        TS_ASSERT_EQUALS(modifier.GetNumBirths(), 0u);
+        TS_ASSERT_EQUALS(modifier.GetNumDeaths(), 0u);
+
+        TS_ASSERT_EQUALS(modifier.rGetMachineStateHistogram().size(), 3u);
+        TS_ASSERT_EQUALS(modifier.rGetMachineStateHistogram()[0], 2u);
+        TS_ASSERT_EQUALS(modifier.rGetMachineStateHistogram()[1], 2u);
+        TS_ASSERT_EQUALS(modifier.rGetMachineStateHistogram()[2], 0u);
+
+        // Head-tail symmetric alignment gives perfect nematic order
+        TS_ASSERT_DELTA(modifier.GetNematicOrder(), 1.0, 1e-9);
+
+        TS_ASSERT_DELTA(modifier.GetRadiusOfGyration(), sqrt(2.0), 1e-9);
+        TS_ASSERT_DELTA(modifier.GetRadialExtent(), sqrt(2.0), 1e-9);
+
+        TS_ASSERT_DELTA(modifier.GetMeanLength(), 2.5, 1e-9);
+        TS_ASSERT_DELTA(modifier.GetLengthStandardDeviation(), sqrt(1.25), 1e-9);
+
+        TS_ASSERT_EQUALS(modifier.rGetLengthHistogram().size(), 4u);
+        for (unsigned bin=0; bin<4; bin++)
+        {
+            TS_ASSERT_EQUALS(modifier.rGetLengthHistogram()[bin], 1u);
+        }
+
+        // Perpendicular capsules have no nematic order in 2D
+        mesh.GetNode(1u)->rGetNodeAttributes()[NA_THETA] = 0.3 + 0.5*M_PI;
+        mesh.GetNode(3u)->rGetNodeAttributes()[NA_THETA] = 0.3 + 0.5*M_PI;
+        modifier.ComputeStatistics(population);
+        TS_ASSERT_DELTA(modifier.GetNematicOrder(), 0.0, 1e-9);
+
+        // The spread is unchanged for a colony far from the origin
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->rGetModifiableLocation()[0] += 1e8;
+        }
+        modifier.ComputeStatistics(population);
+        TS_ASSERT_DELTA(modifier.GetRadiusOfGyration(), sqrt(2.0), 1e-6);
+        TS_ASSERT_DELTA(modifier.GetRadialExtent(), sqrt(2.0), 1e-6);
+
+        TS_ASSERT_THROWS_THIS(modifier.SetLengthHistogramBins(0u, 0.0, 1.0),
+            "The length histogram needs at least one bin and maxLength > minLength");
+        TS_ASSERT_THROWS_THIS(modifier.SetSamplingTimestepMultiple(0u),
+            "The sampling timestep multiple must be positive");
+    }
+
+    void TestStatistics3d()
+    {
+        EXIT_IF_PARALLEL;
+
+        // Two capsules along x and two along y
+        std::vector<Node<3>*> nodes;
+        nodes.push_back(new Node<3>(0u, Create_c_vector(0.0, 0.0, 0.0)));
+        nodes.push_back(new Node<3>(1u, Create_c_vector(3.0, 0.0, 0.0)));
+        nodes.push_back(new Node<3>(2u, Create_c_vector(0.0, 3.0, 0.0)));
+        nodes.push_back(new Node<3>(3u, Create_c_vector(3.0, 3.0, 0.0)));
+
+        NodesOnlyMesh<3> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            mesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = (node_idx < 2) ? 0.0 : 0.5*M_PI;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_PHI] = 0.5*M_PI;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 3> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<3> population(mesh, cells);
+
+        CapsuleColonyStatisticsModifier<3> modifier;
+        modifier.ComputeStatistics(population);
+
+        // <u u^T> = diag(1/2, 1/2, 0), so Q = diag(1/4, 1/4, -1/2)
+        TS_ASSERT_DELTA(modifier.GetNematicOrder(), 0.25, 1e-9);
+        TS_ASSERT_DELTA(modifier.GetRadialExtent(), 1.5*sqrt(2.0), 1e-9);
+        TS_ASSERT_DELTA(modifier.GetMeanLength(), 2.0, 1e-9);
+        TS_ASSERT_DELTA(modifier.GetLengthStandardDeviation(), 0.0, 1e-9);
+
+        // Cells without a TypeSixMachineProperty contribute no machines
+        for (unsigned state=0; state<modifier.GetNumMachineStates(); state++)
+        {
+            TS_ASSERT_EQUALS(modifier.rGetMachineStateHistogram()[state], 0u);
+        }
+
+        // Aligned along z
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_PHI] = (node_idx%2 == 0) ? 0.0 : M_PI;
+        }
+        modifier.ComputeStatistics(population);
+        TS_ASSERT_DELTA(modifier.GetNematicOrder(), 1.0, 1e-9);
+    }
+
+    void TestStatisticsFileInSimulation()
+    {
+        EXIT_IF_PARALLEL;
+
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, Create_c_vector(4.0, 4.0)));
+        nodes.push_back(new Node<2>(1u, Create_c_vector(4.0, 5.0)));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            mesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = 0.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestStatisticsFileInSimulation");
+        simulator.SetDt(1.0/1200.0);
+        simulator.SetSamplingTimestepMultiple(1000);
+        simulator.SetEndTime(100.0/1200.0);
+
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsules<2,2>>();
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<CapsuleForce<2>>();
+        simulator.AddForce(p_capsule_force);
+
+        MAKE_PTR(CapsuleColonyStatisticsModifier<2>, p_modifier);
+        p_modifier->SetSamplingTimestepMultiple(10);
+        simulator.AddSimulationModifier(p_modifier);
+
+        simulator.Solve();
+
+        // One heading line, one row at time zero and one per sampling step
+        OutputFileHandler handler("TestStatisticsFileInSimulation/results_from_time_0", false);
+        std::ifstream file((handler.GetOutputDirectoryFullPath() + "colonystatistics.dat").c_str());
+        TS_ASSERT(file.is_open());
+
+        unsigned num_lines = 0;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            num_lines++;
+        }
+        TS_ASSERT_EQUALS(num_lines, 12u);
+        TS_ASSERT_EQUALS(p_modifier->GetNumCells(), 2u);
+    }
+};
+
+#endif /*TESTCAPSULECOLONYSTATISTICSMODIFIER_HPP_*/
@@ -0,0 +1,89 @@
+#ifndef TESTCAPSULECONTACTISLANDS_HPP_
+#define TESTCAPSULECONTACTISLANDS_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "CapsulePopulationBuilder.hpp"
+#include "CapsuleContactIslands.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleContactIslands : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestIslandsOfFiveCapsules()
+    {
+        EXIT_IF_PARALLEL;
+
+        // Two overlapping pairs, and a capsule 0.5 beyond the tip of the first pair
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(0.0, 0.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(10.0, 0.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(0.0, 0.9), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(3.5, 0.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(10.0, 0.9), 0.0, 0.0, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 4.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        population.Update();
+
+        CapsuleContactIslands<2> islands;
+        TS_ASSERT_DELTA(islands.GetContactTolerance(), 0.0, 1e-12);
+        TS_ASSERT_EQUALS(islands.GetNumIslands(), 0u);
+
+        TS_ASSERT_EQUALS(islands.Compute(population), 3u);
+        TS_ASSERT_EQUALS(islands.GetNumIslands(), 3u);
+        TS_ASSERT_EQUALS(islands.GetNumContacts(), 2u);
+
+        // Islands are numbered by their first node
+        TS_ASSERT_EQUALS(islands.GetIslandOfNode(0u), 0u);
+        TS_ASSERT_EQUALS(islands.GetIslandOfNode(1u), 1u);
+        TS_ASSERT_EQUALS(islands.GetIslandOfNode(2u), 0u);
+        TS_ASSERT_EQUALS(islands.GetIslandOfNode(3u), 2u);
+        TS_ASSERT_EQUALS(islands.GetIslandOfNode(4u), 1u);
+        TS_ASSERT_EQUALS(islands.GetIslandSize(0u), 2u);
+        TS_ASSERT_EQUALS(islands.GetIslandSize(2u), 1u);
+
+        const std::vector<unsigned>& r_offsets = islands.rGetIslandOffsets();
+        const std::vector<unsigned>& r_indices = islands.rGetIslandNodeIndices();
+        TS_ASSERT_EQUALS(r_offsets.size(), 4u);
+        TS_ASSERT_EQUALS(r_offsets[3], 5u);
+        TS_ASSERT_EQUALS(r_indices[r_offsets[1]], 1u);
+        TS_ASSERT_EQUALS(r_indices[r_offsets[1] + 1], 4u);
+        TS_ASSERT_EQUALS(r_indices[r_offsets[2]], 3u);
+
+        TS_ASSERT_THROWS_THIS(islands.GetIslandOfNode(5u),
+            "Node 5 was not in the population when the islands were computed");
+
+        // With a tolerance larger than the gap the third capsule joins the first island
+        TS_ASSERT_THROWS_THIS(islands.SetContactTolerance(-1.0),
+            "The contact tolerance must be non-negative");
+        islands.SetContactTolerance(0.6);
+        TS_ASSERT_EQUALS(islands.Compute(population), 2u);
+        TS_ASSERT_EQUALS(islands.GetNumContacts(), 3u);
+        TS_ASSERT_EQUALS(islands.GetIslandOfNode(3u), 0u);
+        TS_ASSERT_EQUALS(islands.GetIslandSize(0u), 3u);
+        TS_ASSERT_EQUALS(islands.rGetIslandOffsets().size(), 3u);
+    }
+};
+
+#endif /*TESTCAPSULECONTACTISLANDS_HPP_*/
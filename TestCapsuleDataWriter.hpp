@@ -0,0 +1,195 @@
+#ifndef TESTCAPSULEDATAWRITER_HPP_
+#define TESTCAPSULEDATAWRITER_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "CellsGenerator.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "NoCellCycleModel.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OutputFileHandler.hpp"
+#include "SmartPointers.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "CapsuleDataWriter.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleDataWriter : public AbstractCellBasedTestSuite
+{
+private:
+
+    /**
+     * Read back the single line written for one time step.
+     *
+     * @param rDirectory the output directory
+     * @param rValues filled with the values after the time stamp
+     */
+    void ReadLine(const std::string& rDirectory, std::vector<double>& rValues)
+    {
+        OutputFileHandler handler(rDirectory, false);
+        std::ifstream file((handler.GetOutputDirectoryFullPath() + "capsuledata.dat").c_str());
+        TS_ASSERT(file.is_open());
+
+        std::string line;
+        std::getline(file, line);
+        std::stringstream line_stream(line);
+
+        double time;
+        line_stream >> time;
+        TS_ASSERT_DELTA(time, 0.0, 1e-12);
+
+        rValues.clear();
+        double value;
+        while (line_stream >> value)
+        {
+            rValues.push_back(value);
+        }
+    }
+
+public:
+
+    void TestColumnSelection()
+    {
+        CapsuleDataWriter<2,2> writer;
+
+        TS_ASSERT(writer.IsColumnIncluded(CapsuleDataWriter<2,2>::LOCATION));
+        TS_ASSERT(writer.IsColumnIncluded(CapsuleDataWriter<2,2>::ORIENTATION));
+        TS_ASSERT(writer.IsColumnIncluded(CapsuleDataWriter<2,2>::LENGTH));
+        TS_ASSERT(writer.IsColumnIncluded(CapsuleDataWriter<2,2>::RADIUS));
+        TS_ASSERT(writer.IsColumnIncluded(CapsuleDataWriter<2,2>::MACHINE_STATE_COUNTS));
+        TS_ASSERT_EQUALS(writer.GetNumMachineStates(), 6u);
+
+        writer.SetColumnIncluded(CapsuleDataWriter<2,2>::RADIUS, false);
+        TS_ASSERT(!writer.IsColumnIncluded(CapsuleDataWriter<2,2>::RADIUS));
+        TS_ASSERT(writer.IsColumnIncluded(CapsuleDataWriter<2,2>::LENGTH));
+
+        writer.SetColumnIncluded(CapsuleDataWriter<2,2>::RADIUS, true);
+        TS_ASSERT(writer.IsColumnIncluded(CapsuleDataWriter<2,2>::RADIUS));
+
+        TS_ASSERT_THROWS_THIS(writer.SetNumMachineStates(0u),
+            "The number of machine states must be positive");
+    }
+
+    void TestWriterOutput3d()
+    {
+        EXIT_IF_PARALLEL;
+
+        std::vector<Node<3>*> nodes;
+        nodes.push_back(new Node<3>(0u, Create_c_vector(1.0, 2.0, 3.0)));
+        nodes.push_back(new Node<3>(1u, Create_c_vector(4.0, 5.0, 6.0)));
+
+        NodesOnlyMesh<3> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            mesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = 0.25;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_PHI] = 0.5;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 2.0 + node_idx;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 3> cells_generator;
+        cells_generator.GenerateBasicRandom(cells, mesh.GetNumNodes(), p_diff_type);
+
+        // Cell 0 has two machines in state 1 and one in state 2; cell 1 has none
+        std::vector<double> machine_coordinates;
+        machine_coordinates.push_back(0.0);
+        machine_coordinates.push_back(0.0);
+        MAKE_PTR(TypeSixMachineProperty, p_property);
+        p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(1u, machine_coordinates));
+        p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(1u, machine_coordinates));
+        p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(2u, machine_coordinates));
+        cells[0]->AddCellProperty(p_property);
+
+        NodeBasedCellPopulationWithCapsules<3> population(mesh, cells);
+
+        // Write all columns
+        {
+            std::string output_directory = "TestCapsuleDataWriter3dAllColumns";
+            OutputFileHandler output_file_handler(output_directory, true);
+
+            CapsuleDataWriter<3,3> writer;
+            writer.SetNumMachineStates(3u);
+            writer.OpenOutputFile(output_file_handler);
+            writer.WriteTimeStamp();
+            for (AbstractCellPopulation<3>::Iterator cell_iter = population.Begin();
+                 cell_iter != population.End();
+                 ++cell_iter)
+            {
+                writer.VisitCell(*cell_iter, &population);
+            }
+            writer.WriteNewline();
+            writer.CloseFile();
+
+            // Index, id, x, y, z, theta, phi, length, radius and three counts per cell
+            std::vector<double> values;
+            ReadLine(output_directory, values);
+            TS_ASSERT_EQUALS(values.size(), 24u);
+
+            TS_ASSERT_DELTA(values[0], 0.0, 1e-9);
+            TS_ASSERT_DELTA(values[2], 1.0, 1e-9);
+            TS_ASSERT_DELTA(values[3], 2.0, 1e-9);
+            TS_ASSERT_DELTA(values[4], 3.0, 1e-9);
+            TS_ASSERT_DELTA(values[5], 0.25, 1e-9);
+            TS_ASSERT_DELTA(values[6], 0.5, 1e-9);
+            TS_ASSERT_DELTA(values[7], 2.0, 1e-9);
+            TS_ASSERT_DELTA(values[8], 0.5, 1e-9);
+            TS_ASSERT_DELTA(values[9], 0.0, 1e-9);
+            TS_ASSERT_DELTA(values[10], 2.0, 1e-9);
+            TS_ASSERT_DELTA(values[11], 1.0, 1e-9);
+
+            TS_ASSERT_DELTA(values[12], 1.0, 1e-9);
+            TS_ASSERT_DELTA(values[19], 3.0, 1e-9);
+            TS_ASSERT_DELTA(values[21], 0.0, 1e-9);
+            TS_ASSERT_DELTA(values[22], 0.0, 1e-9);
+            TS_ASSERT_DELTA(values[23], 0.0, 1e-9);
+
+            TS_ASSERT_DELTA(writer.GetCellDataForVtkOutput(population.GetCellUsingLocationIndex(1u), &population), 3.0, 1e-9);
+        }
+
+        // Write only the lengths
+        {
+            std::string output_directory = "TestCapsuleDataWriter3dLengthOnly";
+            OutputFileHandler output_file_handler(output_directory, true);
+
+            CapsuleDataWriter<3,3> writer;
+            writer.SetColumnIncluded(CapsuleDataWriter<3,3>::LOCATION, false);
+            writer.SetColumnIncluded(CapsuleDataWriter<3,3>::ORIENTATION, false);
+            writer.SetColumnIncluded(CapsuleDataWriter<3,3>::RADIUS, false);
+            writer.SetColumnIncluded(CapsuleDataWriter<3,3>::MACHINE_STATE_COUNTS, false);
+            writer.OpenOutputFile(output_file_handler);
+            writer.WriteTimeStamp();
+            for (AbstractCellPopulation<3>::Iterator cell_iter = population.Begin();
+                 cell_iter != population.End();
+                 ++cell_iter)
+            {
+                writer.VisitCell(*cell_iter, &population);
+            }
+            writer.WriteNewline();
+            writer.CloseFile();
+
+            std::vector<double> values;
+            ReadLine(output_directory, values);
+            TS_ASSERT_EQUALS(values.size(), 6u);
+            TS_ASSERT_DELTA(values[2], 2.0, 1e-9);
+            TS_ASSERT_DELTA(values[5], 3.0, 1e-9);
+        }
+    }
+};
+
+#endif /*TESTCAPSULEDATAWRITER_HPP_*/
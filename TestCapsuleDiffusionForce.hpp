@@ -0,0 +1,210 @@
+#ifndef TESTCAPSULEDIFFUSIONFORCE_HPP_
+#define TESTCAPSULEDIFFUSIONFORCE_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <cmath>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "SimulationTime.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "CapsulePopulationBuilder.hpp"
+#include "CapsuleDiffusionForce.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleDiffusionForce : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestDiffusionCoefficients()
+    {
+        CapsuleDiffusionForce<2> force;
+
+        TS_ASSERT_DELTA(force.GetAbsoluteTemperature(), 296.0, 1e-12);
+        TS_ASSERT_DELTA(force.GetViscosity(), 3.204e-6, 1e-15);
+        TS_ASSERT_THROWS_THIS(force.SetAbsoluteTemperature(-1.0),
+            "The absolute temperature must be non-negative");
+        TS_ASSERT_THROWS_THIS(force.SetViscosity(0.0),
+            "The viscosity must be positive");
+
+        double d_parallel;
+        double d_perpendicular;
+        double d_rotational;
+
+        // A capsule of zero length is close to a sphere
+        double stokes_einstein = CapsuleDiffusionForce<2>::BOLTZMANN_CONSTANT*296.0/(6.0*M_PI*3.204e-6*0.5);
+        force.CalculateDiffusionCoefficients(0.0, 0.5, d_parallel, d_perpendicular, d_rotational);
+        TS_ASSERT_DELTA(d_parallel/stokes_einstein, 1.0, 0.06);
+        TS_ASSERT_DELTA(d_perpendicular/stokes_einstein, 1.0, 0.06);
+
+        // A rod moves more easily along its axis, and turns more slowly as it grows
+        double d_rotational_short;
+        force.CalculateDiffusionCoefficients(2.0, 0.5, d_parallel, d_perpendicular, d_rotational_short);
+        TS_ASSERT_LESS_THAN(d_perpendicular, d_parallel);
+        force.CalculateDiffusionCoefficients(4.0, 0.5, d_parallel, d_perpendicular, d_rotational);
+        TS_ASSERT_LESS_THAN(d_rotational, d_rotational_short);
+
+        // Coefficients scale with temperature
+        force.SetAbsoluteTemperature(0.0);
+        force.CalculateDiffusionCoefficients(2.0, 0.5, d_parallel, d_perpendicular, d_rotational);
+        TS_ASSERT_DELTA(d_parallel, 0.0, 1e-12);
+        TS_ASSERT_DELTA(d_rotational, 0.0, 1e-12);
+    }
+
+    void TestNoiseStatisticsIn2d()
+    {
+        EXIT_IF_PARALLEL;
+
+        SimulationTime::Instance()->SetEndTimeAndNumberOfTimeSteps(1.0, 1200);
+        RandomNumberGenerator::Instance()->Reseed(0);
+
+        // A single capsule along the x axis
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(0.0, 0.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        CapsuleDiffusionForce<2> force;
+        double d_parallel;
+        double d_perpendicular;
+        double d_rotational;
+        force.CalculateDiffusionCoefficients(2.0, 0.5, d_parallel, d_perpendicular, d_rotational);
+
+        const double dt = 1.0/1200.0;
+        const double damping = population.GetDampingConstant(0u);
+        const double expected_variance_x = damping*damping*2.0*d_parallel/dt;
+        const double expected_variance_y = damping*damping*2.0*d_perpendicular/dt;
+        ForwardEulerNumericalMethodForCapsules<2,2> numerical_method;
+        const double moment_of_inertia = numerical_method.CalculateMomentOfInertiaOfCapsule(2.0, 0.5);
+        const double expected_variance_torque = moment_of_inertia*moment_of_inertia*2.0*d_rotational/dt;
+
+        // Sample moments of the random force and torque
+        const unsigned num_samples = 20000;
+        double sum[3] = {0.0, 0.0, 0.0};
+        double sum_of_squares[3] = {0.0, 0.0, 0.0};
+        Node<2>* p_node = population.GetNode(0u);
+        for (unsigned i=0; i<num_samples; i++)
+        {
+            p_node->ClearAppliedForce();
+            p_node->rGetNodeAttributes()[NA_APPLIED_THETA] = 0.0;
+            force.AddForceContribution(population);
+
+            double values[3] = {p_node->rGetAppliedForce()[0],
+                                p_node->rGetAppliedForce()[1],
+                                p_node->rGetNodeAttributes()[NA_APPLIED_THETA]};
+            for (unsigned j=0; j<3; j++)
+            {
+                sum[j] += values[j];
+                sum_of_squares[j] += values[j]*values[j];
+            }
+        }
+
+        double expected_variances[3] = {expected_variance_x, expected_variance_y, expected_variance_torque};
+        for (unsigned j=0; j<3; j++)
+        {
+            double mean = sum[j]/num_samples;
+            double variance = sum_of_squares[j]/num_samples - mean*mean;
+            TS_ASSERT_DELTA(mean/sqrt(expected_variances[j]), 0.0, 0.05);
+            TS_ASSERT_DELTA(variance/expected_variances[j], 1.0, 0.05);
+        }
+    }
+
+    void TestFreeCapsuleDiffusionIn2d()
+    {
+        EXIT_IF_PARALLEL;
+
+        RandomNumberGenerator::Instance()->Reseed(0);
+
+        // Free capsules along the x axis, far enough apart never to meet
+        const unsigned num_per_side = 30;
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        for (unsigned i=0; i<num_per_side; i++)
+        {
+            for (unsigned j=0; j<num_per_side; j++)
+            {
+                builder.AddCapsule(Create_c_vector(10.0*i, 10.0*j), 0.0, 0.0, 2.0, 0.5, -0.5);
+            }
+        }
+        builder.SetCellCycleModelInitialiser([](UniformCellCycleModel* pModel, unsigned)
+        {
+            pModel->SetMinCellCycleDuration(100.0);
+            pModel->SetMaxCellCycleDuration(101.0);
+        });
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        const unsigned num_capsules = population.GetNumNodes();
+        std::vector<c_vector<double, 2> > start_locations(num_capsules);
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            start_locations[i] = population.GetNode(i)->rGetLocation();
+        }
+
+        // Short enough that the axes stay close to the x axis
+        const double dt = 1.0/1200.0;
+        const double end_time = 12.0*dt;
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestFreeCapsuleDiffusionIn2d");
+        simulator.SetDt(dt);
+        simulator.SetSamplingTimestepMultiple(12);
+        simulator.SetEndTime(end_time);
+
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsules<2,2>>();
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_force = boost::make_shared<CapsuleDiffusionForce<2>>();
+        simulator.AddForce(p_force);
+
+        simulator.Solve();
+
+        double d_parallel;
+        double d_perpendicular;
+        double d_rotational;
+        p_force->CalculateDiffusionCoefficients(2.0, 0.5, d_parallel, d_perpendicular, d_rotational);
+
+        double sum_of_squares_parallel = 0.0;
+        double sum_of_squares_perpendicular = 0.0;
+        double sum_of_squares_theta = 0.0;
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            c_vector<double, 2> displacement = population.GetNode(i)->rGetLocation() - start_locations[i];
+            double rotation = population.GetNode(i)->rGetNodeAttributes()[NA_THETA];
+            sum_of_squares_parallel += displacement[0]*displacement[0];
+            sum_of_squares_perpendicular += displacement[1]*displacement[1];
+            sum_of_squares_theta += rotation*rotation;
+        }
+
+        // Mean squared displacements over 900 capsules, to within about three standard errors
+        TS_ASSERT_DELTA(sum_of_squares_parallel/num_capsules/(2.0*d_parallel*end_time), 1.0, 0.15);
+        TS_ASSERT_DELTA(sum_of_squares_perpendicular/num_capsules/(2.0*d_perpendicular*end_time), 1.0, 0.15);
+        TS_ASSERT_DELTA(sum_of_squares_theta/num_capsules/(2.0*d_rotational*end_time), 1.0, 0.15);
+    }
+};
+
+#endif /*TESTCAPSULEDIFFUSIONFORCE_HPP_*/
@@ -0,0 +1,100 @@
+#ifndef TESTCAPSULEFIRERELAXATION_HPP_
+#define TESTCAPSULEFIRERELAXATION_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "CapsulePopulationBuilder.hpp"
+#include "CapsuleFireRelaxation.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleFireRelaxation : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestParameters()
+    {
+        CapsuleFireRelaxation<2> relaxation;
+
+        TS_ASSERT_DELTA(relaxation.GetInitialTimeStep(), 1.0/1200.0, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetMaxTimeStep(), 10.0/1200.0, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetMaxDisplacement(), 0.05, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetForceTolerance(), 1e-3, 1e-12);
+        TS_ASSERT_EQUALS(relaxation.GetMaxIterations(), 10000u);
+
+        relaxation.SetTimeSteps(0.01, 0.1);
+        relaxation.SetMaxDisplacement(0.1);
+        relaxation.SetForceTolerance(1e-4);
+        relaxation.SetMaxIterations(500u);
+
+        TS_ASSERT_DELTA(relaxation.GetInitialTimeStep(), 0.01, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetMaxTimeStep(), 0.1, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetMaxDisplacement(), 0.1, 1e-12);
+        TS_ASSERT_DELTA(relaxation.GetForceTolerance(), 1e-4, 1e-12);
+        TS_ASSERT_EQUALS(relaxation.GetMaxIterations(), 500u);
+
+        TS_ASSERT_THROWS_THIS(relaxation.SetTimeSteps(0.1, 0.01),
+            "The time steps must be positive, with the maximum no smaller than the initial time step");
+        TS_ASSERT_THROWS_THIS(relaxation.SetMaxDisplacement(0.0),
+            "The maximum displacement must be positive");
+        TS_ASSERT_THROWS_THIS(relaxation.SetForceTolerance(-1.0),
+            "The force tolerance must be positive");
+    }
+
+    void TestRelaxTwoOverlappingCapsules()
+    {
+        EXIT_IF_PARALLEL;
+
+        // Two parallel capsules of radius 0.5 whose centres are 0.6 apart
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(5.0, 4.7), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(5.0, 5.3), 0.0, 0.0, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OffLatticeSimulation<2> simulator(population);
+        auto p_capsule_force = boost::make_shared<CapsuleForce<2>>();
+        simulator.AddForce(p_capsule_force);
+
+        CapsuleFireRelaxation<2> relaxation;
+        unsigned num_iterations = relaxation.Relax(population, simulator.rGetForceCollection());
+
+        TS_ASSERT_LESS_THAN(num_iterations, relaxation.GetMaxIterations());
+        TS_ASSERT_LESS_THAN_EQUALS(relaxation.GetMaxResidual(), relaxation.GetForceTolerance());
+
+        // The capsules are pushed apart symmetrically until they no longer overlap
+        c_vector<double, 2> location_a = population.GetNode(0u)->rGetLocation();
+        c_vector<double, 2> location_b = population.GetNode(1u)->rGetLocation();
+        TS_ASSERT_LESS_THAN(0.999, location_b[1] - location_a[1]);
+        TS_ASSERT_LESS_THAN(location_b[1] - location_a[1], 1.1);
+        TS_ASSERT_DELTA(location_a[1] + location_b[1], 10.0, 1e-6);
+        TS_ASSERT_DELTA(location_a[0], 5.0, 1e-6);
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetNodeAttributes()[NA_THETA], 0.0, 1e-6);
+
+        // A relaxed configuration needs no further iterations
+        TS_ASSERT_EQUALS(relaxation.Relax(population, simulator.rGetForceCollection()), 0u);
+    }
+};
+
+#endif /*TESTCAPSULEFIRERELAXATION_HPP_*/
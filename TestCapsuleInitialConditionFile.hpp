@@ -0,0 +1,209 @@
+#ifndef TESTCAPSULEINITIALCONDITIONFILE_HPP_
+#define TESTCAPSULEINITIALCONDITIONFILE_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "OutputFileHandler.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "CapsulePopulationBuilder.hpp"
+#include "CapsuleInitialConditionFile.hpp"
+#include "CapsuleInitialConditionExportModifier.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleInitialConditionFile : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestExportAndLoadIn3d()
+    {
+        EXIT_IF_PARALLEL;
+
+        CapsulePopulationBuilder<UniformCellCycleModel, 3> builder;
+        builder.AddCapsule(Create_c_vector(1.0, 2.0, 3.0), 0.1, 0.2, 2.0, 0.5, -0.5);
+        builder.AddMachine(2u, std::vector<double>{0.3, -0.4});
+        builder.AddCapsule(Create_c_vector(4.0, 5.0, 6.0), 0.7, 0.8, 2.5, 0.45, -1.5);
+        builder.AddCapsule(Create_c_vector(7.0, 8.0, 9.0), 1.1, 1.2, 3.0, 0.4, -2.5);
+        builder.AddMachine(1u, std::vector<double>{1.0, 2.0});
+        builder.AddMachine(5u, std::vector<double>{-1.0, -2.0});
+
+        NodesOnlyMesh<3> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<3> population(mesh, cells);
+
+        OutputFileHandler handler("TestCapsuleInitialConditionFile");
+        std::string file_name = handler.GetOutputDirectoryFullPath() + "colony.bin";
+        CapsuleInitialConditionFile<3>::Export(population, file_name);
+
+        CapsulePopulationBuilder<UniformCellCycleModel, 3> loaded_builder;
+        TS_ASSERT_DELTA(CapsuleInitialConditionFile<3>::Load(file_name, loaded_builder), 0.0, 1e-12);
+        TS_ASSERT_EQUALS(loaded_builder.GetNumCapsules(), 3u);
+        TS_ASSERT_EQUALS(loaded_builder.GetNumMachines(), 3u);
+
+        NodesOnlyMesh<3> loaded_mesh;
+        loaded_builder.GenerateMesh(loaded_mesh, 100.0);
+        std::vector<CellPtr> loaded_cells;
+        loaded_builder.GenerateCells(loaded_cells, p_type);
+        NodeBasedCellPopulationWithCapsules<3> loaded_population(loaded_mesh, loaded_cells);
+
+        for (unsigned i=0; i<3; i++)
+        {
+            Node<3>* p_node = population.GetNode(i);
+            Node<3>* p_loaded_node = loaded_population.GetNode(i);
+            for (unsigned d=0; d<3; d++)
+            {
+                TS_ASSERT_DELTA(p_loaded_node->rGetLocation()[d], p_node->rGetLocation()[d], 1e-12);
+            }
+            TS_ASSERT_DELTA(p_loaded_node->rGetNodeAttributes()[NA_THETA], p_node->rGetNodeAttributes()[NA_THETA], 1e-12);
+            TS_ASSERT_DELTA(p_loaded_node->rGetNodeAttributes()[NA_PHI], p_node->rGetNodeAttributes()[NA_PHI], 1e-12);
+            TS_ASSERT_DELTA(p_loaded_node->rGetNodeAttributes()[NA_LENGTH], p_node->rGetNodeAttributes()[NA_LENGTH], 1e-12);
+            TS_ASSERT_DELTA(p_loaded_node->rGetNodeAttributes()[NA_RADIUS], p_node->rGetNodeAttributes()[NA_RADIUS], 1e-12);
+            TS_ASSERT_DELTA(loaded_cells[i]->GetBirthTime(), cells[i]->GetBirthTime(), 1e-12);
+        }
+
+        CellPropertyCollection empty_collection = loaded_cells[1]->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+        boost::shared_ptr<TypeSixMachineProperty> p_empty_property = boost::static_pointer_cast<TypeSixMachineProperty>(empty_collection.GetProperty());
+        TS_ASSERT(p_empty_property->rGetMachineData().empty());
+        CellPropertyCollection collection = loaded_cells[2]->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+        boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+        std::vector<std::pair<unsigned, std::vector<double>> >& r_data = p_property->rGetMachineData();
+        TS_ASSERT_EQUALS(r_data.size(), 2u);
+        TS_ASSERT_EQUALS(r_data[1].first, 5u);
+        TS_ASSERT_DELTA(r_data[1].second[0], -1.0, 1e-12);
+        TS_ASSERT_DELTA(r_data[1].second[1], -2.0, 1e-12);
+
+        // Files of the wrong dimension, size or type are rejected
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder_2d;
+        TS_ASSERT_THROWS_THIS(CapsuleInitialConditionFile<2>::Load(file_name, builder_2d),
+            "Initial condition file " + file_name + " has the wrong dimension");
+
+        std::ifstream in_file(file_name.c_str(), std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(in_file)), std::istreambuf_iterator<char>());
+        in_file.close();
+
+        std::string truncated_name = handler.GetOutputDirectoryFullPath() + "truncated.bin";
+        std::ofstream truncated_file(truncated_name.c_str(), std::ios::binary);
+        truncated_file << contents.substr(0, contents.size() - 4);
+        truncated_file.close();
+        TS_ASSERT_THROWS_THIS(CapsuleInitialConditionFile<3>::Load(truncated_name, loaded_builder),
+            "Initial condition file " + truncated_name + " has the wrong size");
+
+        // A huge capsule count in the header is rejected without overflowing the expected size
+        std::string hostile_name = handler.GetOutputDirectoryFullPath() + "hostile.bin";
+        std::string hostile_contents = contents;
+        uint64_t hostile_count = UINT64_C(1) << 62;
+        memcpy(&hostile_contents[24], &hostile_count, sizeof(hostile_count));
+        std::ofstream hostile_file(hostile_name.c_str(), std::ios::binary);
+        hostile_file << hostile_contents;
+        hostile_file.close();
+        TS_ASSERT_THROWS_THIS(CapsuleInitialConditionFile<3>::Load(hostile_name, loaded_builder),
+            "Initial condition file " + hostile_name + " has the wrong size");
+
+        std::string text_name = handler.GetOutputDirectoryFullPath() + "text.bin";
+        std::ofstream text_file(text_name.c_str(), std::ios::binary);
+        text_file << std::string(contents.size(), 'x');
+        text_file.close();
+        TS_ASSERT_THROWS_THIS(CapsuleInitialConditionFile<3>::Load(text_name, loaded_builder),
+            "Initial condition file " + text_name + " is not a capsule initial condition file");
+
+        TS_ASSERT_THROWS_THIS(CapsuleInitialConditionFile<3>::Load(file_name + ".missing", loaded_builder),
+            "Could not open initial condition file " + file_name + ".missing");
+    }
+
+    void TestExportModifier()
+    {
+        EXIT_IF_PARALLEL;
+
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(4.0, 4.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddMachine(1u, std::vector<double>(1u, 0.0));
+        builder.AddCapsule(Create_c_vector(4.0, 5.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.SetCellCycleModelInitialiser([](UniformCellCycleModel* pModel, unsigned)
+        {
+            pModel->SetMinCellCycleDuration(100.0);
+            pModel->SetMaxCellCycleDuration(101.0);
+        });
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestCapsuleInitialConditionExportModifier");
+        simulator.SetDt(1.0/1200.0);
+        simulator.SetSamplingTimestepMultiple(10);
+        simulator.SetEndTime(20.0/1200.0);
+
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsules<2,2>>();
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<CapsuleForce<2>>();
+        simulator.AddForce(p_capsule_force);
+
+        MAKE_PTR(CapsuleInitialConditionExportModifier<2>, p_modifier);
+        TS_ASSERT_THROWS_THIS(p_modifier->SetExportTimestepMultiple(0u),
+            "The export timestep multiple must be positive");
+        p_modifier->SetExportTimestepMultiple(10u);
+        TS_ASSERT_EQUALS(p_modifier->GetExportTimestepMultiple(), 10u);
+        TS_ASSERT(p_modifier->GetExportInitialState());
+        simulator.AddSimulationModifier(p_modifier);
+
+        simulator.Solve();
+
+        // Restart from the state at the final time step
+        OutputFileHandler handler("TestCapsuleInitialConditionExportModifier/results_from_time_0", false);
+        TS_ASSERT(handler.FindFile("initialconditions_0.bin").Exists());
+        TS_ASSERT(handler.FindFile("initialconditions_10.bin").Exists());
+        std::string file_name = handler.GetOutputDirectoryFullPath() + "initialconditions_20.bin";
+
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> loaded_builder;
+        double time = CapsuleInitialConditionFile<2>::Load(file_name, loaded_builder);
+        TS_ASSERT_DELTA(time, 20.0/1200.0, 1e-12);
+        TS_ASSERT_EQUALS(loaded_builder.GetNumCapsules(), 2u);
+        TS_ASSERT_EQUALS(loaded_builder.GetNumMachines(), 1u);
+
+        NodesOnlyMesh<2> loaded_mesh;
+        loaded_builder.GenerateMesh(loaded_mesh, 100.0);
+        std::vector<CellPtr> loaded_cells;
+        loaded_builder.GenerateCells(loaded_cells, p_type);
+
+        // Birth times are shifted so that cell ages are preserved
+        TS_ASSERT_DELTA(loaded_cells[0]->GetBirthTime(), -0.5 - 20.0/1200.0, 1e-12);
+        for (unsigned i=0; i<2; i++)
+        {
+            for (unsigned d=0; d<2; d++)
+            {
+                TS_ASSERT_DELTA(loaded_mesh.GetNode(i)->rGetLocation()[d], population.GetNode(i)->rGetLocation()[d], 1e-12);
+            }
+        }
+    }
+};
+
+#endif /*TESTCAPSULEINITIALCONDITIONFILE_HPP_*/
@@ -0,0 +1,424 @@
+#ifndef TESTCAPSULEKERNELBENCHMARKS_HPP_
+#define TESTCAPSULEKERNELBENCHMARKS_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OutputFileHandler.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "NoCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+/**
+ * Micro-benchmarks for the capsule geometry and force kernels.
+ *
+ * Each kernel is timed on seeded random inputs, over a small working set
+ * that stays in cache ("warm") and over a large working set visited in a
+ * shuffled order ("cold"). Pair kernels are timed separately for random,
+ * parallel, crossing, coincident-centre and pole-aligned configurations.
+ * Results are written as tab-separated rows of kernel, dimension, scenario,
+ * cache state, number of calls, ns per call, calls per second and number of
+ * non-finite results to CapsuleKernelBenchmarks/kernels_<dim>d.dat.
+ *
+ * This is a profiling test and is listed in ProfileTestPack.txt.
+ */
+class TestCapsuleKernelBenchmarks : public AbstractCellBasedTestSuite
+{
+private:
+
+    /** Number of items in the warm working set. */
+    static const unsigned NUM_WARM = 64u;
+
+    /** Number of items in the cold working set. */
+    static const unsigned NUM_COLD = 65536u;
+
+    /** Total number of kernel calls per measurement. */
+    static const unsigned NUM_CALLS = 1u << 22;
+
+    /** Accumulates kernel results so that the calls cannot be optimised away. */
+    volatile double mSink;
+
+    /**
+     * @param a the lower bound
+     * @param b the upper bound
+     * @return a uniform random number in [a, b)
+     */
+    double Uniform(double a, double b)
+    {
+        return a + (b - a)*RandomNumberGenerator::Instance()->ranf();
+    }
+
+    /**
+     * Set up a capsule node.
+     *
+     * @param rNode the node
+     * @param theta the azimuthal angle
+     * @param phi the polar angle, ignored in 2D
+     */
+    template<unsigned DIM>
+    void SetCapsuleAttributes(Node<DIM>& rNode, double theta, double phi)
+    {
+        rNode.AddNodeAttribute(0.0);
+        rNode.rGetNodeAttributes().resize(NA_VEC_LENGTH);
+        rNode.rGetNodeAttributes()[NA_THETA] = theta;
+        rNode.rGetNodeAttributes()[NA_PHI] = phi;
+        rNode.rGetNodeAttributes()[NA_LENGTH] = Uniform(1.0, 3.0);
+        rNode.rGetNodeAttributes()[NA_RADIUS] = 0.5;
+    }
+
+    /**
+     * Create pairs of capsule nodes in one of the benchmark configurations.
+     *
+     * @param rScenario "random", "parallel", "crossing", "coincident" or "pole"
+     * @param numPairs the number of pairs
+     * @param rNodes filled with 2*numPairs nodes, pair i at entries 2i and 2i+1
+     */
+    template<unsigned DIM>
+    void CreatePairs(const std::string& rScenario, unsigned numPairs, std::vector<Node<DIM>*>& rNodes)
+    {
+        for (unsigned i=0; i<numPairs; i++)
+        {
+            c_vector<double, DIM> centre_a;
+            c_vector<double, DIM> offset;
+            for (unsigned d=0; d<DIM; d++)
+            {
+                centre_a[d] = Uniform(0.0, 100.0);
+                offset[d] = Uniform(-2.0, 2.0);
+            }
+
+            double theta_a = Uniform(-M_PI, M_PI);
+            double phi_a = Uniform(0.0, M_PI);
+            double theta_b = Uniform(-M_PI, M_PI);
+            double phi_b = Uniform(0.0, M_PI);
+
+            if (rScenario == "parallel")
+            {
+                // Same axis, offset perpendicular to it
+                theta_b = theta_a;
+                phi_b = phi_a;
+                double separation = Uniform(0.5, 1.5);
+                offset = zero_vector<double>(DIM);
+                offset[0] = -sin(theta_a)*separation;
+                offset[1] = cos(theta_a)*separation;
+            }
+            else if (rScenario == "crossing")
+            {
+                // Perpendicular axes through nearby centres
+                theta_b = theta_a + 0.5*M_PI;
+                phi_b = 0.5*M_PI;
+                phi_a = 0.5*M_PI;
+                offset *= 0.1;
+            }
+            else if (rScenario == "coincident")
+            {
+                offset = zero_vector<double>(DIM);
+            }
+            else if (rScenario == "pole")
+            {
+                // Axes along the poles of the 3D parametrisation, or along the x axis in 2D
+                theta_a = 0.0;
+                theta_b = (i % 2 == 0) ? 0.0 : M_PI;
+                phi_a = 0.0;
+                phi_b = (i % 2 == 0) ? M_PI : 0.0;
+            }
+
+            Node<DIM>* p_node_a = new Node<DIM>(2*i, centre_a);
+            Node<DIM>* p_node_b = new Node<DIM>(2*i + 1, c_vector<double, DIM>(centre_a + offset));
+            SetCapsuleAttributes(*p_node_a, theta_a, phi_a);
+            SetCapsuleAttributes(*p_node_b, theta_b, phi_b);
+            rNodes.push_back(p_node_a);
+            rNodes.push_back(p_node_b);
+        }
+    }
+
+    /**
+     * @param numItems the number of items
+     * @param shuffle whether to shuffle the order, as for the cold set
+     * @return a visiting order for numItems items: sequential for the warm
+     *     set and shuffled for the cold set
+     */
+    std::vector<unsigned> CreateOrder(unsigned numItems, bool shuffle)
+    {
+        std::vector<unsigned> order(numItems);
+        if (numItems == 0)
+        {
+            return order;
+        }
+        for (unsigned i=0; i<numItems; i++)
+        {
+            order[i] = i;
+        }
+        if (shuffle)
+        {
+            for (unsigned i=numItems-1; i>0; i--)
+            {
+                std::swap(order[i], order[RandomNumberGenerator::Instance()->randMod(i+1)]);
+            }
+        }
+        return order;
+    }
+
+    /**
+     * Write one benchmark row.
+     *
+     * @param rpFile the benchmark output file
+     * @param rKernel the name of the kernel
+     * @param dim the spatial dimension
+     * @param rScenario the name of the scenario
+     * @param cold whether the cold working set was used
+     * @param numCalls the number of kernel calls timed
+     * @param seconds the total time taken by the calls
+     * @param numNonFinite the number of calls that gave a non-finite result
+     */
+    void WriteRow(out_stream& rpFile, const std::string& rKernel, unsigned dim, const std::string& rScenario,
+                  bool cold, unsigned numCalls, double seconds, unsigned numNonFinite)
+    {
+        *rpFile << rKernel << "\t" << dim << "\t" << rScenario << "\t" << (cold ? "cold" : "warm")
+                << "\t" << numCalls << "\t" << 1e9*seconds/numCalls << "\t" << numCalls/seconds
+                << "\t" << numNonFinite << "\n";
+    }
+
+    /**
+     * Time CalculateForceDirectionAndContactPoints() and CalculateForceMagnitude() on pairs.
+     *
+     * @param rpFile the benchmark output file
+     * @param rScenario the pair scenario, as for CreatePairs()
+     * @param cold whether to use the cold working set, visited in shuffled order
+     */
+    template<unsigned DIM>
+    void BenchmarkPairKernels(out_stream& rpFile, const std::string& rScenario, bool cold)
+    {
+        unsigned num_pairs = cold ? NUM_COLD : NUM_WARM;
+        std::vector<Node<DIM>*> nodes;
+        CreatePairs<DIM>(rScenario, num_pairs, nodes);
+        std::vector<unsigned> order = CreateOrder(num_pairs, cold);
+
+        CapsuleForce<DIM> force;
+        c_vector<double, DIM> vec_a_to_b;
+        double contact_dist_a;
+        double contact_dist_b;
+
+        std::vector<double> overlaps(num_pairs);
+        unsigned num_non_finite = 0;
+        double sum = 0.0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned call=0; call<NUM_CALLS; call++)
+        {
+            unsigned i = order[call % num_pairs];
+            double overlap = force.CalculateForceDirectionAndContactPoints(*nodes[2*i], *nodes[2*i+1], vec_a_to_b, contact_dist_a, contact_dist_b);
+            overlaps[i] = overlap;
+            sum += overlap + vec_a_to_b[0];
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mSink = mSink + sum;
+
+        for (unsigned i=0; i<num_pairs; i++)
+        {
+            if (!std::isfinite(overlaps[i]))
+            {
+                num_non_finite++;
+            }
+        }
+        WriteRow(rpFile, "CalculateForceDirectionAndContactPoints", DIM, rScenario, cold, NUM_CALLS, seconds, num_non_finite);
+
+        // Only overlapping pairs reach the magnitude calculation in a simulation
+        sum = 0.0;
+        start = std::chrono::steady_clock::now();
+        for (unsigned call=0; call<NUM_CALLS; call++)
+        {
+            unsigned i = order[call % num_pairs];
+            double overlap = std::max(overlaps[i], 0.0);
+            sum += force.CalculateForceMagnitude(overlap,
+                                                 nodes[2*i]->rGetNodeAttributes()[NA_RADIUS],
+                                                 nodes[2*i+1]->rGetNodeAttributes()[NA_RADIUS]);
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mSink = mSink + sum;
+        WriteRow(rpFile, "CalculateForceMagnitude", DIM, rScenario, cold, NUM_CALLS, seconds, std::isfinite(sum) ? 0u : 1u);
+
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+    }
+
+    /**
+     * Time CalculateMassOfCapsule() and CalculateMomentOfInertiaOfCapsule().
+     *
+     * @param rpFile the benchmark output file
+     * @param cold whether to use the cold working set, visited in shuffled order
+     */
+    template<unsigned DIM>
+    void BenchmarkMassKernels(out_stream& rpFile, bool cold)
+    {
+        unsigned num_items = cold ? NUM_COLD : NUM_WARM;
+        std::vector<double> lengths(num_items);
+        std::vector<double> radii(num_items);
+        for (unsigned i=0; i<num_items; i++)
+        {
+            lengths[i] = Uniform(0.0, 5.0);
+            radii[i] = Uniform(0.0, 1.0);
+        }
+        std::vector<unsigned> order = CreateOrder(num_items, cold);
+
+        ForwardEulerNumericalMethodForCapsules<DIM, DIM> method;
+
+        double sum = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned call=0; call<NUM_CALLS; call++)
+        {
+            unsigned i = order[call % num_items];
+            sum += method.CalculateMassOfCapsule(lengths[i], radii[i]);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mSink = mSink + sum;
+        TS_ASSERT(std::isfinite(sum));
+        WriteRow(rpFile, "CalculateMassOfCapsule", DIM, "random", cold, NUM_CALLS, seconds, std::isfinite(sum) ? 0u : 1u);
+
+        sum = 0.0;
+        start = std::chrono::steady_clock::now();
+        for (unsigned call=0; call<NUM_CALLS; call++)
+        {
+            unsigned i = order[call % num_items];
+            sum += method.CalculateMomentOfInertiaOfCapsule(lengths[i], radii[i]);
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mSink = mSink + sum;
+        TS_ASSERT(std::isfinite(sum));
+        WriteRow(rpFile, "CalculateMomentOfInertiaOfCapsule", DIM, "random", cold, NUM_CALLS, seconds, std::isfinite(sum) ? 0u : 1u);
+    }
+
+    /**
+     * Time NodeBasedCellPopulationWithCapsules::GetMachineCoords().
+     *
+     * @param rpFile the benchmark output file
+     * @param cold whether to use the cold working set, visited in shuffled order
+     */
+    template<unsigned DIM>
+    void BenchmarkMachineCoords(out_stream& rpFile, bool cold)
+    {
+        unsigned num_capsules = cold ? NUM_COLD : NUM_WARM;
+
+        std::vector<Node<DIM>*> nodes;
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            c_vector<double, DIM> location;
+            for (unsigned d=0; d<DIM; d++)
+            {
+                location[d] = Uniform(0.0, 1000.0);
+            }
+            nodes.push_back(new Node<DIM>(i, location));
+        }
+
+        NodesOnlyMesh<DIM> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 10.0);
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            SetCapsuleAttributes(*mesh.GetNode(i), Uniform(-M_PI, M_PI), Uniform(0.0, M_PI));
+        }
+
+        std::vector<CellPtr> cells;
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(DifferentiatedCellProliferativeType, p_type);
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            CellPtr p_cell(new Cell(p_state, new NoCellCycleModel()));
+            p_cell->SetCellProliferativeType(p_type);
+            cells.push_back(p_cell);
+        }
+        NodeBasedCellPopulationWithCapsules<DIM> population(mesh, cells);
+
+        // Machine positions along the axis, with an angle about it in 3D
+        std::vector<std::vector<double> > machine_angles(num_capsules);
+        std::vector<c_vector<double, DIM> > centres(num_capsules);
+        std::vector<double> lengths(num_capsules);
+        for (unsigned i=0; i<num_capsules; i++)
+        {
+            machine_angles[i].push_back(Uniform(-M_PI, M_PI));
+            if (DIM == 3)
+            {
+                machine_angles[i].push_back(Uniform(-1.0, 1.0));
+            }
+            centres[i] = population.GetNode(i)->rGetLocation();
+            lengths[i] = population.GetNode(i)->rGetNodeAttributes()[NA_LENGTH];
+        }
+        std::vector<unsigned> order = CreateOrder(num_capsules, cold);
+
+        double sum = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned call=0; call<NUM_CALLS; call++)
+        {
+            unsigned i = order[call % num_capsules];
+            c_vector<double, DIM> coords = population.GetMachineCoords(i, machine_angles[i], centres[i], lengths[i]);
+            sum += coords[0];
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mSink = mSink + sum;
+        WriteRow(rpFile, "GetMachineCoords", DIM, "random", cold, NUM_CALLS, seconds, std::isfinite(sum) ? 0u : 1u);
+    }
+
+    /**
+     * Run all kernel benchmarks in one dimension.
+     */
+    template<unsigned DIM>
+    void RunBenchmarks()
+    {
+        RandomNumberGenerator::Instance()->Reseed(0);
+        mSink = 0.0;
+
+        OutputFileHandler handler("CapsuleKernelBenchmarks", false);
+        std::stringstream file_name;
+        file_name << "kernels_" << DIM << "d.dat";
+        out_stream p_file = handler.OpenOutputFile(file_name.str());
+        *p_file << "kernel\tdim\tscenario\tcache\tcalls\tns_per_call\tcalls_per_s\tnum_non_finite\n";
+
+        const char* scenarios[] = {"random", "parallel", "crossing", "coincident", "pole"};
+        for (unsigned cold=0; cold<2; cold++)
+        {
+            for (unsigned s=0; s<5; s++)
+            {
+                BenchmarkPairKernels<DIM>(p_file, scenarios[s], cold == 1);
+            }
+            BenchmarkMassKernels<DIM>(p_file, cold == 1);
+            BenchmarkMachineCoords<DIM>(p_file, cold == 1);
+        }
+        p_file->close();
+    }
+
+public:
+
+    void TestKernelBenchmarks2d()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmarks<2>();
+    }
+
+    void TestKernelBenchmarks3d()
+    {
+        EXIT_IF_PARALLEL;
+        RunBenchmarks<3>();
+    }
+};
+
+#endif /*TESTCAPSULEKERNELBENCHMARKS_HPP_*/
@@ -0,0 +1,78 @@
+#ifndef TESTCAPSULEOUTFLOWCELLKILLER_HPP_
+#define TESTCAPSULEOUTFLOWCELLKILLER_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <cfloat>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "CapsulePopulationBuilder.hpp"
+#include "CapsuleOutflowCellKiller.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleOutflowCellKiller : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestOutflowFromChannel()
+    {
+        EXIT_IF_PARALLEL;
+
+        // A row of capsules along a channel with outlets at x = 0 and x = 20
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(-0.5, 2.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(0.5, 2.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(10.0, 2.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(19.5, 2.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(20.5, 2.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        TS_ASSERT_THROWS_THIS(CapsuleOutflowCellKiller<2> bad_killer(&population, 20.0, 0.0),
+            "The lower outlet must be below the upper outlet");
+
+        // A mother machine, closed at x = 0, loses only the capsule beyond x = 20
+        CapsuleOutflowCellKiller<2> mother_machine_killer(&population, -DBL_MAX, 20.0);
+        TS_ASSERT_DELTA(mother_machine_killer.GetLowerOutlet(), -DBL_MAX, 1e-12);
+        TS_ASSERT_DELTA(mother_machine_killer.GetUpperOutlet(), 20.0, 1e-12);
+        mother_machine_killer.CheckAndLabelCellsForApoptosisOrDeath();
+        TS_ASSERT_EQUALS(mother_machine_killer.GetNumCellsRemoved(), 1u);
+        TS_ASSERT(cells[4]->IsDead());
+        TS_ASSERT(!cells[0]->IsDead());
+
+        // An open channel also loses the capsule beyond x = 0, and does not count dead cells twice
+        CapsuleOutflowCellKiller<2> channel_killer(&population, 0.0, 20.0);
+        channel_killer.CheckAndLabelCellsForApoptosisOrDeath();
+        TS_ASSERT_EQUALS(channel_killer.GetNumCellsRemoved(), 1u);
+        TS_ASSERT(cells[0]->IsDead());
+        TS_ASSERT(!cells[1]->IsDead());
+        TS_ASSERT(!cells[3]->IsDead());
+
+        population.RemoveDeadCells();
+        TS_ASSERT_EQUALS(population.GetNumRealCells(), 3u);
+
+        channel_killer.CheckAndLabelCellsForApoptosisOrDeath();
+        TS_ASSERT_EQUALS(channel_killer.GetNumCellsRemoved(), 1u);
+    }
+};
+
+#endif /*TESTCAPSULEOUTFLOWCELLKILLER_HPP_*/
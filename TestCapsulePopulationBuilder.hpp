@@ -0,0 +1,154 @@
+#ifndef TESTCAPSULEPOPULATIONBUILDER_HPP_
+#define TESTCAPSULEPOPULATIONBUILDER_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "CapsulePopulationBuilder.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsulePopulationBuilder : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestAddCapsulesIn2d()
+    {
+        EXIT_IF_PARALLEL;
+
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.Reserve(3u, 3u, 3u);
+
+        TS_ASSERT_THROWS_THIS(builder.AddMachine(1u, std::vector<double>(1u, 0.0)),
+            "A capsule must be added before its machines");
+
+        TS_ASSERT_EQUALS(builder.AddCapsule(Create_c_vector(1.0, 2.0), 0.1, 0.0, 2.0, 0.5, -0.1), 0u);
+        builder.AddMachine(1u, std::vector<double>(1u, 0.25));
+        builder.AddMachine(4u, std::vector<double>(1u, -0.5));
+        TS_ASSERT_EQUALS(builder.AddCapsule(Create_c_vector(3.0, 2.0), 0.2, 0.0, 2.5, 0.5, -0.2), 1u);
+        TS_ASSERT_EQUALS(builder.AddCapsule(Create_c_vector(5.0, 2.0), 0.3, 0.0, 3.0, 0.4, -0.3), 2u);
+        builder.AddMachine(2u, std::vector<double>(1u, 1.0));
+
+        TS_ASSERT_EQUALS(builder.GetNumCapsules(), 3u);
+        TS_ASSERT_EQUALS(builder.GetNumMachines(), 3u);
+
+        builder.SetCellCycleModelInitialiser([](UniformCellCycleModel* pModel, unsigned index)
+        {
+            pModel->SetMinCellCycleDuration(1.0 + index);
+            pModel->SetMaxCellCycleDuration(1.6 + index);
+        });
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+
+        TS_ASSERT_EQUALS(mesh.GetNumNodes(), 3u);
+        TS_ASSERT_EQUALS(cells.size(), 3u);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+        TS_ASSERT_EQUALS(population.GetNumRealCells(), 3u);
+
+        Node<2>* p_node = population.GetNode(2u);
+        TS_ASSERT_DELTA(p_node->rGetLocation()[0], 5.0, 1e-12);
+        TS_ASSERT_DELTA(p_node->rGetLocation()[1], 2.0, 1e-12);
+        TS_ASSERT_EQUALS(p_node->rGetNodeAttributes().size(), (unsigned)NA_VEC_LENGTH);
+        TS_ASSERT_DELTA(p_node->rGetNodeAttributes()[NA_THETA], 0.3, 1e-12);
+        TS_ASSERT_DELTA(p_node->rGetNodeAttributes()[NA_LENGTH], 3.0, 1e-12);
+        TS_ASSERT_DELTA(p_node->rGetNodeAttributes()[NA_RADIUS], 0.4, 1e-12);
+
+        TS_ASSERT_DELTA(cells[1]->GetBirthTime(), -0.2, 1e-12);
+        UniformCellCycleModel* p_model = static_cast<UniformCellCycleModel*>(cells[2]->GetCellCycleModel());
+        TS_ASSERT_DELTA(p_model->GetMinCellCycleDuration(), 3.0, 1e-12);
+        TS_ASSERT_DELTA(p_model->GetMaxCellCycleDuration(), 3.6, 1e-12);
+
+        // The second capsule has no machines and so an empty property
+        CellPropertyCollection empty_collection = cells[1]->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+        TS_ASSERT_EQUALS(empty_collection.GetSize(), 1u);
+        boost::shared_ptr<TypeSixMachineProperty> p_empty_property = boost::static_pointer_cast<TypeSixMachineProperty>(empty_collection.GetProperty());
+        TS_ASSERT(p_empty_property->rGetMachineData().empty());
+
+        CellPropertyCollection collection = cells[0]->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+        TS_ASSERT_EQUALS(collection.GetSize(), 1u);
+        boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+        std::vector<std::pair<unsigned, std::vector<double>> >& r_data = p_property->rGetMachineData();
+        TS_ASSERT_EQUALS(r_data.size(), 2u);
+        TS_ASSERT_EQUALS(r_data[1].first, 4u);
+        TS_ASSERT_EQUALS(r_data[1].second.size(), 1u);
+        TS_ASSERT_DELTA(r_data[1].second[0], -0.5, 1e-12);
+    }
+
+    void TestSetArraysIn3d()
+    {
+        EXIT_IF_PARALLEL;
+
+        const unsigned num_capsules = 2;
+        double locations[] = {0.0, 0.0, 0.0, 3.0, 3.0, 3.0};
+        double thetas[] = {0.0, 0.5};
+        double phis[] = {0.5*M_PI, 0.0};
+        double lengths[] = {2.0, 2.5};
+        double radii[] = {0.5, 0.5};
+        double birth_times[] = {-0.9, -0.5};
+
+        // Two machines on the second capsule, each with two coordinates
+        uint64_t machine_offsets[] = {0u, 0u, 2u};
+        uint32_t machine_states[] = {3u, 5u};
+        uint64_t coordinate_offsets[] = {0u, 2u, 4u};
+        double coordinates[] = {0.0, 1.0, M_PI, -1.0};
+
+        CapsulePopulationBuilder<UniformCellCycleModel, 3> builder;
+        builder.SetCapsules(num_capsules, locations, thetas, phis, lengths, radii, birth_times);
+        TS_ASSERT_EQUALS(builder.GetNumCapsules(), 2u);
+        TS_ASSERT_EQUALS(builder.GetNumMachines(), 0u);
+        builder.SetMachines(machine_offsets, machine_states, coordinate_offsets, coordinates);
+        TS_ASSERT_EQUALS(builder.GetNumMachines(), 2u);
+
+        NodesOnlyMesh<3> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+
+        NodeBasedCellPopulationWithCapsules<3> population(mesh, cells);
+
+        TS_ASSERT_DELTA(population.GetNode(1u)->rGetLocation()[2], 3.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetNodeAttributes()[NA_PHI], 0.5*M_PI, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1u)->rGetNodeAttributes()[NA_THETA], 0.5, 1e-12);
+        TS_ASSERT_DELTA(cells[0]->GetBirthTime(), -0.9, 1e-12);
+
+        CellPropertyCollection collection = cells[1]->rGetCellPropertyCollection().template GetProperties<TypeSixMachineProperty>();
+        boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+        std::vector<std::pair<unsigned, std::vector<double>> >& r_data = p_property->rGetMachineData();
+        TS_ASSERT_EQUALS(r_data.size(), 2u);
+        TS_ASSERT_EQUALS(r_data[0].first, 3u);
+        TS_ASSERT_EQUALS(r_data[1].first, 5u);
+        TS_ASSERT_DELTA(r_data[1].second[0], M_PI, 1e-12);
+        TS_ASSERT_DELTA(r_data[1].second[1], -1.0, 1e-12);
+
+        // Offsets are checked
+        uint64_t bad_offsets[] = {0u, 2u, 1u};
+        TS_ASSERT_THROWS_THIS(builder.SetMachines(bad_offsets, machine_states, coordinate_offsets, coordinates),
+            "Machine offsets must not decrease");
+        uint64_t bad_start[] = {1u, 1u, 2u};
+        TS_ASSERT_THROWS_THIS(builder.SetMachines(bad_start, machine_states, coordinate_offsets, coordinates),
+            "Machine offsets must start at zero");
+    }
+};
+
+#endif /*TESTCAPSULEPOPULATIONBUILDER_HPP_*/
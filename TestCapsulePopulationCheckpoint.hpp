@@ -0,0 +1,336 @@
+#ifndef TESTCAPSULEPOPULATIONCHECKPOINT_HPP_
+#define TESTCAPSULEPOPULATIONCHECKPOINT_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "CellsGenerator.hpp"
+#include "DifferentiatedCellProliferativeType.hpp"
+#include "NoCellCycleModel.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "OutputFileHandler.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "SimulationTime.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "CapsulePopulationCheckpoint.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsulePopulationCheckpoint : public AbstractCellBasedTestSuite
+{
+private:
+
+    /**
+     * Create three overlapping capsules, each with two machines.
+     *
+     * @param rMesh the mesh to fill
+     * @param rCells the cells to fill
+     */
+    void SetUpCapsules(NodesOnlyMesh<2>& rMesh, std::vector<CellPtr>& rCells)
+    {
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, Create_c_vector(4.0, 4.0)));
+        nodes.push_back(new Node<2>(1u, Create_c_vector(4.5, 4.8)));
+        nodes.push_back(new Node<2>(2u, Create_c_vector(5.5, 4.2)));
+        rMesh.ConstructNodesWithoutMesh(nodes, 100.0);
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+        }
+
+        for (unsigned node_idx = 0; node_idx < rMesh.GetNumNodes(); ++node_idx)
+        {
+            rMesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            rMesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            rMesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = 0.4*node_idx;
+            rMesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+            rMesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        for (unsigned i=0; i<rMesh.GetNumNodes(); i++)
+        {
+            UniformCellCycleModel* p_model = new UniformCellCycleModel();
+            p_model->SetMinCellCycleDuration(100.0);
+            p_model->SetMaxCellCycleDuration(200.0);
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+            p_cell->SetBirthTime(-0.1*i);
+
+            MAKE_PTR(TypeSixMachineProperty, p_property);
+            for (unsigned machine=0; machine<2; machine++)
+            {
+                std::vector<double> machine_angles;
+                machine_angles.push_back(RandomNumberGenerator::Instance()->ranf());
+                p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(i+machine, machine_angles));
+            }
+            p_cell->AddCellProperty(p_property);
+
+            rCells.push_back(p_cell);
+        }
+    }
+
+public:
+
+    void TestCaptureAndRestore()
+    {
+        EXIT_IF_PARALLEL;
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules(mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        CapsulePopulationCheckpoint<2> checkpoint;
+        checkpoint.Capture(population);
+
+        TS_ASSERT_EQUALS(checkpoint.GetNumCells(), 3u);
+        TS_ASSERT_EQUALS(checkpoint.GetNumAttributes(), (unsigned)NA_VEC_LENGTH);
+        TS_ASSERT_EQUALS(checkpoint.rGetMachineOffsets().size(), 4u);
+        TS_ASSERT_EQUALS(checkpoint.rGetMachineStates().size(), 6u);
+        TS_ASSERT_EQUALS(checkpoint.rGetMachineCoordinateOffsets().size(), 7u);
+
+        OutputFileHandler handler("TestCapsulePopulationCheckpoint", true);
+        std::string file_name = handler.GetOutputDirectoryFullPath() + "population.ckpt";
+        checkpoint.Save(file_name);
+
+        // Record the original state, then change it
+        std::vector<c_vector<double, 2> > locations;
+        std::vector<std::vector<double> > attributes;
+        std::vector<double> durations;
+        std::vector<std::vector<std::pair<unsigned, std::vector<double>> > > machines;
+        for (AbstractCellPopulation<2>::Iterator cell_iter = population.Begin();
+             cell_iter != population.End();
+             ++cell_iter)
+        {
+            Node<2>* p_node = population.GetNodeCorrespondingToCell(*cell_iter);
+            locations.push_back(p_node->rGetLocation());
+            attributes.push_back(p_node->rGetNodeAttributes());
+            durations.push_back(static_cast<UniformCellCycleModel*>(cell_iter->GetCellCycleModel())->GetCellCycleDuration());
+
+            CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().GetProperties<TypeSixMachineProperty>();
+            boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+            machines.push_back(p_property->rGetMachineData());
+
+            p_node->rGetModifiableLocation()[0] += 1.0;
+            p_node->rGetNodeAttributes()[NA_THETA] += 1.0;
+            p_property->rGetMachineData().clear();
+            cell_iter->SetBirthTime(-5.0);
+        }
+        double next_random_number = RandomNumberGenerator::Instance()->ranf();
+        RandomNumberGenerator::Instance()->ranf();
+
+        CapsulePopulationCheckpoint<2> loaded_checkpoint;
+        loaded_checkpoint.Load(file_name);
+        TS_ASSERT_DELTA(loaded_checkpoint.GetTime(), 0.0, 1e-12);
+        loaded_checkpoint.Restore(population);
+
+        // The restored state is bitwise identical to the original
+        unsigned cell_index = 0;
+        for (AbstractCellPopulation<2>::Iterator cell_iter = population.Begin();
+             cell_iter != population.End();
+             ++cell_iter, ++cell_index)
+        {
+            Node<2>* p_node = population.GetNodeCorrespondingToCell(*cell_iter);
+            TS_ASSERT_EQUALS(p_node->rGetLocation()[0], locations[cell_index][0]);
+            TS_ASSERT_EQUALS(p_node->rGetLocation()[1], locations[cell_index][1]);
+            TS_ASSERT_EQUALS(p_node->rGetNodeAttributes().size(), attributes[cell_index].size());
+            for (unsigned i=0; i<attributes[cell_index].size(); i++)
+            {
+                TS_ASSERT_EQUALS(p_node->rGetNodeAttributes()[i], attributes[cell_index][i]);
+            }
+            TS_ASSERT_EQUALS(cell_iter->GetBirthTime(), -0.1*cell_index);
+            TS_ASSERT_EQUALS(static_cast<UniformCellCycleModel*>(cell_iter->GetCellCycleModel())->GetCellCycleDuration(), durations[cell_index]);
+
+            CellPropertyCollection collection = cell_iter->rGetCellPropertyCollection().GetProperties<TypeSixMachineProperty>();
+            boost::shared_ptr<TypeSixMachineProperty> p_property = boost::static_pointer_cast<TypeSixMachineProperty>(collection.GetProperty());
+            TS_ASSERT_EQUALS(p_property->rGetMachineData().size(), 2u);
+            for (unsigned machine=0; machine<2; machine++)
+            {
+                TS_ASSERT_EQUALS(p_property->rGetMachineData()[machine].first, machines[cell_index][machine].first);
+                TS_ASSERT_EQUALS(p_property->rGetMachineData()[machine].second[0], machines[cell_index][machine].second[0]);
+            }
+        }
+
+        // The random number generator continues from where it was captured
+        TS_ASSERT_EQUALS(RandomNumberGenerator::Instance()->ranf(), next_random_number);
+    }
+
+    void TestRestartContinuesSimulation()
+    {
+        EXIT_IF_PARALLEL;
+
+        double dt = 1.0/1200.0;
+        OutputFileHandler handler("TestCapsuleCheckpointRestart", true);
+        std::string file_name = handler.GetOutputDirectoryFullPath() + "population.ckpt";
+
+        // Run to t = 50 dt, checkpoint, then continue to t = 100 dt
+        std::vector<c_vector<double, 2> > final_locations;
+        std::vector<double> final_thetas;
+        {
+            NodesOnlyMesh<2> mesh;
+            std::vector<CellPtr> cells;
+            SetUpCapsules(mesh, cells);
+            NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+            OffLatticeSimulation<2> simulator(population);
+            simulator.SetOutputDirectory("TestCapsuleCheckpointRestart/Original");
+            simulator.SetDt(dt);
+            simulator.SetSamplingTimestepMultiple(1000);
+            simulator.SetNumericalMethod(boost::make_shared<ForwardEulerNumericalMethodForCapsules<2,2>>());
+            simulator.AddForce(boost::make_shared<CapsuleForce<2>>());
+
+            simulator.SetEndTime(50.0*dt);
+            simulator.Solve();
+
+            CapsulePopulationCheckpoint<2> checkpoint;
+            checkpoint.Capture(population);
+            checkpoint.Save(file_name);
+
+            simulator.SetEndTime(100.0*dt);
+            simulator.Solve();
+
+            for (AbstractCellPopulation<2>::Iterator cell_iter = population.Begin();
+                 cell_iter != population.End();
+                 ++cell_iter)
+            {
+                Node<2>* p_node = population.GetNodeCorrespondingToCell(*cell_iter);
+                final_locations.push_back(p_node->rGetLocation());
+                final_thetas.push_back(p_node->rGetNodeAttributes()[NA_THETA]);
+            }
+        }
+
+        // Restart from the checkpoint and run to t = 100 dt
+        {
+            CapsulePopulationCheckpoint<2> checkpoint;
+            checkpoint.Load(file_name);
+            TS_ASSERT_DELTA(checkpoint.GetTime(), 50.0*dt, 1e-12);
+            checkpoint.RestoreSimulationTime();
+
+            NodesOnlyMesh<2> mesh;
+            std::vector<CellPtr> cells;
+            SetUpCapsules(mesh, cells);
+            NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+            checkpoint.Restore(population);
+
+            OffLatticeSimulation<2> simulator(population);
+            simulator.SetOutputDirectory("TestCapsuleCheckpointRestart/Restarted");
+            simulator.SetDt(dt);
+            simulator.SetSamplingTimestepMultiple(1000);
+            simulator.SetNumericalMethod(boost::make_shared<ForwardEulerNumericalMethodForCapsules<2,2>>());
+            simulator.AddForce(boost::make_shared<CapsuleForce<2>>());
+
+            simulator.SetEndTime(100.0*dt);
+            simulator.Solve();
+
+            unsigned cell_index = 0;
+            for (AbstractCellPopulation<2>::Iterator cell_iter = population.Begin();
+                 cell_iter != population.End();
+                 ++cell_iter, ++cell_index)
+            {
+                Node<2>* p_node = population.GetNodeCorrespondingToCell(*cell_iter);
+                TS_ASSERT_DELTA(p_node->rGetLocation()[0], final_locations[cell_index][0], 1e-12);
+                TS_ASSERT_DELTA(p_node->rGetLocation()[1], final_locations[cell_index][1], 1e-12);
+                TS_ASSERT_DELTA(p_node->rGetNodeAttributes()[NA_THETA], final_thetas[cell_index], 1e-12);
+            }
+        }
+    }
+
+    void TestExceptions()
+    {
+        EXIT_IF_PARALLEL;
+
+        CapsulePopulationCheckpoint<2> checkpoint_2d;
+        TS_ASSERT_THROWS_CONTAINS(checkpoint_2d.Load("/does/not/exist.ckpt"),
+            "Could not open checkpoint file");
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        SetUpCapsules(mesh, cells);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OutputFileHandler handler("TestCapsulePopulationCheckpointExceptions", true);
+        std::string file_name = handler.GetOutputDirectoryFullPath() + "population.ckpt";
+        checkpoint_2d.Capture(population);
+        checkpoint_2d.Save(file_name);
+
+        CapsulePopulationCheckpoint<3> checkpoint_3d;
+        TS_ASSERT_THROWS_CONTAINS(checkpoint_3d.Load(file_name), "is for dimension 2, not 3");
+
+        // A population of a different size cannot be restored
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, Create_c_vector(0.0, 0.0)));
+        nodes.push_back(new Node<2>(1u, Create_c_vector(3.0, 0.0)));
+        NodesOnlyMesh<2> other_mesh;
+        other_mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+        for (unsigned i=0; i<nodes.size(); i++)
+        {
+            delete nodes[i];
+            other_mesh.GetNode(i)->AddNodeAttribute(0.0);
+            other_mesh.GetNode(i)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+        }
+
+        std::vector<CellPtr> other_cells;
+        auto p_diff_type = boost::make_shared<DifferentiatedCellProliferativeType>();
+        CellsGenerator<NoCellCycleModel, 2> cells_generator;
+        cells_generator.GenerateBasicRandom(other_cells, other_mesh.GetNumNodes(), p_diff_type);
+
+        NodeBasedCellPopulationWithCapsules<2> other_population(other_mesh, other_cells);
+        TS_ASSERT_THROWS_THIS(checkpoint_2d.Restore(other_population),
+            "The population has 2 cells but the checkpoint has 3");
+
+        std::ifstream in_file(file_name.c_str(), std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(in_file)), std::istreambuf_iterator<char>());
+        in_file.close();
+
+        // An array length longer than the file is rejected before anything is allocated
+        std::string hostile_contents = contents;
+        uint64_t hostile_size = UINT64_C(1) << 60;
+        memcpy(&hostile_contents[32], &hostile_size, sizeof(hostile_size));
+        std::string hostile_name = handler.GetOutputDirectoryFullPath() + "hostile.ckpt";
+        std::ofstream hostile_file(hostile_name.c_str(), std::ios::binary);
+        hostile_file << hostile_contents;
+        hostile_file.close();
+        CapsulePopulationCheckpoint<2> hostile_checkpoint;
+        TS_ASSERT_THROWS_CONTAINS(hostile_checkpoint.Load(hostile_name), "is truncated");
+
+        // Machine offsets that run past the machines are rejected on restore
+        const unsigned num_attributes = checkpoint_2d.GetNumAttributes();
+        size_t last_offset_position = 32 + (8 + 8*2*3) + (8 + 8*num_attributes*3) + (8 + 4*3) + (8 + 8*3) + (8 + 8*3)
+                                      + 8 + 8*3;
+        std::string corrupt_contents = contents;
+        uint64_t corrupt_offset = 1000u;
+        memcpy(&corrupt_contents[last_offset_position], &corrupt_offset, sizeof(corrupt_offset));
+        std::string corrupt_name = handler.GetOutputDirectoryFullPath() + "corrupt.ckpt";
+        std::ofstream corrupt_file(corrupt_name.c_str(), std::ios::binary);
+        corrupt_file << corrupt_contents;
+        corrupt_file.close();
+        CapsulePopulationCheckpoint<2> corrupt_checkpoint;
+        corrupt_checkpoint.Load(corrupt_name);
+        TS_ASSERT_THROWS_THIS(corrupt_checkpoint.Restore(population),
+            "Checkpoint machine offsets must end at the number of machines");
+    }
+};
+
+#endif /*TESTCAPSULEPOPULATIONCHECKPOINT_HPP_*/
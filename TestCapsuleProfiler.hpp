@@ -0,0 +1,263 @@
+#ifndef TESTCAPSULEPROFILER_HPP_
+#define TESTCAPSULEPROFILER_HPP_
+
+// Compile the profiler in for this test
+#define CAPSULE_PROFILING
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <type_traits>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "OutputFileHandler.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "CapsuleBasedDivisionRule.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "TypeSixMachineModifier.hpp"
+#include "TypeSixMachineCellKiller.hpp"
+#include "CapsuleProfiler.hpp"
+#include "ProfiledForce.hpp"
+#include "ProfiledNumericalMethod.hpp"
+#include "ProfiledCellKiller.hpp"
+#include "ProfiledSimulationModifier.hpp"
+#include "ProfiledDivisionRule.hpp"
+#include "CapsuleProfileOutputModifier.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleProfiler : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestProfilerPhases()
+    {
+        TS_ASSERT(CapsuleProfiler::IsEnabled());
+
+        unsigned phase_a = CapsuleProfiler::RegisterPhase("TestPhaseA");
+        unsigned phase_b = CapsuleProfiler::RegisterPhase("TestPhaseB");
+        TS_ASSERT_DIFFERS(phase_a, phase_b);
+        TS_ASSERT_EQUALS(CapsuleProfiler::RegisterPhase("TestPhaseA"), phase_a);
+
+        CapsuleProfiler::Reset();
+        for (unsigned i=0; i<3; i++)
+        {
+            CAPSULE_PROFILE_SCOPE(phase_a);
+            CAPSULE_PROFILE_COUNT(phase_a, 2u);
+        }
+
+        const std::vector<CapsuleProfiler::Phase>& r_phases = CapsuleProfiler::rGetPhases();
+        TS_ASSERT_EQUALS(r_phases[phase_a].mName, "TestPhaseA");
+        TS_ASSERT_EQUALS(r_phases[phase_a].mIntervalCalls, 3u);
+        TS_ASSERT_EQUALS(r_phases[phase_a].mIntervalCount, 6u);
+        TS_ASSERT_EQUALS(r_phases[phase_a].mTotalCalls, 3u);
+        TS_ASSERT_LESS_THAN_EQUALS(0.0, r_phases[phase_a].mIntervalSeconds);
+        TS_ASSERT_EQUALS(r_phases[phase_b].mIntervalCalls, 0u);
+
+        CapsuleProfiler::ResetInterval();
+        TS_ASSERT_EQUALS(r_phases[phase_a].mIntervalCalls, 0u);
+        TS_ASSERT_EQUALS(r_phases[phase_a].mIntervalCount, 0u);
+        TS_ASSERT_EQUALS(r_phases[phase_a].mTotalCalls, 3u);
+        TS_ASSERT_EQUALS(r_phases[phase_a].mTotalCount, 6u);
+
+        CapsuleProfiler::Reset();
+        TS_ASSERT_EQUALS(r_phases[phase_a].mTotalCalls, 0u);
+
+        CapsuleProfileOutputModifier<2> modifier;
+        TS_ASSERT_EQUALS(modifier.GetSamplingTimestepMultiple(), 1u);
+        TS_ASSERT_EQUALS(modifier.GetUseHardwareCounters(), false);
+        modifier.SetUseHardwareCounters(true);
+        TS_ASSERT_EQUALS(modifier.GetUseHardwareCounters(), true);
+        modifier.SetSamplingTimestepMultiple(5u);
+        TS_ASSERT_EQUALS(modifier.GetSamplingTimestepMultiple(), 5u);
+        TS_ASSERT_THROWS_THIS(modifier.SetSamplingTimestepMultiple(0u),
+            "The sampling timestep multiple must be positive");
+    }
+
+    void TestHardwareCounters()
+    {
+        // perf_event_open is often unavailable, e.g. in containers, so only check what can be read
+        CapsulePerfCounters counters;
+        uint64_t before[CapsulePerfCounters::NUM_COUNTERS];
+        uint64_t after[CapsulePerfCounters::NUM_COUNTERS];
+
+        // The counters own file descriptors, so cannot be copied
+        TS_ASSERT(!std::is_copy_constructible<CapsulePerfCounters>::value);
+        TS_ASSERT(!std::is_copy_assignable<CapsulePerfCounters>::value);
+
+        // Closed counters report a failed read and read as zero
+        TS_ASSERT(!counters.Read(before));
+        for (unsigned i=0; i<CapsulePerfCounters::NUM_COUNTERS; i++)
+        {
+            TS_ASSERT_EQUALS(before[i], 0u);
+        }
+        TS_ASSERT_EQUALS(std::string(CapsulePerfCounters::GetCounterName(CapsulePerfCounters::LLC_MISSES)), "llc_misses");
+
+        if (counters.Open())
+        {
+            TS_ASSERT(counters.IsOpen());
+            TS_ASSERT(counters.IsCounterOpen(CapsulePerfCounters::CYCLES));
+
+            TS_ASSERT(counters.Read(before));
+            volatile double sum = 0.0;
+            for (unsigned i=0; i<100000; i++)
+            {
+                sum = sum + i;
+            }
+            TS_ASSERT(counters.Read(after));
+
+            TS_ASSERT_LESS_THAN(before[CapsulePerfCounters::CYCLES], after[CapsulePerfCounters::CYCLES]);
+            if (counters.IsCounterOpen(CapsulePerfCounters::INSTRUCTIONS))
+            {
+                TS_ASSERT_LESS_THAN(100000u, after[CapsulePerfCounters::INSTRUCTIONS] - before[CapsulePerfCounters::INSTRUCTIONS]);
+            }
+
+            counters.Close();
+            TS_ASSERT(!counters.IsOpen());
+        }
+        else
+        {
+            TS_ASSERT(!counters.IsOpen());
+        }
+    }
+
+    void TestProfiledSimulation()
+    {
+        EXIT_IF_PARALLEL;
+
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, Create_c_vector(4.0, 4.0)));
+        nodes.push_back(new Node<2>(1u, Create_c_vector(4.0, 5.0)));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            mesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = 0.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            UniformCellCycleModel* p_model = new UniformCellCycleModel();
+            p_model->SetMinCellCycleDuration(100.0);
+            p_model->SetMaxCellCycleDuration(101.0);
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+
+            std::vector<double> machine_angles;
+            machine_angles.push_back(0.0);
+            MAKE_PTR(TypeSixMachineProperty, p_property);
+            p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(1u, machine_angles));
+            p_cell->AddCellProperty(p_property);
+
+            cells.push_back(p_cell);
+        }
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        boost::shared_ptr<AbstractCentreBasedDivisionRule<2,2> > p_division_rule(new ProfiledDivisionRule<CapsuleBasedDivisionRule<2,2>, 2>());
+        population.SetCentreBasedDivisionRule(p_division_rule);
+
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestProfiledSimulation");
+        simulator.SetDt(1.0/1200.0);
+        simulator.SetSamplingTimestepMultiple(10);
+        simulator.SetEndTime(20.0/1200.0);
+
+        auto p_numerical_method = boost::make_shared<ProfiledNumericalMethod<ForwardEulerNumericalMethodForCapsules<2,2> > >();
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<ProfiledForce<CapsuleForce<2>, 2> >();
+        p_capsule_force->SetProfilePhaseName("CapsuleForce");
+        p_capsule_force->SetYoungModulus(200.0);
+        simulator.AddForce(p_capsule_force);
+
+        auto p_killer = boost::make_shared<ProfiledCellKiller<TypeSixMachineCellKiller<2> > >(&population);
+        simulator.AddCellKiller(p_killer);
+
+        auto p_machine_modifier = boost::make_shared<ProfiledSimulationModifier<TypeSixMachineModifier<2>, 2> >();
+        p_machine_modifier->SetProfilePhaseName("TypeSixMachineModifier");
+        p_machine_modifier->SetOutputDirectory("TestProfiledSimulation");
+        p_machine_modifier->SetMachineParametersFromGercEtAl();
+        simulator.AddSimulationModifier(p_machine_modifier);
+
+        MAKE_PTR(CapsuleProfileOutputModifier<2>, p_profile_modifier);
+        p_profile_modifier->SetSamplingTimestepMultiple(10u);
+        p_profile_modifier->SetUseHardwareCounters(true);
+        simulator.AddSimulationModifier(p_profile_modifier);
+
+        simulator.Solve();
+
+        TS_ASSERT(!CapsuleProfiler::rGetHardwareCounters().IsOpen());
+
+        // Each force call is one step, and the one pair is counted at each
+        const std::vector<CapsuleProfiler::Phase>& r_phases = CapsuleProfiler::rGetPhases();
+        unsigned force_phase = CapsuleProfiler::RegisterPhase("CapsuleForce");
+        TS_ASSERT_EQUALS(r_phases[force_phase].mTotalCalls, 20u);
+        TS_ASSERT_EQUALS(r_phases[force_phase].mTotalCount, 20u);
+        TS_ASSERT_EQUALS(r_phases[CapsuleProfiler::RegisterPhase("NumericalMethod")].mTotalCalls, 20u);
+        TS_ASSERT_LESS_THAN(0u, r_phases[CapsuleProfiler::RegisterPhase("CellKiller")].mTotalCalls);
+        TS_ASSERT_EQUALS(r_phases[CapsuleProfiler::RegisterPhase("TypeSixMachineModifier")].mTotalCalls, 20u);
+        TS_ASSERT_EQUALS(r_phases[CapsuleProfiler::RegisterPhase("DivisionRule")].mTotalCalls, 0u);
+
+        // Two intervals and the totals, each with every phase and event
+        OutputFileHandler handler("TestProfiledSimulation/results_from_time_0", false);
+        std::ifstream file((handler.GetOutputDirectoryFullPath() + "capsuleprofile.dat").c_str());
+        TS_ASSERT(file.is_open());
+
+        std::string line;
+        std::getline(file, line);
+        TS_ASSERT_EQUALS(line, "time\tphase\tseconds\tcalls\tcount\tcycles\tinstructions\tllc_misses\tbranch_misses");
+
+        unsigned num_force_rows = 0;
+        std::set<std::string> names;
+        while (std::getline(file, line))
+        {
+            std::stringstream line_stream(line);
+            std::string time;
+            std::string name;
+            double seconds;
+            unsigned calls;
+            unsigned count;
+            line_stream >> time >> name >> seconds >> calls >> count;
+            names.insert(name);
+            if (name == "CapsuleForce")
+            {
+                num_force_rows++;
+                TS_ASSERT_EQUALS(calls, (time == "total") ? 20u : 10u);
+            }
+        }
+        TS_ASSERT_EQUALS(num_force_rows, 3u);
+        TS_ASSERT_EQUALS(names.count("NumericalMethod"), 1u);
+        TS_ASSERT_EQUALS(names.count("UpdateCellPopulation"), 1u);
+        TS_ASSERT_EQUALS(names.count("Output"), 1u);
+    }
+};
+
+#endif /*TESTCAPSULEPROFILER_HPP_*/
@@ -0,0 +1,90 @@
+#ifndef TESTCAPSULESTEADYSTATESIMULATION_HPP_
+#define TESTCAPSULESTEADYSTATESIMULATION_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "SimulationTime.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "CapsulePopulationBuilder.hpp"
+#include "CapsuleSteadyStateSimulation.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleSteadyStateSimulation : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestStopAtSteadyState()
+    {
+        EXIT_IF_PARALLEL;
+
+        // Two overlapping capsules that will not divide during the run
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(5.0, 4.6), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(5.2, 5.4), 0.1, 0.0, 2.0, 0.5, -0.5);
+        builder.SetCellCycleModelInitialiser([](UniformCellCycleModel* pModel, unsigned)
+        {
+            pModel->SetMinCellCycleDuration(100.0);
+            pModel->SetMaxCellCycleDuration(101.0);
+        });
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        CapsuleSteadyStateSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestCapsuleSteadyStateSimulation");
+        simulator.SetDt(1.0/1200.0);
+        simulator.SetSamplingTimestepMultiple(1200);
+        simulator.SetEndTime(10.0);
+
+        TS_ASSERT_DELTA(simulator.GetForceTolerance(), 1e-3, 1e-12);
+        TS_ASSERT_DELTA(simulator.GetTorqueTolerance(), 1e-3, 1e-12);
+        TS_ASSERT_DELTA(simulator.GetDisplacementTolerance(), 1e-6, 1e-12);
+        TS_ASSERT_EQUALS(simulator.GetNumQuiescentStepsRequired(), 100u);
+        TS_ASSERT_THROWS_THIS(simulator.SetTolerances(-1.0, 1.0, 1.0),
+            "The steady state tolerances must be non-negative");
+        TS_ASSERT_THROWS_THIS(simulator.SetNumQuiescentStepsRequired(0u),
+            "The number of quiescent steps required must be positive");
+
+        simulator.SetTolerances(1e-2, 1e-2, 1e-5);
+        simulator.SetNumQuiescentStepsRequired(10u);
+
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsules<2,2>>();
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<CapsuleForce<2>>();
+        simulator.AddForce(p_capsule_force);
+
+        TS_ASSERT(!simulator.HasReachedSteadyState());
+        simulator.Solve();
+
+        // The run stops well before the end time, with everything below tolerance
+        TS_ASSERT(simulator.HasReachedSteadyState());
+        TS_ASSERT_LESS_THAN(SimulationTime::Instance()->GetTime(), 10.0);
+        TS_ASSERT_LESS_THAN_EQUALS(simulator.GetMaxForce(), 1e-2);
+        TS_ASSERT_LESS_THAN_EQUALS(simulator.GetMaxTorque(), 1e-2);
+        TS_ASSERT_LESS_THAN_EQUALS(simulator.GetMaxDisplacement(), 1e-5);
+        TS_ASSERT_EQUALS(population.GetNumRealCells(), 2u);
+    }
+};
+
+#endif /*TESTCAPSULESTEADYSTATESIMULATION_HPP_*/
@@ -0,0 +1,268 @@
+#ifndef TESTCAPSULETRACEOUTPUTMODIFIER_HPP_
+#define TESTCAPSULETRACEOUTPUTMODIFIER_HPP_
+
+// Compile the profiler in for this test
+#define CAPSULE_PROFILING
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "OutputFileHandler.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsules.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "TypeSixMachineProperty.hpp"
+#include "CapsuleTraceRecorder.hpp"
+#include "ProfiledForce.hpp"
+#include "AsynchronousCapsuleOutputModifier.hpp"
+#include "CapsuleTraceOutputModifier.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleTraceOutputModifier : public AbstractCellBasedTestSuite
+{
+private:
+
+    /** @return the number of occurrences of rPattern in rString */
+    unsigned CountOccurrences(const std::string& rString, const std::string& rPattern)
+    {
+        unsigned count = 0;
+        for (size_t pos = rString.find(rPattern); pos != std::string::npos; pos = rString.find(rPattern, pos + 1))
+        {
+            count++;
+        }
+        return count;
+    }
+
+public:
+
+    void TestRecorder()
+    {
+        unsigned name = CapsuleTraceRecorder::RegisterName("TestEvent");
+        TS_ASSERT_EQUALS(CapsuleTraceRecorder::RegisterName("TestEvent"), name);
+
+        // Nothing is recorded while disabled
+        std::stringstream stream;
+        bool first = true;
+        CapsuleTraceRecorder::Drain(stream, first);
+        CapsuleTraceRecorder::RecordInstant(name, 1);
+        TS_ASSERT_EQUALS(CapsuleTraceRecorder::Drain(stream, first), 0u);
+        TS_ASSERT(first);
+
+        // Events from two threads go to two tracks
+        CapsuleTraceRecorder::SetEnabled(true);
+        {
+            CAPSULE_TRACE_SCOPE("TestScope");
+        }
+        std::thread worker([name]()
+        {
+            CapsuleTraceRecorder::SetThreadName("Worker");
+            CapsuleTraceRecorder::RecordCounter(name, 7);
+        });
+        worker.join();
+
+        TS_ASSERT_EQUALS(CapsuleTraceRecorder::Drain(stream, first), 0u);
+        TS_ASSERT(!first);
+        std::string json = stream.str();
+        TS_ASSERT_EQUALS(CountOccurrences(json, "\"name\":\"TestScope\",\"ph\":\"X\""), 1u);
+        TS_ASSERT_EQUALS(CountOccurrences(json, "\"name\":\"TestEvent\",\"ph\":\"C\""), 1u);
+        TS_ASSERT_EQUALS(CountOccurrences(json, "\"args\":{\"value\":7}"), 1u);
+
+        std::stringstream names;
+        bool first_name = true;
+        CapsuleTraceRecorder::WriteThreadNames(names, first_name);
+        TS_ASSERT_EQUALS(CountOccurrences(names.str(), "{\"name\":\"Worker\"}"), 1u);
+
+        // A small buffer wraps around and loses the oldest events
+        CapsuleTraceRecorder::SetBufferCapacity(3u);
+        std::thread overflowing_worker([name]()
+        {
+            for (unsigned i=0; i<10; i++)
+            {
+                CapsuleTraceRecorder::RecordInstant(name, i);
+            }
+        });
+        overflowing_worker.join();
+        CapsuleTraceRecorder::SetBufferCapacity(1u << 16);
+
+        std::stringstream overflow_stream;
+        TS_ASSERT_EQUALS(CapsuleTraceRecorder::Drain(overflow_stream, first), 7u);
+        TS_ASSERT_EQUALS(CountOccurrences(overflow_stream.str(), "\"ph\":\"i\""), 3u);
+        TS_ASSERT_EQUALS(CountOccurrences(overflow_stream.str(), "\"args\":{\"count\":9}"), 1u);
+
+        CapsuleTraceRecorder::SetEnabled(false);
+
+        CapsuleTraceOutputModifier<2> modifier;
+        TS_ASSERT_EQUALS(modifier.GetDrainTimestepMultiple(), 100u);
+        modifier.SetDrainTimestepMultiple(10u);
+        TS_ASSERT_EQUALS(modifier.GetDrainTimestepMultiple(), 10u);
+        TS_ASSERT_THROWS_THIS(modifier.SetDrainTimestepMultiple(0u),
+            "The drain timestep multiple must be positive");
+    }
+
+    void TestConcurrentWrapAround()
+    {
+        unsigned even_name = CapsuleTraceRecorder::RegisterName("EvenValue");
+        unsigned odd_name = CapsuleTraceRecorder::RegisterName("OddValue");
+        const unsigned num_events = 200000;
+
+        std::stringstream discarded;
+        bool discarded_first = true;
+        CapsuleTraceRecorder::Drain(discarded, discarded_first);
+
+        // A small buffer is drained while the producer keeps lapping it
+        CapsuleTraceRecorder::SetEnabled(true);
+        CapsuleTraceRecorder::SetBufferCapacity(64u);
+        std::atomic<bool> finished(false);
+        std::thread producer([&]()
+        {
+            for (unsigned k=0; k<num_events; k++)
+            {
+                CapsuleTraceRecorder::RecordCounter(k%2 == 0 ? even_name : odd_name, k);
+            }
+            finished.store(true);
+        });
+
+        std::stringstream stream;
+        bool first = true;
+        unsigned long num_lost = 0;
+        while (!finished.load())
+        {
+            num_lost += CapsuleTraceRecorder::Drain(stream, first);
+        }
+        producer.join();
+        num_lost += CapsuleTraceRecorder::Drain(stream, first);
+        CapsuleTraceRecorder::SetBufferCapacity(1u << 16);
+        CapsuleTraceRecorder::SetEnabled(false);
+
+        // No torn event is written: every name matches the parity of its value
+        unsigned num_written = 0;
+        unsigned num_torn = 0;
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            size_t value_pos = line.find("\"value\":");
+            TS_ASSERT_DIFFERS(value_pos, std::string::npos);
+            unsigned long value = std::stoul(line.substr(value_pos + 8));
+            bool is_even = (line.find("\"name\":\"EvenValue\"") != std::string::npos);
+            if (is_even != (value%2 == 0))
+            {
+                num_torn++;
+            }
+            num_written++;
+        }
+        TS_ASSERT_EQUALS(num_torn, 0u);
+        TS_ASSERT_EQUALS(num_written + num_lost, num_events);
+
+        // The buffer of the exited producer has been released
+        TS_ASSERT_LESS_THAN_EQUALS(CapsuleTraceRecorder::GetNumThreadBuffers(), 1u);
+    }
+
+    void TestTraceOfTwoCapsules()
+    {
+        EXIT_IF_PARALLEL;
+
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, Create_c_vector(4.0, 4.0)));
+        nodes.push_back(new Node<2>(1u, Create_c_vector(4.0, 5.0)));
+
+        NodesOnlyMesh<2> mesh;
+        mesh.ConstructNodesWithoutMesh(nodes, 100.0);
+
+        for (unsigned node_idx = 0; node_idx < mesh.GetNumNodes(); ++node_idx)
+        {
+            mesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            mesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = 0.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+            mesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        std::vector<CellPtr> cells;
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        for (unsigned i=0; i<mesh.GetNumNodes(); i++)
+        {
+            UniformCellCycleModel* p_model = new UniformCellCycleModel();
+            p_model->SetMinCellCycleDuration(100.0);
+            p_model->SetMaxCellCycleDuration(101.0);
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+
+            std::vector<double> machine_angles;
+            machine_angles.push_back(0.0);
+            MAKE_PTR(TypeSixMachineProperty, p_property);
+            p_property->rGetMachineData().emplace_back(std::pair<unsigned, std::vector<double>>(1u, machine_angles));
+            p_cell->AddCellProperty(p_property);
+
+            cells.push_back(p_cell);
+        }
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestTraceOfTwoCapsules");
+        simulator.SetDt(1.0/1200.0);
+        simulator.SetSamplingTimestepMultiple(10);
+        simulator.SetEndTime(20.0/1200.0);
+
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsules<2,2>>();
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<ProfiledForce<CapsuleForce<2>, 2> >();
+        p_capsule_force->SetProfilePhaseName("CapsuleForce");
+        simulator.AddForce(p_capsule_force);
+
+        MAKE_PTR(AsynchronousCapsuleOutputModifier<2>, p_output_modifier);
+        p_output_modifier->SetSamplingTimestepMultiple(10);
+        simulator.AddSimulationModifier(p_output_modifier);
+
+        MAKE_PTR(CapsuleTraceOutputModifier<2>, p_trace_modifier);
+        p_trace_modifier->SetDrainTimestepMultiple(5u);
+        simulator.AddSimulationModifier(p_trace_modifier);
+
+        simulator.Solve();
+
+        TS_ASSERT_EQUALS(p_trace_modifier->GetNumLostEvents(), 0u);
+        TS_ASSERT(!CapsuleTraceRecorder::IsEnabled());
+
+        OutputFileHandler handler("TestTraceOfTwoCapsules/results_from_time_0", false);
+        std::ifstream file((handler.GetOutputDirectoryFullPath() + "trace.json").c_str());
+        TS_ASSERT(file.is_open());
+        std::stringstream contents;
+        contents << file.rdbuf();
+        std::string json = contents.str();
+
+        TS_ASSERT_EQUALS(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0u);
+        TS_ASSERT_EQUALS(json.substr(json.size() - 4), "\n]}\n");
+        TS_ASSERT_EQUALS(CountOccurrences(json, "\"name\":\"TimeStep\""), 20u);
+        TS_ASSERT_EQUALS(CountOccurrences(json, "\"name\":\"CapsuleForce\""), 20u);
+        TS_ASSERT_EQUALS(CountOccurrences(json, "\"name\":\"DivisionBurst\""), 0u);
+        TS_ASSERT_EQUALS(CountOccurrences(json, "{\"name\":\"Simulation\"}"), 1u);
+
+        // The writer thread records its frames on its own track
+        TS_ASSERT_LESS_THAN(0u, CountOccurrences(json, "\"name\":\"WriteFrame\""));
+        TS_ASSERT_EQUALS(CountOccurrences(json, "{\"name\":\"AsynchronousCapsuleOutputWriter\"}"), 1u);
+    }
+};
+
+#endif /*TESTCAPSULETRACEOUTPUTMODIFIER_HPP_*/
@@ -0,0 +1,187 @@
+#ifndef TESTCAPSULEWALLBOUNDARYCONDITION_HPP_
+#define TESTCAPSULEWALLBOUNDARYCONDITION_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <map>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+#include "CapsulePopulationBuilder.hpp"
+#include "CapsuleWallBoundaryCondition.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestCapsuleWallBoundaryCondition : public AbstractCellBasedTestSuite
+{
+public:
+
+    void TestBoxAndWellIn2d()
+    {
+        EXIT_IF_PARALLEL;
+
+        // A capsule through the left wall, one through the top wall, one clear of both and one outside the well
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(0.8, 5.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(5.0, 9.5), 0.5*M_PI, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(5.0, 5.0), 0.3, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(18.0, 5.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        CapsuleWallBoundaryCondition<2> box_condition(&population);
+        TS_ASSERT_THROWS_THIS(box_condition.AddBoxWalls(Create_c_vector(0.0, 10.0), Create_c_vector(10.0, 0.0)),
+            "The lower corner must be below the upper corner");
+        TS_ASSERT_THROWS_THIS(box_condition.AddPlaneWall(Create_c_vector(0.0, 0.0), Create_c_vector(0.0, 0.0)),
+            "The wall normal must be non-zero");
+        box_condition.AddBoxWalls(Create_c_vector(0.0, 0.0), Create_c_vector(10.0, 10.0));
+        TS_ASSERT_EQUALS(box_condition.GetNumPlaneWalls(), 4u);
+        TS_ASSERT(!box_condition.HasCircularWell());
+        TS_ASSERT(!box_condition.VerifyBoundaryCondition());
+
+        std::map<Node<2>*, c_vector<double, 2> > old_locations;
+        box_condition.ImposeBoundaryCondition(old_locations);
+
+        TS_ASSERT_EQUALS(box_condition.GetNumCapsulesNearWalls(), 3u);
+        TS_ASSERT(box_condition.VerifyBoundaryCondition());
+
+        // The end caps now touch the walls
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[0], 1.5, 1e-9);
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[1], 5.0, 1e-9);
+        TS_ASSERT_DELTA(population.GetNode(1u)->rGetLocation()[1], 8.5, 1e-9);
+        TS_ASSERT_DELTA(population.GetNode(2u)->rGetLocation()[0], 5.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(2u)->rGetLocation()[1], 5.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(3u)->rGetLocation()[0], 8.5, 1e-9);
+
+        // A well of radius 4 about the centre of the box pulls the outer capsules in radially
+        CapsuleWallBoundaryCondition<2> well_condition(&population);
+        TS_ASSERT_THROWS_THIS(well_condition.SetCircularWell(Create_c_vector(5.0, 5.0), 0.0),
+            "The well radius must be positive");
+        well_condition.SetCircularWell(Create_c_vector(5.0, 5.0), 4.0);
+        TS_ASSERT(well_condition.HasCircularWell());
+        well_condition.ImposeBoundaryCondition(old_locations);
+        TS_ASSERT(well_condition.VerifyBoundaryCondition());
+
+        TS_ASSERT_DELTA(population.GetNode(3u)->rGetLocation()[0], 7.5, 1e-9);
+        TS_ASSERT_DELTA(population.GetNode(3u)->rGetLocation()[1], 5.0, 1e-9);
+        TS_ASSERT_DELTA(population.GetNode(2u)->rGetLocation()[0], 5.0, 1e-12);
+    }
+
+    void TestWedgeIn2d()
+    {
+        EXIT_IF_PARALLEL;
+
+        // A capsule through the floor of a 60 degree wedge with its apex at the origin
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(1.0, 0.2), 0.0, 0.0, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        CapsuleWallBoundaryCondition<2> boundary_condition(&population);
+        boundary_condition.AddPlaneWall(Create_c_vector(0.0, 0.0), Create_c_vector(0.0, 1.0));
+        boundary_condition.AddPlaneWall(Create_c_vector(0.0, 0.0), Create_c_vector(sin(M_PI/3.0), -cos(M_PI/3.0)));
+
+        // Lifting the capsule off the floor pushes it through the sloping wall, and back again
+        std::map<Node<2>*, c_vector<double, 2> > old_locations;
+        boundary_condition.ImposeBoundaryCondition(old_locations);
+        TS_ASSERT(boundary_condition.VerifyBoundaryCondition());
+
+        // The capsule ends up wedged against both walls
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[0], 1.0 + 0.5*sqrt(3.0), 1e-6);
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[1], 0.5, 1e-6);
+    }
+
+    void TestBoxAndOffsetWellIn2d()
+    {
+        EXIT_IF_PARALLEL;
+
+        // A capsule through the right wall of a box and outside a well centred above the box
+        CapsulePopulationBuilder<UniformCellCycleModel, 2> builder;
+        builder.AddCapsule(Create_c_vector(8.9, 9.5), 0.0, 0.0, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<2> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        CapsuleWallBoundaryCondition<2> boundary_condition(&population);
+        boundary_condition.AddBoxWalls(Create_c_vector(0.0, 0.0), Create_c_vector(10.0, 10.0));
+        boundary_condition.SetCircularWell(Create_c_vector(5.0, 12.0), 4.5);
+
+        // The radial push of the well moves the capsule out through the top of the box, and back again
+        std::map<Node<2>*, c_vector<double, 2> > old_locations;
+        boundary_condition.ImposeBoundaryCondition(old_locations);
+        TS_ASSERT(boundary_condition.VerifyBoundaryCondition());
+
+        // The capsule touches the top of the box and the well
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[0], 4.0 + sqrt(9.75), 1e-6);
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[1], 9.5, 1e-6);
+
+        // A channel narrower than the capsule cannot hold it
+        CapsuleWallBoundaryCondition<2> narrow_condition(&population);
+        narrow_condition.AddChannelWalls(Create_c_vector(0.0, 9.0), Create_c_vector(0.0, 9.5));
+        TS_ASSERT_THROWS_THIS(narrow_condition.ImposeBoundaryCondition(old_locations),
+            "Capsule 0 could not be moved inside the walls in 100 sweeps");
+    }
+
+    void TestPlaneAndChannelIn3d()
+    {
+        EXIT_IF_PARALLEL;
+
+        // A flat capsule and an upright capsule sunk into the agar plane z = 0, and a capsule in the channel outlet
+        CapsulePopulationBuilder<UniformCellCycleModel, 3> builder;
+        builder.AddCapsule(Create_c_vector(2.0, 2.0, 0.2), 0.0, 0.5*M_PI, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(5.0, 2.0, 1.0), 0.0, 0.0, 2.0, 0.5, -0.5);
+        builder.AddCapsule(Create_c_vector(50.0, 4.8, 3.0), 0.0, 0.5*M_PI, 2.0, 0.5, -0.5);
+
+        NodesOnlyMesh<3> mesh;
+        builder.GenerateMesh(mesh, 100.0);
+        std::vector<CellPtr> cells;
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        builder.GenerateCells(cells, p_type);
+        NodeBasedCellPopulationWithCapsules<3> population(mesh, cells);
+
+        CapsuleWallBoundaryCondition<3> boundary_condition(&population);
+        boundary_condition.AddPlaneWall(Create_c_vector(0.0, 0.0, 0.0), Create_c_vector(0.0, 0.0, 2.0));
+
+        // The channel is open along x and 5 wide in y and z
+        boundary_condition.AddChannelWalls(Create_c_vector(0.0, 0.0, 0.0), Create_c_vector(0.0, 5.0, 5.0));
+        TS_ASSERT_EQUALS(boundary_condition.GetNumPlaneWalls(), 5u);
+
+        std::map<Node<3>*, c_vector<double, 3> > old_locations;
+        boundary_condition.ImposeBoundaryCondition(old_locations);
+        TS_ASSERT(boundary_condition.VerifyBoundaryCondition());
+
+        TS_ASSERT_DELTA(population.GetNode(0u)->rGetLocation()[2], 0.5, 1e-9);
+        TS_ASSERT_DELTA(population.GetNode(1u)->rGetLocation()[2], 1.5, 1e-9);
+        TS_ASSERT_DELTA(population.GetNode(2u)->rGetLocation()[0], 50.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(2u)->rGetLocation()[1], 4.5, 1e-9);
+        TS_ASSERT_DELTA(population.GetNode(2u)->rGetLocation()[2], 3.0, 1e-12);
+    }
+};
+
+#endif /*TESTCAPSULEWALLBOUNDARYCONDITION_HPP_*/
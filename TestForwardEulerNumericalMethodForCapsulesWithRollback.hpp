@@ -0,0 +1,195 @@
+#ifndef TESTFORWARDEULERNUMERICALMETHODFORCAPSULESWITHROLLBACK_HPP_
+#define TESTFORWARDEULERNUMERICALMETHODFORCAPSULESWITHROLLBACK_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+// Must be included before other cell_based headers
+#include "CellBasedSimulationArchiver.hpp"
+
+#include <cmath>
+
+#include "AbstractCellBasedTestSuite.hpp"
+#include "SmartPointers.hpp"
+#include "NodesOnlyMesh.hpp"
+#include "OffLatticeSimulation.hpp"
+#include "WildTypeCellMutationState.hpp"
+#include "TransitCellProliferativeType.hpp"
+#include "UniformCellCycleModel.hpp"
+#include "UblasCustomFunctions.hpp"
+
+// Header files included in this project
+#include "TypeSixSecretionEnumerations.hpp"
+#include "ForwardEulerNumericalMethodForCapsulesWithRollback.hpp"
+#include "CapsuleForce.hpp"
+#include "NodeBasedCellPopulationWithCapsules.hpp"
+
+// This test is always run sequentially (never in parallel)
+#include "FakePetscSetup.hpp"
+
+class TestForwardEulerNumericalMethodForCapsulesWithRollback : public AbstractCellBasedTestSuite
+{
+private:
+
+    /** Create two strongly overlapping capsules, which push apart quickly. */
+    void CreateOverlappingCapsules(NodesOnlyMesh<2>& rMesh, std::vector<CellPtr>& rCells)
+    {
+        std::vector<Node<2>*> nodes;
+        nodes.push_back(new Node<2>(0u, Create_c_vector(4.0, 4.0)));
+        nodes.push_back(new Node<2>(1u, Create_c_vector(4.1, 4.2)));
+        rMesh.ConstructNodesWithoutMesh(nodes, 100.0);
+
+        for (unsigned node_idx = 0; node_idx < rMesh.GetNumNodes(); ++node_idx)
+        {
+            rMesh.GetNode(node_idx)->AddNodeAttribute(0.0);
+            rMesh.GetNode(node_idx)->rGetNodeAttributes().resize(NA_VEC_LENGTH);
+            rMesh.GetNode(node_idx)->rGetNodeAttributes()[NA_THETA] = 0.25*node_idx;
+            rMesh.GetNode(node_idx)->rGetNodeAttributes()[NA_LENGTH] = 2.0;
+            rMesh.GetNode(node_idx)->rGetNodeAttributes()[NA_RADIUS] = 0.5;
+        }
+
+        MAKE_PTR(WildTypeCellMutationState, p_state);
+        MAKE_PTR(TransitCellProliferativeType, p_type);
+        for (unsigned i=0; i<rMesh.GetNumNodes(); i++)
+        {
+            UniformCellCycleModel* p_model = new UniformCellCycleModel();
+            p_model->SetMinCellCycleDuration(100.0);
+            p_model->SetMaxCellCycleDuration(101.0);
+            CellPtr p_cell(new Cell(p_state, p_model));
+            p_cell->SetCellProliferativeType(p_type);
+            rCells.push_back(p_cell);
+        }
+    }
+
+public:
+
+    void TestParameters()
+    {
+        ForwardEulerNumericalMethodForCapsulesWithRollback<2,2> method;
+
+        TS_ASSERT_DELTA(method.GetMaxDisplacement(), 0.5, 1e-12);
+        TS_ASSERT_DELTA(method.GetMaxRotation(), 0.25*M_PI, 1e-12);
+        TS_ASSERT_EQUALS(method.GetMaxNumberOfHalvings(), 10u);
+        TS_ASSERT_EQUALS(method.GetNumRollbacks(), 0u);
+
+        method.SetMaxDisplacement(0.1);
+        method.SetMaxRotation(0.2);
+        method.SetMaxNumberOfHalvings(4u);
+
+        TS_ASSERT_DELTA(method.GetMaxDisplacement(), 0.1, 1e-12);
+        TS_ASSERT_DELTA(method.GetMaxRotation(), 0.2, 1e-12);
+        TS_ASSERT_EQUALS(method.GetMaxNumberOfHalvings(), 4u);
+
+        // More halvings would overflow the number of substeps
+        TS_ASSERT_THROWS_THIS(method.SetMaxNumberOfHalvings(32u),
+            "The maximum number of halvings must be at most 31");
+        method.SetMaxNumberOfHalvings(31u);
+        TS_ASSERT_EQUALS(method.GetMaxNumberOfHalvings(), 31u);
+    }
+
+    void TestRollbackOfLargeOverlap()
+    {
+        EXIT_IF_PARALLEL;
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        CreateOverlappingCapsules(mesh, cells);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestRollbackOfLargeOverlap");
+        simulator.SetDt(1.0/120.0);
+        simulator.SetSamplingTimestepMultiple(10);
+        simulator.SetEndTime(10.0/120.0);
+
+        // A small limit forces the first steps to be split into substeps
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsulesWithRollback<2,2>>();
+        p_numerical_method->SetMaxDisplacement(1e-3);
+        p_numerical_method->SetMaxNumberOfHalvings(20u);
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<CapsuleForce<2>>();
+        simulator.AddForce(p_capsule_force);
+
+        simulator.Solve();
+
+        TS_ASSERT_LESS_THAN(0u, p_numerical_method->GetNumRollbacks());
+
+        // The capsules have separated and remain finite
+        c_vector<double, 2> x0 = population.GetNode(0)->rGetLocation();
+        c_vector<double, 2> x1 = population.GetNode(1)->rGetLocation();
+        TS_ASSERT(std::isfinite(x0[0]) && std::isfinite(x0[1]));
+        TS_ASSERT(std::isfinite(x1[0]) && std::isfinite(x1[1]));
+        TS_ASSERT_LESS_THAN(norm_2(Create_c_vector(0.1, 0.2)), norm_2(x1 - x0));
+    }
+
+    void TestExceptionRestoresState()
+    {
+        EXIT_IF_PARALLEL;
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        CreateOverlappingCapsules(mesh, cells);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestRollbackExceptionRestoresState");
+        simulator.SetDt(1.0/120.0);
+        simulator.SetEndTime(1.0/120.0);
+
+        // No movement is ever acceptable, so every retry fails
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsulesWithRollback<2,2>>();
+        p_numerical_method->SetMaxDisplacement(0.0);
+        p_numerical_method->SetMaxNumberOfHalvings(2u);
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<CapsuleForce<2>>();
+        simulator.AddForce(p_capsule_force);
+
+        TS_ASSERT_THROWS_CONTAINS(simulator.Solve(), "Capsule positions are still unstable after 2 halvings");
+
+        TS_ASSERT_EQUALS(p_numerical_method->GetNumRollbacks(), 1u);
+        TS_ASSERT_DELTA(population.GetNode(0)->rGetLocation()[0], 4.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(0)->rGetLocation()[1], 4.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1)->rGetLocation()[0], 4.1, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1)->rGetLocation()[1], 4.2, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1)->rGetNodeAttributes()[NA_THETA], 0.25, 1e-12);
+    }
+
+    void TestExceptionWithoutHalvings()
+    {
+        EXIT_IF_PARALLEL;
+
+        NodesOnlyMesh<2> mesh;
+        std::vector<CellPtr> cells;
+        CreateOverlappingCapsules(mesh, cells);
+
+        NodeBasedCellPopulationWithCapsules<2> population(mesh, cells);
+
+        OffLatticeSimulation<2> simulator(population);
+        simulator.SetOutputDirectory("TestRollbackExceptionWithoutHalvings");
+        simulator.SetDt(1.0/120.0);
+        simulator.SetEndTime(1.0/120.0);
+
+        // The failed step is not retried, but the state is still restored
+        auto p_numerical_method = boost::make_shared<ForwardEulerNumericalMethodForCapsulesWithRollback<2,2>>();
+        p_numerical_method->SetMaxDisplacement(0.0);
+        p_numerical_method->SetMaxNumberOfHalvings(0u);
+        simulator.SetNumericalMethod(p_numerical_method);
+
+        auto p_capsule_force = boost::make_shared<CapsuleForce<2>>();
+        simulator.AddForce(p_capsule_force);
+
+        TS_ASSERT_THROWS_CONTAINS(simulator.Solve(), "Capsule positions are still unstable after 0 halvings");
+
+        TS_ASSERT_EQUALS(p_numerical_method->GetNumRollbacks(), 1u);
+        TS_ASSERT_DELTA(population.GetNode(0)->rGetLocation()[0], 4.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(0)->rGetLocation()[1], 4.0, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1)->rGetLocation()[0], 4.1, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1)->rGetLocation()[1], 4.2, 1e-12);
+        TS_ASSERT_DELTA(population.GetNode(1)->rGetNodeAttributes()[NA_THETA], 0.25, 1e-12);
+    }
+};
+
+#endif /*TESTFORWARDEULERNUMERICALMETHODFORCAPSULESWITHROLLBACK_HPP_*/